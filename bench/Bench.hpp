@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Utils.hpp"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Every benchmark is run once to warm up and then repeatCount times, the median and the minimum are reported.
+
+struct Stats
+{
+    double median;
+    double min;
+    double p99;
+};
+
+inline double getTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline Stats computeStats(std::vector<double> &samples)
+{
+    ASSERT(!samples.empty());
+    std::sort(samples.begin(), samples.end());
+    size_t p99Index = min((uint32_t)samples.size() - 1, (uint32_t)(samples.size() * 99 / 100));
+    return { samples[samples.size() / 2], samples[0], samples[p99Index] };
+}
+
+// func takes arg and returns the measured time in seconds
+template <typename Func, typename Arg>
+Stats measure(Func func, Arg &arg, uint32_t repeatCount)
+{
+    std::vector<double> samples(repeatCount);
+    func(arg); // warm up
+
+    for (uint32_t i = 0; i < repeatCount; i++)
+    {
+        samples[i] = func(arg);
+    }
+
+    return computeStats(samples);
+}
+
+// every suite writes a single member of the top level JSON object, without the trailing comma
+
+void runJobSystemBench(FILE *file, uint32_t repeatCount);
+
+void runBlockCompressionBench(FILE *file, uint32_t repeatCount);
+
+void runMipGenerationBench(FILE *file, uint32_t repeatCount);
+
+void runKtx2Bench(FILE *file, uint32_t repeatCount);
\ No newline at end of file
@@ -0,0 +1,231 @@
+#include "Bench.hpp"
+#include "BlockCompression.hpp"
+#include "JobSystem.hpp"
+#include "Parallel.hpp"
+#include "Utils.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr uint32_t imageSize = 512;
+static constexpr uint32_t blockCountPerRow = imageSize / 4;
+static constexpr float compressionQuality = 0.1f; // same as the asset import
+
+enum class BlockFormat : uint8_t
+{
+    BC5 = 0,
+    BC6,
+    BC7
+};
+
+static const char *const blockFormatNames[] = { "BC5", "BC6H", "BC7" };
+
+struct CompressionBenchContext
+{
+    const uint8_t *rgba;
+    const uint16_t *rgbHalf;
+    uint8_t *blocks;
+    BlockFormat format;
+};
+
+static uint16_t floatToHalf(float value) // positive normal range only, enough for the test image
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int32_t exponent = (int32_t)(bits >> 23 & 0xFF) - 127 + 15;
+
+    if (exponent <= 0)
+        return 0;
+    if (exponent >= 31)
+        return 0x7BFF;
+
+    return (uint16_t)(exponent << 10 | (bits >> 13 & 0x3FF));
+}
+
+static float halfToFloat(uint16_t half)
+{
+    uint32_t exponent = half >> 10 & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    return exponent ? ldexpf(1.f + mantissa / 1024.f, (int32_t)exponent - 15) : ldexpf(mantissa / 1024.f, -14);
+}
+
+// gradients, hard edges and noise, so that every mode has something to do
+static void createTestImages(uint8_t *rgba, uint16_t *rgbHalf)
+{
+    srand(1);
+
+    for (uint32_t y = 0; y < imageSize; y++)
+    {
+        for (uint32_t x = 0; x < imageSize; x++)
+        {
+            uint8_t *texel = rgba + (y * imageSize + x) * 4;
+            bool checker = (x / 32 + y / 32) & 1;
+            texel[0] = (uint8_t)(x / 4 + rand() % 24);
+            texel[1] = (uint8_t)(y / 4 + (x / 8 & 1) * 60 + rand() % 12);
+            texel[2] = (uint8_t)((checker ? 200 : 30) + rand() % 8);
+            texel[3] = 255;
+
+            float luminance = exp2f(x * 12.f / imageSize - 4.f);
+            uint16_t *half = rgbHalf + (y * imageSize + x) * 3;
+            half[0] = floatToHalf(luminance);
+            half[1] = floatToHalf(luminance * y / imageSize);
+            half[2] = floatToHalf(checker ? luminance : 0.1f);
+        }
+    }
+}
+
+static void compressBlockRows(uint32_t begin, uint32_t end, void *userData)
+{
+    CompressionBenchContext &context = *(CompressionBenchContext *)userData;
+
+    for (uint32_t row = begin; row < end; row++)
+    {
+        for (uint32_t x = 0; x < blockCountPerRow; x++)
+        {
+            uint32_t texelOffset = row * 4 * imageSize + x * 4;
+            uint8_t *dst = context.blocks + (row * blockCountPerRow + x) * 16;
+
+            switch (context.format)
+            {
+            case BlockFormat::BC5:
+            {
+                const uint8_t *src = context.rgba + texelOffset * 4;
+                uint8_t red[16], green[16];
+
+                for (uint32_t i = 0; i < 16; i++)
+                {
+                    red[i] = src[(i / 4) * imageSize * 4 + (i % 4) * 4];
+                    green[i] = src[(i / 4) * imageSize * 4 + (i % 4) * 4 + 1];
+                }
+
+                compressBlockBC5(red, 4, green, 4, dst);
+                break;
+            }
+            case BlockFormat::BC6:
+                compressBlockBC6(context.rgbHalf + texelOffset * 3, imageSize * 3, dst);
+                break;
+            case BlockFormat::BC7:
+                compressBlockBC7(context.rgba + texelOffset * 4, imageSize * 4, dst);
+                break;
+            }
+        }
+    }
+}
+
+static double runCompression(CompressionBenchContext &context)
+{
+    double start = getTime();
+    parallelFor(0, blockCountPerRow, 1, compressBlockRows, &context);
+    return getTime() - start;
+}
+
+// PSNR of the decoded blocks, BC6H is compared after a x / (1 + x) tone mapping
+static double computePsnr(const CompressionBenchContext &context)
+{
+    double squaredErrorSum = 0.0;
+    uint32_t valueCount = 0;
+
+    for (uint32_t row = 0; row < blockCountPerRow; row++)
+    {
+        for (uint32_t x = 0; x < blockCountPerRow; x++)
+        {
+            uint32_t texelOffset = row * 4 * imageSize + x * 4;
+            const uint8_t *block = context.blocks + (row * blockCountPerRow + x) * 16;
+
+            uint8_t red[16], green[16], rgba[16][4];
+            uint16_t rgb[16][3];
+
+            switch (context.format)
+            {
+            case BlockFormat::BC5:
+                VERIFY(decompressBlockBC5(block, red, green));
+                break;
+            case BlockFormat::BC6:
+                VERIFY(decompressBlockBC6(block, rgb));
+                break;
+            case BlockFormat::BC7:
+                VERIFY(decompressBlockBC7(block, rgba));
+                break;
+            }
+
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                uint32_t srcOffset = texelOffset + (i / 4) * imageSize + i % 4;
+                double diffs[4];
+                uint32_t diffCount = 0;
+
+                switch (context.format)
+                {
+                case BlockFormat::BC5:
+                    diffs[diffCount++] = red[i] - (double)context.rgba[srcOffset * 4];
+                    diffs[diffCount++] = green[i] - (double)context.rgba[srcOffset * 4 + 1];
+                    break;
+                case BlockFormat::BC6:
+                    for (uint32_t c = 0; c < 3; c++)
+                    {
+                        float decoded = halfToFloat(rgb[i][c]);
+                        float original = halfToFloat(context.rgbHalf[srcOffset * 3 + c]);
+                        diffs[diffCount++] = 255.0 * (decoded / (1.f + decoded) - original / (1.f + original));
+                    }
+                    break;
+                case BlockFormat::BC7:
+                    for (uint32_t c = 0; c < 4; c++)
+                    {
+                        diffs[diffCount++] = rgba[i][c] - (double)context.rgba[srcOffset * 4 + c];
+                    }
+                    break;
+                }
+
+                for (uint32_t j = 0; j < diffCount; j++)
+                {
+                    squaredErrorSum += diffs[j] * diffs[j];
+                }
+
+                valueCount += diffCount;
+            }
+        }
+    }
+
+    double meanSquaredError = squaredErrorSum / valueCount;
+    return meanSquaredError > 0.0 ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+}
+
+void runBlockCompressionBench(FILE *file, uint32_t repeatCount)
+{
+    std::vector<uint8_t> rgba(imageSize * imageSize * 4);
+    std::vector<uint16_t> rgbHalf(imageSize * imageSize * 3);
+    std::vector<uint8_t> blocks(blockCountPerRow * blockCountPerRow * 16);
+    createTestImages(rgba.data(), rgbHalf.data());
+
+    initJobSystem();
+    SimdIsa maxIsa = getMaxSimdIsa();
+    double megapixels = imageSize * imageSize / 1e6;
+
+    fprintf(file, "  \"blockCompression\": {\n");
+    fprintf(file, "    \"workerCount\": %u,\n", getWorkerThreadCount());
+    fprintf(file, "    \"imageSize\": %u,\n", imageSize);
+    fprintf(file, "    \"quality\": %.2f,\n", compressionQuality);
+    fprintf(file, "    \"benchmarks\": [\n");
+
+    for (uint32_t isa = 0; isa <= (uint32_t)maxIsa; isa++)
+    {
+        initBlockCompression(compressionQuality, (SimdIsa)isa);
+
+        for (uint32_t format = 0; format < countOf(blockFormatNames); format++)
+        {
+            CompressionBenchContext context { rgba.data(), rgbHalf.data(), blocks.data(), (BlockFormat)format };
+            Stats stats = measure(runCompression, context, repeatCount);
+            bool last = isa == (uint32_t)maxIsa && format + 1 == countOf(blockFormatNames);
+            fprintf(file, "      { \"format\": \"%s\", \"isa\": \"%s\", \"medianMPixPerSecond\": %.2f, \"maxMPixPerSecond\": %.2f, \"psnr\": %.2f }%s\n",
+                blockFormatNames[format], getSimdIsaName((SimdIsa)isa), megapixels / stats.median, megapixels / stats.min,
+                computePsnr(context), last ? "" : ",");
+        }
+    }
+
+    fprintf(file, "    ]\n");
+    fprintf(file, "  }");
+
+    terminateJobSystem();
+    initBlockCompression(compressionQuality);
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "Bench.hpp"
+#include "JobSystem.hpp"
+#include "Utils.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static constexpr uint32_t emptyJobCount = 1 << 20;
+static constexpr uint32_t fanOutJobCount = 64;
+static constexpr uint32_t fanOutIterationCount = 1000;
+static constexpr uint32_t nestedRootJobCount = 256;
+static constexpr uint32_t nestedChildJobCount = 1024;
+static constexpr uint32_t producerJobCount = 1 << 16;
+
+static void emptyJob(int64_t, void *) {}
+
+static std::vector<JobInfo> makeEmptyJobs(uint32_t count)
+{
+    std::vector<JobInfo> jobInfos(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        jobInfos[i] = { emptyJob, i, nullptr, JobPriority::Normal };
+    }
+
+    return jobInfos;
+}
+
+// enqueueJobs + waitForToken for a big batch of jobs that do nothing, measures pure scheduling overhead
+static double runEmptyJobs(std::vector<JobInfo> &jobInfos)
+{
+    Token token = createToken();
+    double start = getTime();
+    enqueueJobs(jobInfos.data(), (uint32_t)jobInfos.size(), token);
+    waitForToken(token);
+    double time = getTime() - start;
+    destroyToken(token);
+    return time;
+}
+
+// latency of a small batch from submission until the waiting thread resumes
+static double runFanOutFanIn(std::vector<JobInfo> &jobInfos)
+{
+    Token token = createToken();
+    double start = getTime();
+    enqueueJobs(jobInfos.data(), (uint32_t)jobInfos.size(), token);
+    waitForToken(token, HelpWhileWaiting::No);
+    double time = getTime() - start;
+    destroyToken(token);
+    return time;
+}
+
+static void nestedRootJob(int64_t, void *userData)
+{
+    std::vector<JobInfo> &childJobInfos = *(std::vector<JobInfo> *)userData;
+    enqueueJobs(childJobInfos.data(), (uint32_t)childJobInfos.size(), getCurrentJobToken());
+}
+
+// jobs that submit jobs from worker threads, the children are tracked by the root token
+static double runNested(std::vector<JobInfo> &childJobInfos)
+{
+    std::vector<JobInfo> rootJobInfos(nestedRootJobCount, { nestedRootJob, 0, (void *)&childJobInfos, JobPriority::Normal });
+    Token token = createToken();
+    double start = getTime();
+    enqueueJobs(rootJobInfos.data(), (uint32_t)rootJobInfos.size(), token);
+    waitForToken(token);
+    double time = getTime() - start;
+    destroyToken(token);
+    return time;
+}
+
+struct ProducerContext
+{
+    std::atomic_uint32_t readyCount;
+    std::atomic_bool go;
+};
+
+static void producerFunc(ProducerContext *context)
+{
+    Token token = createToken();
+    JobInfo jobInfo = { emptyJob, 0, nullptr, JobPriority::Normal };
+    context->readyCount.fetch_add(1, std::memory_order_relaxed);
+
+    while (!context->go.load(std::memory_order_acquire))
+        CPU_PAUSE();
+
+    for (uint32_t i = 0; i < producerJobCount; i++)
+    {
+        enqueueJob(jobInfo, token);
+    }
+
+    waitForToken(token);
+    destroyToken(token);
+}
+
+// several external threads submit single jobs at the same time, past 8 of them the extra ones share the injection queues
+static double runProducers(uint32_t producerCount)
+{
+    ProducerContext context;
+    context.readyCount = 0;
+    context.go = false;
+    std::vector<std::thread> producers;
+
+    for (uint32_t i = 0; i < producerCount; i++)
+    {
+        producers.emplace_back(producerFunc, &context);
+    }
+
+    while (context.readyCount.load(std::memory_order_relaxed) < producerCount)
+        std::this_thread::yield();
+
+    double start = getTime();
+    context.go.store(true, std::memory_order_release);
+
+    for (std::thread &producer : producers)
+    {
+        producer.join();
+    }
+
+    return getTime() - start;
+}
+
+// producerCount is omitted when 0
+static void writeThroughput(FILE *file, const char *name, const Stats &stats, uint64_t jobCount, uint32_t producerCount, bool last)
+{
+    fprintf(file, "      { \"name\": \"%s\", ", name);
+
+    if (producerCount)
+        fprintf(file, "\"producers\": %u, ", producerCount);
+
+    fprintf(file, "\"jobs\": %llu, \"medianNsPerJob\": %.2f, \"minNsPerJob\": %.2f, \"medianJobsPerSecond\": %.0f }%s\n",
+        (unsigned long long)jobCount, stats.median * 1e9 / jobCount, stats.min * 1e9 / jobCount, jobCount / stats.median, last ? "" : ",");
+}
+
+void runJobSystemBench(FILE *file, uint32_t repeatCount)
+{
+    initJobSystem();
+    uint32_t workerCount = getWorkerThreadCount();
+    uint32_t producerCount = max(std::thread::hardware_concurrency(), 1);
+
+    std::vector<JobInfo> emptyJobInfos = makeEmptyJobs(emptyJobCount);
+    Stats emptyStats = measure(runEmptyJobs, emptyJobInfos, repeatCount);
+
+    std::vector<JobInfo> fanOutJobInfos = makeEmptyJobs(fanOutJobCount);
+    Stats fanOutStats = measure(runFanOutFanIn, fanOutJobInfos, fanOutIterationCount);
+
+    std::vector<JobInfo> childJobInfos = makeEmptyJobs(nestedChildJobCount);
+    Stats nestedStats = measure(runNested, childJobInfos, repeatCount);
+
+    std::vector<Stats> producerStats(producerCount);
+
+    for (uint32_t i = 0; i < producerCount; i++)
+    {
+        uint32_t count = i + 1;
+        producerStats[i] = measure(runProducers, count, repeatCount);
+    }
+
+    terminateJobSystem();
+
+    fprintf(file, "  \"jobSystem\": {\n");
+    fprintf(file, "    \"workerCount\": %u,\n", workerCount);
+    fprintf(file, "    \"benchmarks\": [\n");
+    writeThroughput(file, "emptyJobs", emptyStats, emptyJobCount, 0, false);
+    fprintf(file, "      { \"name\": \"fanOutFanIn\", \"jobs\": %u, \"iterations\": %u, \"medianUs\": %.2f, \"minUs\": %.2f, \"p99Us\": %.2f },\n",
+        fanOutJobCount, fanOutIterationCount, fanOutStats.median * 1e6, fanOutStats.min * 1e6, fanOutStats.p99 * 1e6);
+    writeThroughput(file, "nested", nestedStats, (uint64_t)nestedRootJobCount * (nestedChildJobCount + 1), 0, false);
+
+    for (uint32_t i = 0; i < producerCount; i++)
+    {
+        writeThroughput(file, "producers", producerStats[i], (uint64_t)producerJobCount * (i + 1), i + 1, i + 1 == producerCount);
+    }
+
+    fprintf(file, "    ]\n");
+    fprintf(file, "  }");
+}
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "Bench.hpp"
+#include "BlockCompression.hpp"
+#include "JobSystem.hpp"
+#include "Ktx2.hpp"
+#include "MipGeneration.hpp"
+#include "Parallel.hpp"
+#include "Utils.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define KHRONOS_STATIC
+#include <ktx.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// BC7 textures with full mip chains, like the imported materials, written plain and with several Zstandard levels.
+// The files are written into the working dir and stay in the page cache between the runs, so the times are the decode cost, the bytes are what the storage has to deliver.
+
+static constexpr uint16_t imageSize = 1024;
+static constexpr uint8_t levelCount = 11;
+static constexpr uint32_t imageCount = 8;
+static constexpr uint32_t vkFormatBC7Unorm = 145; // VK_FORMAT_BC7_UNORM_BLOCK
+static const uint32_t zstdLevels[] = { 0, 3, 9, 19 }; // 0 is no supercompression
+
+struct LevelCompressionContext
+{
+    const uint8_t *rgba;
+    uint8_t *blocks;
+    uint16_t mipSize;
+};
+
+struct LoadBenchContext
+{
+    const char *const *filenames;
+    uint8_t *const *dsts;
+    double cpuTime; // of the last run
+};
+
+static double getCpuTime() // of all the threads of the process
+{
+#ifdef _WIN32
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+    VERIFY(GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime));
+    uint64_t kernel = (uint64_t)kernelTime.dwHighDateTime << 32 | kernelTime.dwLowDateTime;
+    uint64_t user = (uint64_t)userTime.dwHighDateTime << 32 | userTime.dwLowDateTime;
+    return (kernel + user) * 1e-7;
+#else
+    timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+static void compressBlockRows(uint32_t begin, uint32_t end, void *userData)
+{
+    LevelCompressionContext &context = *(LevelCompressionContext *)userData;
+    uint32_t blockCountPerRow = max(context.mipSize / 4u, 1u);
+
+    for (uint32_t row = begin; row < end; row++)
+    {
+        for (uint32_t x = 0; x < blockCountPerRow; x++)
+        {
+            uint8_t texels[16][4]; // the levels below 4x4 repeat their edge texels
+
+            for (uint32_t i = 0; i < 16; i++)
+            {
+                uint32_t texelX = min(x * 4 + i % 4, context.mipSize - 1u);
+                uint32_t texelY = min(row * 4 + i / 4, context.mipSize - 1u);
+                memcpy(texels[i], context.rgba + (texelY * context.mipSize + texelX) * 4, 4);
+            }
+
+            compressBlockBC7(texels[0], 16, context.blocks + (row * blockCountPerRow + x) * 16);
+        }
+    }
+}
+
+// gradients and noise, every image has its own seed, so that the files differ
+static std::vector<uint8_t> createBC7Image(uint32_t seed)
+{
+    uint32_t rgbaSize = 0, bc7Size = 0;
+
+    for (uint32_t i = 0, mipSize = imageSize; i < levelCount; i++, mipSize /= 2)
+    {
+        rgbaSize += mipSize * mipSize * 4;
+        bc7Size += max(mipSize / 4, 1u) * max(mipSize / 4, 1u) * 16;
+    }
+
+    std::vector<uint8_t> rgba(rgbaSize);
+    std::vector<uint8_t> bc7(bc7Size);
+    srand(seed);
+
+    for (uint32_t y = 0; y < imageSize; y++)
+    {
+        for (uint32_t x = 0; x < imageSize; x++)
+        {
+            uint8_t *texel = rgba.data() + (y * imageSize + x) * 4;
+            texel[0] = (uint8_t)(x / 4 + rand() % 32);
+            texel[1] = (uint8_t)(y / 4 + rand() % 16);
+            texel[2] = (uint8_t)(((x / 64 + y / 64 + seed) & 1) * 160 + rand() % 8);
+            texel[3] = 255;
+        }
+    }
+
+    generateMips(rgba.data(), imageSize, imageSize, 1, levelCount, MipTexelFormat::Rgba8Unorm, MipFilter::Box);
+
+    for (uint32_t i = 0, mipSize = imageSize, rgbaOffset = 0, bc7Offset = 0; i < levelCount; i++, mipSize /= 2)
+    {
+        LevelCompressionContext context { rgba.data() + rgbaOffset, bc7.data() + bc7Offset, (uint16_t)mipSize };
+        uint32_t blockRowCount = max(mipSize / 4, 1u);
+        parallelFor(0, blockRowCount, 1, compressBlockRows, &context);
+        rgbaOffset += mipSize * mipSize * 4;
+        bc7Offset += blockRowCount * blockRowCount * 16;
+    }
+
+    return bc7;
+}
+
+static void writeKtx2File(const char *filename, const std::vector<uint8_t> &bc7, uint32_t zstdLevel)
+{
+    ktxTexture2 *texture;
+    ktxTextureCreateInfo createInfo {};
+    createInfo.vkFormat = vkFormatBC7Unorm;
+    createInfo.baseWidth = imageSize;
+    createInfo.baseHeight = imageSize;
+    createInfo.baseDepth = 1;
+    createInfo.numDimensions = 2;
+    createInfo.numLevels = levelCount;
+    createInfo.numLayers = 1;
+    createInfo.numFaces = 1;
+    VERIFY(ktxTexture2_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) == KTX_SUCCESS);
+
+    for (uint32_t i = 0, mipSize = imageSize, offset = 0; i < levelCount; i++, mipSize /= 2)
+    {
+        uint32_t levelSize = max(mipSize / 4, 1u) * max(mipSize / 4, 1u) * 16;
+        VERIFY(ktxTexture_SetImageFromMemory(ktxTexture(texture), i, 0, 0, bc7.data() + offset, levelSize) == KTX_SUCCESS);
+        offset += levelSize;
+    }
+
+    if (zstdLevel)
+        VERIFY(ktxTexture2_DeflateZstd(texture, zstdLevel) == KTX_SUCCESS);
+
+    VERIFY(ktxTexture_WriteToNamedFile(ktxTexture(texture), filename) == KTX_SUCCESS);
+    ktxTexture_Destroy(ktxTexture(texture));
+}
+
+static double runLoad(LoadBenchContext &context)
+{
+    Ktx2File files[imageCount];
+    double cpuStart = getCpuTime();
+    double start = getTime();
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        files[i] = openKtx2File(context.filenames[i]);
+    }
+
+    readKtx2Levels(files, context.dsts, imageCount);
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        closeKtx2File(files[i]);
+    }
+
+    double time = getTime() - start;
+    context.cpuTime = getCpuTime() - cpuStart;
+    return time;
+}
+
+void runKtx2Bench(FILE *file, uint32_t repeatCount)
+{
+    initJobSystem();
+    initMipGeneration();
+    initBlockCompression(0.1f); // same as the asset import
+
+    std::vector<uint8_t> images[imageCount];
+    std::vector<uint8_t> loadedImages[imageCount];
+    uint8_t *dsts[imageCount];
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        images[i] = createBC7Image(i + 1);
+        loadedImages[i].resize(images[i].size());
+        dsts[i] = loadedImages[i].data();
+    }
+
+    double megabytes = images[0].size() * imageCount / 1e6;
+
+    fprintf(file, "  \"ktx2Load\": {\n");
+    fprintf(file, "    \"workerCount\": %u,\n", getWorkerThreadCount());
+    fprintf(file, "    \"imageSize\": %u,\n", imageSize);
+    fprintf(file, "    \"imageCount\": %u,\n", imageCount);
+    fprintf(file, "    \"payloadBytes\": %u,\n", (uint32_t)(images[0].size() * imageCount));
+    fprintf(file, "    \"benchmarks\": [\n");
+
+    for (uint32_t level = 0; level < countOf(zstdLevels); level++)
+    {
+        char filenameBuffers[imageCount][64];
+        const char *filenames[imageCount];
+        uint64_t fileBytes = 0;
+
+        for (uint32_t i = 0; i < imageCount; i++)
+        {
+            snprintf(filenameBuffers[i], sizeof(filenameBuffers[i]), "ktx2Bench_image%u_zstd%u.ktx2", i, zstdLevels[level]);
+            filenames[i] = filenameBuffers[i];
+            writeKtx2File(filenames[i], images[i], zstdLevels[level]);
+
+            uint64_t size, modifiedTime;
+            VERIFY(getFileStats(filenames[i], size, modifiedTime));
+            fileBytes += size;
+        }
+
+        LoadBenchContext context { filenames, dsts, 0.0 };
+        Stats stats = measure(runLoad, context, repeatCount);
+
+        for (uint32_t i = 0; i < imageCount; i++)
+        {
+            VERIFY(loadedImages[i] == images[i]);
+            remove(filenames[i]);
+        }
+
+        bool last = level + 1 == countOf(zstdLevels);
+        fprintf(file, "      { \"zstdLevel\": %u, \"fileBytes\": %llu, \"medianMs\": %.3f, \"minMs\": %.3f, \"medianMBPerSecond\": %.2f, \"lastCpuMs\": %.3f }%s\n",
+            zstdLevels[level], (unsigned long long)fileBytes, stats.median * 1e3, stats.min * 1e3, megabytes / stats.median, context.cpuTime * 1e3, last ? "" : ",");
+    }
+
+    fprintf(file, "    ]\n");
+    fprintf(file, "  }");
+
+    terminateJobSystem();
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#include "Bench.hpp"
+#include "JobSystem.hpp"
+#include "MipGeneration.hpp"
+#include "Utils.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr uint16_t imageSize = 2048;
+static constexpr uint8_t levelCount = 12;
+
+static const char *const texelFormatNames[] = { "rgba8Unorm", "rgba8Srgb", "rgba8Normal", "rgba16Float" };
+static const char *const filterNames[] = { "box", "kaiser" };
+
+struct MipBenchContext
+{
+    const uint8_t *level0;
+    uint8_t *data;
+    uint32_t level0Size;
+    MipTexelFormat format;
+    MipFilter filter;
+};
+
+static uint32_t calcChainSize(uint32_t texelSize)
+{
+    uint32_t size = 0;
+
+    for (uint32_t i = 0, mipSize = imageSize; i < levelCount; i++, mipSize /= 2)
+    {
+        size += mipSize * mipSize * texelSize;
+    }
+
+    return size;
+}
+
+static double runMipGeneration(MipBenchContext &context)
+{
+    memcpy(context.data, context.level0, context.level0Size);
+    double start = getTime();
+    generateMips(context.data, imageSize, imageSize, 1, levelCount, context.format, context.filter);
+    return getTime() - start;
+}
+
+static double runRenormalization(MipBenchContext &context)
+{
+    memcpy(context.data, context.level0, context.level0Size);
+    double start = getTime();
+    renormalizeNormals(context.data, imageSize * imageSize);
+    return getTime() - start;
+}
+
+void runMipGenerationBench(FILE *file, uint32_t repeatCount)
+{
+    std::vector<uint8_t> level0(imageSize * imageSize * 8);
+    std::vector<uint8_t> data(calcChainSize(8));
+    srand(1);
+
+    for (uint32_t i = 0; i < imageSize * imageSize * 4; i++) // finite positive half floats, noise for the 8 bit formats too
+    {
+        ((uint16_t *)level0.data())[i] = (uint16_t)(rand() % 0x7C00);
+    }
+
+    initJobSystem();
+    SimdIsa maxIsa = getMaxSimdIsa();
+    double megapixels = imageSize * imageSize / 1e6;
+
+    fprintf(file, "  \"mipGeneration\": {\n");
+    fprintf(file, "    \"workerCount\": %u,\n", getWorkerThreadCount());
+    fprintf(file, "    \"imageSize\": %u,\n", imageSize);
+    fprintf(file, "    \"benchmarks\": [\n");
+
+    for (uint32_t isa = 0; isa <= (uint32_t)maxIsa; isa++)
+    {
+        initMipGeneration((SimdIsa)isa);
+
+        for (uint32_t format = 0; format < countOf(texelFormatNames); format++)
+        {
+            for (uint32_t filter = 0; filter < countOf(filterNames); filter++)
+            {
+                uint32_t texelSize = (MipTexelFormat)format == MipTexelFormat::Rgba16Float ? 8 : 4;
+                MipBenchContext context { level0.data(), data.data(), imageSize * imageSize * texelSize, (MipTexelFormat)format, (MipFilter)filter };
+                Stats stats = measure(runMipGeneration, context, repeatCount);
+                bool last = isa == (uint32_t)maxIsa && format + 1 == countOf(texelFormatNames) && filter + 1 == countOf(filterNames);
+                fprintf(file, "      { \"format\": \"%s\", \"filter\": \"%s\", \"isa\": \"%s\", \"medianMPixPerSecond\": %.2f, \"maxMPixPerSecond\": %.2f }%s\n",
+                    texelFormatNames[format], filterNames[filter], getSimdIsaName((SimdIsa)isa), megapixels / stats.median, megapixels / stats.min, last ? "" : ",");
+            }
+        }
+    }
+
+    fprintf(file, "    ],\n");
+    fprintf(file, "    \"renormalization\": [\n");
+
+    for (uint32_t isa = 0; isa <= (uint32_t)maxIsa; isa++)
+    {
+        initMipGeneration((SimdIsa)isa);
+        MipBenchContext context { level0.data(), data.data(), imageSize * imageSize * 4, MipTexelFormat::Rgba8Normal, MipFilter::Box };
+        Stats stats = measure(runRenormalization, context, repeatCount);
+        fprintf(file, "      { \"isa\": \"%s\", \"medianMPixPerSecond\": %.2f, \"maxMPixPerSecond\": %.2f }%s\n",
+            getSimdIsaName((SimdIsa)isa), megapixels / stats.median, megapixels / stats.min, isa == (uint32_t)maxIsa ? "" : ",");
+    }
+
+    fprintf(file, "    ]\n");
+    fprintf(file, "  }");
+
+    terminateJobSystem();
+    initMipGeneration();
+}
\ No newline at end of file
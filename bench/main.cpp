@@ -0,0 +1,76 @@
+#include "Bench.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Standalone microbenchmarks, no window or GPU involved.
+
+static void printUsage(FILE *file)
+{
+    fprintf(file, "Usage: cutter-bench [output.json] [repeat count]\n");
+    fprintf(file, "Writes the results as JSON to output.json or to stdout, every benchmark is repeated 10 times by default.\n");
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help"))
+        {
+            printUsage(stdout);
+            return 0;
+        }
+
+        if (argv[i][0] == '-')
+        {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            printUsage(stderr);
+            return 1;
+        }
+    }
+
+    if (argc > 3)
+    {
+        printUsage(stderr);
+        return 1;
+    }
+
+    const char *outputPath = argc > 1 ? argv[1] : nullptr;
+    int32_t repeatArg = argc > 2 ? atoi(argv[2]) : 10;
+
+    if (repeatArg < 1)
+    {
+        fprintf(stderr, "Invalid repeat count %s\n", argv[2]);
+        printUsage(stderr);
+        return 1;
+    }
+
+    uint32_t repeatCount = (uint32_t)repeatArg;
+
+    FILE *file = outputPath ? fopen(outputPath, "w") : stdout;
+
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open %s\n", outputPath);
+        return 1;
+    }
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"repeatCount\": %u,\n", repeatCount);
+    runJobSystemBench(file, repeatCount);
+    fprintf(file, ",\n");
+    runBlockCompressionBench(file, repeatCount);
+    fprintf(file, ",\n");
+    runMipGenerationBench(file, repeatCount);
+#ifdef ENABLE_KTX2_BENCH
+    fprintf(file, ",\n");
+    runKtx2Bench(file, repeatCount);
+#endif
+    fprintf(file, "\n}\n");
+
+    if (file != stdout)
+        fclose(file);
+
+    return 0;
+}
\ No newline at end of file
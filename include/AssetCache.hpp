@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Imported assets are keyed by a hash of their sources and import settings, the keys are kept in a manifest file.
+// The hash of a source file is reused while its size and modification time stay the same, so a warm start reads no sources.
+// Not thread safe.
+
+void loadAssetCache(const char *manifestPath);
+
+// writes the manifest if anything changed
+void saveAssetCache();
+
+uint64_t hashSourceFile(const char *filename);
+
+// the asset exists and was made with the same key
+bool isAssetUpToDate(const char *assetPath, uint64_t key);
+
+// call after the asset is written
+void setAssetKey(const char *assetPath, uint64_t key);
\ No newline at end of file
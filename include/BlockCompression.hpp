@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Utils.hpp"
+
+#include <stdint.h>
+
+// Native BC5, BC6H (unsigned) and BC7 encoders working on a single 4x4 block.
+// Strides are in elements of the source type between the starts of two block rows.
+
+// quality is in [0, 1], higher values spend more time on endpoint refinement and the BC7 partition search
+// maxIsa caps the instruction set, mostly useful for benchmarking, not thread safe
+void initBlockCompression(float quality, SimdIsa maxIsa = SimdIsa::Avx2);
+
+void compressBlockBC5(const uint8_t *red, uint32_t redStride, const uint8_t *green, uint32_t greenStride, uint8_t *dst);
+
+void compressBlockBC6(const uint16_t *rgb, uint32_t stride, uint8_t *dst); // half floats, negative values are clamped to 0
+
+void compressBlockBC7(const uint8_t *rgba, uint32_t stride, uint8_t *dst);
+
+// the decoders only support the modes the encoders above produce and return false for the rest
+
+bool decompressBlockBC5(const uint8_t *src, uint8_t red[16], uint8_t green[16]);
+
+bool decompressBlockBC6(const uint8_t *src, uint16_t rgb[16][3]);
+
+bool decompressBlockBC7(const uint8_t *src, uint8_t rgba[16][4]);
\ No newline at end of file
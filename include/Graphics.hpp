@@ -111,6 +111,32 @@ void copyImage(const Image &srcImage, GpuImage &dstImage, QueueFamily dstQueueFa
 
 void copyImage(const GpuImage &srcImage, Image &dstImage, QueueFamily srcQueueFamily, VkImageLayout srcLayout = VK_IMAGE_LAYOUT_UNDEFINED);
 
+// all images share one staging buffer trip and one submission per queue, so their total size must fit into the staging buffer
+void copyImages(const Image *srcImages, GpuImage *dstImages, uint32_t imageCount, QueueFamily dstQueueFamily, VkImageLayout dstLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+void copyImages(const GpuImage *srcImages, Image *dstImages, uint32_t imageCount, QueueFamily srcQueueFamily, VkImageLayout srcLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+
+typedef void (*FillStagingCallback)(uint8_t *const *stagingData, uint32_t imageCount, void *userData);
+
+// srcImages only describe the layout, their data is written straight into the staging buffer by fillCallback in the Image layout,
+// it gets the staging addresses of all images at once, so it can fill them in parallel
+void copyImages(const Image *srcImages, GpuImage *dstImages, uint32_t imageCount, FillStagingCallback fillCallback, void *userData,
+    QueueFamily dstQueueFamily, VkImageLayout dstLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+typedef void (*FillStagingRowsCallback)(uint8_t *stagingData, uint16_t firstRow, uint16_t rowCount, void *userData);
+
+// srcImage has a single level and face and only describes the layout, its rows are written by fillCallback a strip at a time,
+// as many rows as fit into half of the staging buffer, a strip is filled while the previous one is copied from the other half,
+// so the image may be bigger than the staging buffer, only the last strip is waited for before returning
+void copyImageRows(const Image &srcImage, GpuImage &dstImage, FillStagingRowsCallback fillCallback, void *userData,
+    QueueFamily dstQueueFamily, VkImageLayout dstLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+uint32_t getStagingBufferSize();
+
+// only records the copy of every level and face, srcImage must be in VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+// dstImage only describes the layout of the data in dstBuffer, e.g. for a later copyBufferToStagingBuffer
+void copyImageToBuffer(Cmd cmd, const GpuImage &srcImage, const Image &dstImage, GpuBuffer &dstBuffer);
+
 void blitGpuImageMips(Cmd cmd, GpuImage &gpuImage, VkImageLayout oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
     VkImageLayout newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, StageFlags srcStage = StageFlags::None, StageFlags dstStage = StageFlags::None);
 
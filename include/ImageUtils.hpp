@@ -1,10 +1,14 @@
 #pragma once
 
+#include "MipGeneration.hpp"
 #include "Utils.hpp"
 
 #include <stdint.h>
 #include <volk/volk.h>
 
+struct GpuImage; // Graphics.hpp includes this header
+enum class QueueFamily : uint8_t;
+
 enum class ImagePurpose : uint8_t
 {
     Undefined = 0,
@@ -29,22 +33,87 @@ static_assert(sizeof(Image) == 24, "");
 EnumBool(GenerateMips);
 EnumBool(Compress);
 
+enum class CompressionDevice : uint8_t
+{
+    Cpu = 0,
+    Gpu
+};
+
+enum class MipDevice : uint8_t
+{
+    Cpu = 0,
+    Gpu
+};
+
+struct ImageImportInfo
+{
+    const uint8_t *data; // encoded image, inImageFilename is read instead if it is null
+    uint32_t dataSize;
+    const char *inImageFilename;
+    const char *outImageFilename;
+    ImagePurpose purpose;
+};
+
+struct EnvMapBakeInfo
+{
+    const char *hdriPath;
+    const char *skyboxPath;
+    const char *irradianceShPath; // written as a raw IrradianceSh
+    const char *prefilteredMapPath;
+};
+
+// the CPU side of the import: mips, HDR decoding and block compression, enough to import images without a Vulkan device,
+// initImageUtils calls it too
+void initCpuImageUtils();
+
+void terminateCpuImageUtils();
+
 void initImageUtils(const char *computeSkyboxShaderPath,
     const char *computeBrdfLutShaderPath,
-    const char *computeIrradianceMapShaderPath,
+    const char *computeIrradianceShShaderPath,
     const char *computePrefilteredMapShaderPath,
-    const char *normalizeNormalMapShaderPath);
+    const char *normalizeNormalMapShaderPath,
+    const char *compressBC5ShaderPath,
+    const char *compressBC6ShaderPath,
+    const char *compressBC7ShaderPath,
+    const char *generateMipsRgba8ShaderPath,
+    const char *generateMipsRgba16fShaderPath);
 
 void terminateImageUtils();
 
+// where the blocks of the images of the purpose are encoded, only HDRIs use the GPU by default
+void setCompressionDevice(ImagePurpose purpose, CompressionDevice compressionDevice);
+
+// the CPU skips the upload and readback and filters in linear space, it is used when there is no Vulkan device
+// and for images above 4096x4096 too, unless the mips are blitted
+void setMipGeneration(MipDevice mipDevice, MipFilter mipFilter);
+
+// 0 writes the levels as they are, 1 to 22 deflates every level into its own Zstandard frame, so they decode in parallel
+void setSupercompressionLevel(uint32_t zstdLevel);
+
+// normal maps of at least minTexelCount texels, all faces, are renormalized on the GPU when there is a device, 4096x4096 by default:
+// the CPU does ~350 MPix/s per core with AVX2 (cutter-bench), only maps that hold a worker for ~50 ms repay 8 bytes of staging copies per texel
+void setGpuNormalizationThreshold(uint32_t minTexelCount);
+
+// everything that changes the imported images of the purpose, for the asset cache keys, HDRIs include the env map sizes
+uint64_t hashImageImportSettings(ImagePurpose purpose, uint64_t seed);
+
 void importImage(const uint8_t *data, uint32_t dataSize, ImagePurpose purpose, const char *outImageFilename);
 
 void importImage(const char *inImageFilename, const char *outImageFilename, ImagePurpose purpose);
 
+// decoding and writing run on the job system while the calling thread does the GPU steps of a batch of images at once,
+// so several images are in flight, must be called from the thread that owns the Vulkan queues
+void importImages(const ImageImportInfo *infos, uint32_t imageCount);
+
 void writeImage(Image &image, const char *outImageFilename, GenerateMips generateMips, Compress compress);
 
 Image loadImage(const char *inImageFilename);
 
+// the KTX2 files are mapped and their levels are copied straight into the staging buffer, once,
+// as many images as the staging buffer holds go in one submission, 6 face images become cubemaps
+void loadGpuImages(const char *const *inImageFilenames, GpuImage *gpuImages, uint32_t imageCount, QueueFamily dstQueueFamily, VkImageUsageFlags usageFlags);
+
 void destroyImage(Image &image);
 
 void createImageMips(Image &image);
@@ -55,4 +124,6 @@ uint32_t iterateImageLevelFaces(const Image &image, IterateCallback callback, vo
 
 void computeBrdfLut(const char *brdfLutPath);
 
-void computeEnvMaps(const char *hdriPath, const char *skyboxPath, const char *irradianceMapPath, const char *prefilteredMapPath);
\ No newline at end of file
+// all HDRIs as one pipeline: the GPU bakes one while the previous one is read back, the next one is opened
+// and the maps before are compressed and written on the job system, the HDRIs are decoded to RGBA16F in strips straight into the staging buffer
+void computeEnvMaps(const EnvMapBakeInfo *infos, uint32_t hdriCount);
\ No newline at end of file
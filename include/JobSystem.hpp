@@ -2,26 +2,104 @@
 
 #include <stdint.h>
 
+#include "Utils.hpp"
+
 typedef struct Token_t *Token;
 typedef void (*JobFunc)(int64_t userIndex, void *userData);
 
+enum class JobPriority : uint8_t
+{
+    Normal = 0, // zero so that a zeroed JobInfo is a normal job
+    Critical, // per frame work, runs before anything else and on the reserved workers
+    Background // asset baking, runs only when nothing else is queued
+};
+
 struct JobInfo
 {
     JobFunc func;
     int64_t userIndex;
     void *userData;
+    JobPriority priority;
+};
+
+struct JobGraphNode
+{
+    JobInfo jobInfo;
+    const uint32_t *predecessors; // indices of the nodes that must finish first, they must come before this node
+    uint32_t predecessorCount;
+};
+
+// cores are counted among the usable ones, i.e. in the process affinity mask and after skipping SMT siblings
+struct JobSystemConfig
+{
+    uint32_t workerCount; // 0 means one per core of the window that is not reserved
+    uint32_t reservedWorkerCount; // workers that run only critical jobs, so those start right away even if the others are busy
+    uint32_t reservedCoreCount; // cores at the start of the window left to the calling thread, the driver and shaderc threads
+    uint32_t firstCore; // the window lets several processes share a machine without stepping on each other
+    uint32_t coreCount; // 0 means up to the last usable core
+    bool pinThreads; // pin every worker to its own core of the window and the calling thread to the reserved cores
+    bool skipSmtSiblings; // use only one logical core of every physical core
+};
+
+// bucket 0 counts latencies below 1 us, bucket i the ones in [2^(i - 1), 2^i) us, the last one everything slower
+static constexpr uint32_t jobLatencyBucketCount = 16;
+
+// cumulative since initJobSystem, times are in nanoseconds
+struct WorkerStats
+{
+    uint64_t executedJobCount;
+    uint64_t stolenJobCount;
+    uint64_t busyTime;
+    uint64_t spinTime; // looking for jobs
+    uint64_t idleTime; // sleeping
+    uint64_t latencyHistogram[jobLatencyBucketCount]; // from enqueue to start
 };
 
-void initJobSystem();
+EnumBool(HelpWhileWaiting);
+
+void initJobSystem(const JobSystemConfig &config = {});
 
 void terminateJobSystem();
 
+uint32_t getWorkerThreadCount();
+
+// fills up to maxCount entries, returns the worker count
+uint32_t getWorkerStats(WorkerStats *stats, uint32_t maxCount);
+
+uint32_t getQueuedJobCount();
+
+// plots the totals of all workers since the previous call in Tracy, meant to be called once per frame
+void plotJobSystemStats();
+
 Token createToken();
 
+// handles are generation checked, using a destroyed token aborts, in release builds too
 void destroyToken(Token token);
 
+// queued jobs of a cancelled token are dropped, the running ones finish early if they poll isCancelled,
+// so waitForToken returns quickly, the token stays cancelled until it is destroyed
+void cancelToken(Token token);
+
+bool isCancelled(Token token);
+
+// the token of the job running on the calling thread, nullptr outside of jobs
+Token getCurrentJobToken();
+
+// the priority of the job running on the calling thread, Normal outside of jobs
+JobPriority getCurrentJobPriority();
+
+// 16 byte aligned memory for job payloads, freed in bulk when the token is destroyed
+void *allocateJobData(Token token, uint32_t size);
+
 void enqueueJob(JobInfo jobInfo, Token token);
 
 void enqueueJobs(JobInfo *jobInfos, uint32_t jobsCount, Token token);
 
-void waitForToken(Token token);
\ No newline at end of file
+// the job is enqueued once all jobs of dependency are done, token is counted right away
+void enqueueJobAfter(JobInfo jobInfo, Token dependency, Token token);
+
+// every node is enqueued once all its predecessors are done, token counts all nodes and keeps the graph in its arena
+void enqueueJobGraph(const JobGraphNode *nodes, uint32_t nodeCount, Token token);
+
+// with HelpWhileWaiting::Yes the caller runs queued jobs until the token is done, then parks instead of spinning
+void waitForToken(Token token, HelpWhileWaiting help = HelpWhileWaiting::Yes);
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Utils.hpp"
+
+#include <stdint.h>
+
+// Reading of the KTX2 files written by writeImage without libktx, the files are mapped and every level is copied or
+// decompressed straight into its destination, no Vulkan involved.
+// The destination layout is the one of Image: levels one after another, largest first, the faces of a level together.
+
+struct Ktx2Level
+{
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+static_assert(sizeof(Ktx2Level) == 24, "");
+
+enum class Ktx2Supercompression : uint32_t
+{
+    None = 0,
+    Zstd = 2 // one frame per level, the faces of a level share it
+};
+
+struct Ktx2File
+{
+    MappedFile file;
+    const Ktx2Level *levels;
+    uint32_t vkFormat;
+    uint16_t width, height;
+    uint8_t faceCount, levelCount;
+    Ktx2Supercompression supercompression;
+    uint32_t dataSize; // of all levels after decompression
+};
+
+// VERIFYs that the file is a 2D image or cubemap the loader understands
+Ktx2File openKtx2File(const char *filename);
+
+void closeKtx2File(Ktx2File &file);
+
+// one job per level of all the files, the big ones start first, dsts[i] must have room for files[i].dataSize
+void readKtx2Levels(const Ktx2File *files, uint8_t *const *dsts, uint32_t fileCount);
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Utils.hpp"
+
+#include <stdint.h>
+
+// CPU mip chains of RGBA8 and RGBA16F images, laid out like Image: levels one after another, all faces of a level together.
+// Every level is a 2x downsample of the previous one, filtered in linear space, its rows are spread over the job system.
+
+enum class MipFilter : uint8_t
+{
+    Box = 0, // 2x2 average, same as a linear blit
+    Kaiser // 6x6 Kaiser windowed sinc, sharper, the edges are clamped
+};
+
+enum class MipTexelFormat : uint8_t
+{
+    Rgba8Unorm = 0,
+    Rgba8Srgb, // rgb are filtered after the conversion to linear
+    Rgba8Normal, // rgb hold a normal that is renormalized after filtering, like normalizeNormalMap.comp does
+    Rgba16Float // negative values are clamped to 0
+};
+
+// builds the lookup tables and the kernels, maxIsa caps the instruction set, mostly useful for benchmarking, not thread safe
+void initMipGeneration(SimdIsa maxIsa = SimdIsa::Avx2);
+
+// level 0 of every face must be filled in, data must have room for all levels
+void generateMips(uint8_t *data, uint16_t width, uint16_t height, uint8_t faceCount, uint8_t levelCount, MipTexelFormat format, MipFilter filter);
+
+// the rgb of RGBA8 normals in place with the math of normalizeNormalMap.comp, alpha is kept, spread over the job system,
+// every instruction set gives the same bytes, GPUs may differ by 1 where their inversesqrt is approximate
+void renormalizeNormals(uint8_t *rgba, uint32_t texelCount);
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// processes the [begin, end) subrange
+typedef void (*RangeFunc)(uint32_t begin, uint32_t end, void *userData);
+// accumulates the [begin, end) subrange into partial
+typedef void (*ReduceRangeFunc)(uint32_t begin, uint32_t end, void *partial, void *userData);
+// merges src into dst, called in range order so the reduction does not have to be commutative
+typedef void (*JoinFunc)(void *dst, const void *src, void *userData);
+
+// the loops below are cancelled with the job that calls them, they then return false and their output is incomplete
+
+// splits the range in halves until they are smaller than grainSize (0 means automatic), runs the pieces on the job system
+// and returns when all of them are done, the calling thread helps with the work
+bool parallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, RangeFunc func, void *userData);
+
+// result must be initialized with the identity value, it is used as the starting value of every partial,
+// it is left untouched if the loop is cancelled
+bool parallelReduce(uint32_t begin, uint32_t end, uint32_t grainSize, void *result, uint32_t resultSize, ReduceRangeFunc reduceFunc, JoinFunc joinFunc, void *userData);
+
+// dst[i] = sum of src[0..i), src and dst may be the same array, total gets the sum of all elements
+bool parallelExclusiveScan(const uint32_t *src, uint32_t *dst, uint32_t count, uint32_t &total);
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Utils.hpp"
+
+#include <stdint.h>
+
+// Reading of Radiance HDR (RGBE) files without stb_image, the files are mapped and their rows are converted straight to RGBA16F,
+// a strip at a time, so even the biggest HDRIs never need a whole decoded copy in host memory.
+// Rows go top to bottom, alpha is 1 and the values above the half range are clamped to it.
+
+struct HdrFile
+{
+    MappedFile file;
+    uint32_t *rowOffsets; // height + 1 of them, the run length encoded rows can only be found by walking the ones before
+    uint16_t width, height;
+};
+
+// picks the RGBE to half conversion, maxIsa caps the instruction set, mostly useful for benchmarking, not thread safe
+void initHdrDecoding(SimdIsa maxIsa = SimdIsa::Avx2);
+
+// VERIFYs that the file is a 32-bit_rle_rgbe image in the usual -Y +X orientation, walks all of it once to find the rows
+HdrFile openHdrFile(const char *filename);
+
+void closeHdrFile(HdrFile &file);
+
+// the rows [firstRow, firstRow + rowCount) tightly packed, dst must have room for rowCount * width * 4 halves,
+// the rows are spread over the job system
+void decodeHdrRows(const HdrFile &file, uint16_t firstRow, uint16_t rowCount, uint16_t *dst);
\ No newline at end of file
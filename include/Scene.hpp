@@ -31,10 +31,14 @@ struct Scene
     std::vector<std::string> imagePaths;
 };
 
-void importMaterial(const MaterialTextureSet &srcSet, const MaterialTextureSet &dstSet);
+// all textures of all sets go through one import pipeline
+void importMaterials(const MaterialTextureSet *srcSets, const MaterialTextureSet *dstSets, uint32_t setCount);
 
 void addMaterialToScene(Scene &scene, const MaterialTextureSet &set);
 
+// the scaling factor, the scene file version and the import settings of its images
+uint64_t hashSceneImportSettings(float scale, uint64_t seed);
+
 void importSceneFromGlb(const char *glbFilePath, const char *sceneDirPath, float scale);
 
 Scene loadSceneFromFile(const char *sceneDirPath);
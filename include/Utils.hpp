@@ -1,6 +1,7 @@
 #pragma once
 
 #include <assert.h>
+#include <immintrin.h> // for _mm_pause
 #include <stdint.h>
 #ifdef _MSC_VER
 #include <malloc.h> // for alloca
@@ -22,6 +23,14 @@
 
 #define CPU_PAUSE _mm_pause // TODO: handle non x64
 
+#ifdef _MSC_VER
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,f16c")))
+#endif
+
 #define defineEnumOperators(enumType, intType) \
 inline intType  operator+(enumType a) { return (intType)a; } \
 inline enumType operator~(enumType a) { return (enumType)(~(intType)a); } \
@@ -52,7 +61,7 @@ inline constexpr bool isPowerOf2(uint32_t value)
     return value && !(value & (value - 1));
 }
 
-inline constexpr uint32_t aligned(uint32_t value, uint32_t alignment) // alignment must be a power of 2!
+inline uint32_t aligned(uint32_t value, uint32_t alignment) // alignment must be a power of 2!
 {
     ASSERT(isPowerOf2(alignment));
     return (value + alignment - 1) & ~(alignment - 1);
@@ -63,10 +72,47 @@ inline constexpr bool isValidString(const char *str)
     return str && *str;
 }
 
+enum class SimdIsa : uint8_t
+{
+    Scalar = 0,
+    Sse41,
+    Avx2 // with F16C, which every AVX2 CPU has
+};
+
+// the best instruction set supported by the CPU
+SimdIsa getMaxSimdIsa();
+
+const char *getSimdIsaName(SimdIsa isa);
+
+// XXH64 from the xxHash that comes with zstd, not for anything security related
+uint64_t hash64(const void *data, uint64_t size, uint64_t seed = 0);
+
+// for chaining plain values into a hash
+template <typename T>
+inline uint64_t hashValue(const T &value, uint64_t seed)
+{
+    return hash64(&value, sizeof(value), seed);
+}
+
 bool mkdir(const char *path, bool recursive);
 
 bool pathExists(const char *path);
 
+// false if the file does not exist, modifiedTime is in seconds
+bool getFileStats(const char *filename, uint64_t &size, uint64_t &modifiedTime);
+
 uint32_t readFile(const char *filename, uint8_t *buffer, uint32_t bufferSize);
 
+struct MappedFile
+{
+    const uint8_t *data;
+    uint64_t size;
+    void *handle; // the file mapping object on Windows
+};
+
+// read only view of the whole file, data is null if the file cannot be opened or is empty
+MappedFile mapFile(const char *filename);
+
+void unmapFile(MappedFile &file);
+
 uint32_t writeFile(const char *filename, const void *data, uint32_t size);
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "AssetCache.hpp"
+#include "Utils.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <tracy/Tracy.hpp>
+
+// Manifest lines:
+// s <hash> <size> <modified time> <source path>
+// a <key> <asset path>
+static const char *const manifestHeader = "cutter asset cache 1\n";
+
+struct SourceEntry
+{
+    std::string path;
+    uint64_t hash;
+    uint64_t size;
+    uint64_t modifiedTime;
+};
+
+struct AssetEntry
+{
+    std::string path;
+    uint64_t key;
+};
+
+static std::string manifestPath;
+static std::vector<SourceEntry> sourceEntries;
+static std::vector<AssetEntry> assetEntries;
+static bool dirty = false;
+
+template <typename Entry>
+static Entry *findEntry(std::vector<Entry> &entries, const char *path)
+{
+    for (Entry &entry : entries)
+    {
+        if (entry.path == path)
+            return &entry;
+    }
+
+    return nullptr;
+}
+
+void loadAssetCache(const char *path)
+{
+    ZoneScoped;
+    ASSERT(isValidString(path));
+    manifestPath = path;
+    sourceEntries.clear();
+    assetEntries.clear();
+    dirty = false;
+
+    FILE *stream = fopen(path, "rb");
+
+    if (!stream)
+        return;
+
+    char line[512];
+
+    if (!fgets(line, sizeof(line), stream) || strcmp(line, manifestHeader)) // an unknown version rebuilds everything
+    {
+        fclose(stream);
+        return;
+    }
+
+    while (fgets(line, sizeof(line), stream))
+    {
+        char entryPath[256];
+        unsigned long long hash, size, modifiedTime;
+
+        if (sscanf(line, "s %llx %llu %llu %255[^\n]", &hash, &size, &modifiedTime, entryPath) == 4)
+            sourceEntries.push_back({ entryPath, hash, size, modifiedTime });
+        else if (sscanf(line, "a %llx %255[^\n]", &hash, entryPath) == 2)
+            assetEntries.push_back({ entryPath, hash });
+    }
+
+    fclose(stream);
+}
+
+void saveAssetCache()
+{
+    ZoneScoped;
+    ASSERT(!manifestPath.empty());
+
+    if (!dirty)
+        return;
+
+    std::string text = manifestHeader;
+    char line[512];
+
+    for (const SourceEntry &entry : sourceEntries)
+    {
+        snprintf(line, sizeof(line), "s %016llx %llu %llu %s\n", (unsigned long long)entry.hash, (unsigned long long)entry.size, (unsigned long long)entry.modifiedTime, entry.path.c_str());
+        text += line;
+    }
+
+    for (const AssetEntry &entry : assetEntries)
+    {
+        snprintf(line, sizeof(line), "a %016llx %s\n", (unsigned long long)entry.key, entry.path.c_str());
+        text += line;
+    }
+
+    VERIFY(writeFile(manifestPath.c_str(), text.data(), (uint32_t)text.size()) == text.size());
+    dirty = false;
+}
+
+uint64_t hashSourceFile(const char *filename)
+{
+    ZoneScoped;
+    ASSERT(isValidString(filename));
+    ZoneText(filename, strlen(filename));
+    uint64_t size, modifiedTime;
+    VERIFY(getFileStats(filename, size, modifiedTime));
+    SourceEntry *entry = findEntry(sourceEntries, filename);
+
+    if (entry && entry->size == size && entry->modifiedTime == modifiedTime)
+        return entry->hash;
+
+    uint8_t *data = new uint8_t[size];
+    VERIFY(readFile(filename, data, (uint32_t)size) == size);
+    uint64_t hash = hash64(data, size);
+    delete[] data;
+
+    if (!entry)
+    {
+        sourceEntries.push_back({ filename, 0, 0, 0 });
+        entry = &sourceEntries.back();
+    }
+
+    entry->hash = hash;
+    entry->size = size;
+    entry->modifiedTime = modifiedTime;
+    dirty = true;
+
+    return hash;
+}
+
+bool isAssetUpToDate(const char *assetPath, uint64_t key)
+{
+    ASSERT(isValidString(assetPath));
+    const AssetEntry *entry = findEntry(assetEntries, assetPath);
+    return entry && entry->key == key && pathExists(assetPath);
+}
+
+void setAssetKey(const char *assetPath, uint64_t key)
+{
+    ASSERT(isValidString(assetPath));
+    AssetEntry *entry = findEntry(assetEntries, assetPath);
+
+    if (!entry)
+    {
+        assetEntries.push_back({ assetPath, ~key });
+        entry = &assetEntries.back();
+    }
+
+    dirty |= entry->key != key;
+    entry->key = key;
+}
\ No newline at end of file
@@ -0,0 +1,1529 @@
+#include "BlockCompression.hpp"
+#include "Utils.hpp"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+static constexpr uint32_t blockTexelCount = 16;
+static constexpr uint32_t blockSizeInBytes = 16;
+
+// texels of a block or of a partition subset, one row per channel
+struct BlockPixels
+{
+    float channels[4][blockTexelCount];
+    uint32_t count;
+};
+
+static constexpr uint8_t weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static constexpr uint8_t weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// BC7 two subset partitions, bit i is set when texel i belongs to the second subset
+static constexpr uint16_t partitionTable2[64] =
+{
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80, 0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+    0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE, 0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+    0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A, 0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+    0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C, 0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+};
+
+// the anchor texel of the second subset, the first subset always starts at texel 0
+static constexpr uint8_t anchorTable2[64] =
+{
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15
+};
+
+static uint32_t refineIterationCount = 1;
+static uint32_t partitionCandidateCount = 4;
+static float mode1ErrorThreshold = 0.f; // BC7 blocks that mode 6 encodes with less error skip the partition search
+
+#pragma region Index search
+// finds the closest palette entry for every pixel and returns the sum of squared errors
+typedef float (*FindIndicesFunc)(const BlockPixels &pixels, const float (*palette)[4], uint32_t paletteSize, uint32_t channelCount, uint8_t *indices);
+
+static float findIndicesScalar(const BlockPixels &pixels, const float (*palette)[4], uint32_t paletteSize, uint32_t channelCount, uint8_t *indices)
+{
+    float totalError = 0.f;
+
+    for (uint32_t i = 0; i < pixels.count; i++)
+    {
+        float bestError = FLT_MAX;
+        uint8_t bestIndex = 0;
+
+        for (uint32_t k = 0; k < paletteSize; k++)
+        {
+            float error = 0.f;
+
+            for (uint32_t c = 0; c < channelCount; c++)
+            {
+                float diff = pixels.channels[c][i] - palette[k][c];
+                error += diff * diff;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                bestIndex = (uint8_t)k;
+            }
+        }
+
+        indices[i] = bestIndex;
+        totalError += bestError;
+    }
+
+    return totalError;
+}
+
+TARGET_SSE41 static float findIndicesSse41(const BlockPixels &pixels, const float (*palette)[4], uint32_t paletteSize, uint32_t channelCount, uint8_t *indices)
+{
+    __m128 totalError = _mm_setzero_ps();
+
+    for (uint32_t i = 0; i < pixels.count; i += 4) // lanes past count read padding and are masked out
+    {
+        __m128 bestError = _mm_set1_ps(FLT_MAX);
+        __m128 bestIndex = _mm_setzero_ps(); // small integers are exact as floats
+
+        for (uint32_t k = 0; k < paletteSize; k++)
+        {
+            __m128 error = _mm_setzero_ps();
+
+            for (uint32_t c = 0; c < channelCount; c++)
+            {
+                __m128 diff = _mm_sub_ps(_mm_loadu_ps(&pixels.channels[c][i]), _mm_set1_ps(palette[k][c]));
+                error = _mm_add_ps(error, _mm_mul_ps(diff, diff));
+            }
+
+            __m128 less = _mm_cmplt_ps(error, bestError);
+            bestError = _mm_min_ps(error, bestError);
+            bestIndex = _mm_blendv_ps(bestIndex, _mm_set1_ps((float)k), less);
+        }
+
+        __m128i lane = _mm_add_epi32(_mm_set1_epi32((int32_t)i), _mm_setr_epi32(0, 1, 2, 3));
+        __m128 valid = _mm_castsi128_ps(_mm_cmplt_epi32(lane, _mm_set1_epi32((int32_t)pixels.count)));
+        totalError = _mm_add_ps(totalError, _mm_and_ps(bestError, valid));
+
+        int32_t laneIndices[4];
+        _mm_storeu_si128((__m128i *)laneIndices, _mm_cvtps_epi32(bestIndex));
+
+        for (uint32_t j = 0; j < 4 && i + j < pixels.count; j++)
+        {
+            indices[i + j] = (uint8_t)laneIndices[j];
+        }
+    }
+
+    totalError = _mm_hadd_ps(totalError, totalError);
+    totalError = _mm_hadd_ps(totalError, totalError);
+    return _mm_cvtss_f32(totalError);
+}
+
+TARGET_AVX2 static float findIndicesAvx2(const BlockPixels &pixels, const float (*palette)[4], uint32_t paletteSize, uint32_t channelCount, uint8_t *indices)
+{
+    __m256 totalError = _mm256_setzero_ps();
+
+    for (uint32_t i = 0; i < pixels.count; i += 8) // lanes past count read padding and are masked out
+    {
+        __m256 bestError = _mm256_set1_ps(FLT_MAX);
+        __m256 bestIndex = _mm256_setzero_ps(); // small integers are exact as floats
+
+        for (uint32_t k = 0; k < paletteSize; k++)
+        {
+            __m256 error = _mm256_setzero_ps();
+
+            for (uint32_t c = 0; c < channelCount; c++)
+            {
+                __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(&pixels.channels[c][i]), _mm256_set1_ps(palette[k][c]));
+                error = _mm256_add_ps(error, _mm256_mul_ps(diff, diff));
+            }
+
+            __m256 less = _mm256_cmp_ps(error, bestError, _CMP_LT_OQ);
+            bestError = _mm256_min_ps(error, bestError);
+            bestIndex = _mm256_blendv_ps(bestIndex, _mm256_set1_ps((float)k), less);
+        }
+
+        __m256i lane = _mm256_add_epi32(_mm256_set1_epi32((int32_t)i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 valid = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32((int32_t)pixels.count), lane));
+        totalError = _mm256_add_ps(totalError, _mm256_and_ps(bestError, valid));
+
+        int32_t laneIndices[8];
+        _mm256_storeu_si256((__m256i *)laneIndices, _mm256_cvtps_epi32(bestIndex));
+
+        for (uint32_t j = 0; j < 8 && i + j < pixels.count; j++)
+        {
+            indices[i + j] = (uint8_t)laneIndices[j];
+        }
+    }
+
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(totalError), _mm256_extractf128_ps(totalError, 1));
+    sum = _mm_hadd_ps(sum, sum);
+    sum = _mm_hadd_ps(sum, sum);
+    return _mm_cvtss_f32(sum);
+}
+
+static FindIndicesFunc findIndices = findIndicesScalar;
+#pragma endregion
+
+#pragma region Bits
+struct BitWriter
+{
+    uint64_t words[2];
+    uint32_t offset;
+
+    void write(uint32_t value, uint32_t bitCount)
+    {
+        ASSERT(bitCount < 32 && value < (1u << bitCount));
+        uint32_t word = offset >> 6;
+        uint32_t shift = offset & 63;
+        words[word] |= (uint64_t)value << shift;
+
+        if (shift + bitCount > 64)
+            words[word + 1] |= (uint64_t)value >> (64 - shift);
+
+        offset += bitCount;
+    }
+};
+
+struct BitReader
+{
+    uint64_t words[2];
+    uint32_t offset;
+
+    uint32_t read(uint32_t bitCount)
+    {
+        ASSERT(bitCount < 32);
+        uint32_t word = offset >> 6;
+        uint32_t shift = offset & 63;
+        uint64_t value = words[word] >> shift;
+
+        if (shift + bitCount > 64)
+            value |= words[word + 1] << (64 - shift);
+
+        offset += bitCount;
+        return (uint32_t)value & ((1u << bitCount) - 1);
+    }
+};
+#pragma endregion
+
+#pragma region Endpoint fitting
+static inline float clampf(float value, float low, float high)
+{
+    return value < low ? low : (value > high ? high : value);
+}
+
+static inline int32_t clampi(int32_t value, int32_t low, int32_t high)
+{
+    return value < low ? low : (value > high ? high : value);
+}
+
+// returns the variance along the principal axis, the axis is zero when all pixels are equal
+static float computePrincipalAxis(const BlockPixels &pixels, uint32_t channelCount, float mean[4], float axis[4])
+{
+    float covariance[4][4] {};
+
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        float sum = 0.f;
+
+        for (uint32_t i = 0; i < pixels.count; i++)
+        {
+            sum += pixels.channels[c][i];
+        }
+
+        mean[c] = c < channelCount ? sum / pixels.count : 0.f;
+    }
+
+    for (uint32_t i = 0; i < pixels.count; i++)
+    {
+        for (uint32_t c = 0; c < channelCount; c++)
+        {
+            float diffC = pixels.channels[c][i] - mean[c];
+
+            for (uint32_t d = c; d < channelCount; d++)
+            {
+                covariance[c][d] += diffC * (pixels.channels[d][i] - mean[d]);
+            }
+        }
+    }
+
+    for (uint32_t c = 0; c < channelCount; c++)
+    {
+        for (uint32_t d = 0; d < c; d++)
+        {
+            covariance[c][d] = covariance[d][c];
+        }
+    }
+
+    float vector[4] = { 1.f, 1.f, 1.f, 1.f };
+    float length = 0.f;
+
+    for (uint32_t iteration = 0; iteration < 8; iteration++) // power iteration
+    {
+        float next[4] {};
+
+        for (uint32_t c = 0; c < channelCount; c++)
+        {
+            for (uint32_t d = 0; d < channelCount; d++)
+            {
+                next[c] += covariance[c][d] * vector[d];
+            }
+        }
+
+        length = 0.f;
+
+        for (uint32_t c = 0; c < channelCount; c++)
+        {
+            length = fmaxf(length, fabsf(next[c]));
+        }
+
+        if (length < 1e-6f)
+            break;
+
+        for (uint32_t c = 0; c < channelCount; c++)
+        {
+            vector[c] = next[c] / length;
+        }
+    }
+
+    float normSquared = 0.f;
+
+    for (uint32_t c = 0; c < channelCount; c++)
+    {
+        normSquared += vector[c] * vector[c];
+    }
+
+    float invNorm = length < 1e-6f ? 0.f : 1.f / sqrtf(normSquared);
+
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        axis[c] = c < channelCount ? vector[c] * invNorm : 0.f;
+    }
+
+    return length < 1e-6f ? 0.f : length;
+}
+
+// endpoints at the extents of the pixels projected onto the principal axis
+static void fitEndpoints(const BlockPixels &pixels, uint32_t channelCount, float endpoints[2][4])
+{
+    float mean[4], axis[4];
+    computePrincipalAxis(pixels, channelCount, mean, axis);
+    float minT = 0.f, maxT = 0.f;
+
+    for (uint32_t i = 0; i < pixels.count; i++)
+    {
+        float t = 0.f;
+
+        for (uint32_t c = 0; c < channelCount; c++)
+        {
+            t += (pixels.channels[c][i] - mean[c]) * axis[c];
+        }
+
+        minT = fminf(minT, t);
+        maxT = fmaxf(maxT, t);
+    }
+
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        endpoints[0][c] = mean[c] + minT * axis[c];
+        endpoints[1][c] = mean[c] + maxT * axis[c];
+    }
+}
+
+// least squares endpoints for fixed indices, interpolationWeights[i] is the weight of the second endpoint for index i
+static bool refineEndpoints(const BlockPixels &pixels, uint32_t channelCount, const uint8_t *indices, const float *interpolationWeights, float endpoints[2][4])
+{
+    float aa = 0.f, ab = 0.f, bb = 0.f;
+    float ax[4] {}, bx[4] {};
+
+    for (uint32_t i = 0; i < pixels.count; i++)
+    {
+        float b = interpolationWeights[indices[i]];
+        float a = 1.f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+
+        for (uint32_t c = 0; c < channelCount; c++)
+        {
+            ax[c] += a * pixels.channels[c][i];
+            bx[c] += b * pixels.channels[c][i];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+
+    if (fabsf(det) < 1e-6f) // all pixels use the same index
+        return false;
+
+    float invDet = 1.f / det;
+
+    for (uint32_t c = 0; c < channelCount; c++)
+    {
+        endpoints[0][c] = (bb * ax[c] - ab * bx[c]) * invDet;
+        endpoints[1][c] = (aa * bx[c] - ab * ax[c]) * invDet;
+    }
+
+    return true;
+}
+
+static inline void loadInterpolationWeights(const uint8_t *weights, uint32_t count, float *interpolationWeights)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        interpolationWeights[i] = weights[i] / 64.f;
+    }
+}
+#pragma endregion
+
+#pragma region BC5
+// 8 value mode only, endpoints[0] > endpoints[1]
+static void buildPaletteBC4(uint8_t endpoint0, uint8_t endpoint1, float palette[8][4])
+{
+    palette[0][0] = endpoint0;
+    palette[1][0] = endpoint1;
+
+    for (uint32_t i = 1; i < 7; i++)
+    {
+        palette[i + 1][0] = ((7 - i) * endpoint0 + i * endpoint1) / 7.f;
+    }
+}
+
+static void compressBlockBC4(const uint8_t *values, uint32_t stride, uint8_t *dst)
+{
+    BlockPixels pixels;
+    pixels.count = blockTexelCount;
+    float minValue = 255.f, maxValue = 0.f;
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        float value = values[(i / 4) * stride + i % 4];
+        pixels.channels[0][i] = value;
+        minValue = fminf(minValue, value);
+        maxValue = fmaxf(maxValue, value);
+    }
+
+    memset(dst, 0, blockSizeInBytes / 2);
+
+    if (minValue == maxValue) // all indices 0
+    {
+        dst[0] = dst[1] = (uint8_t)maxValue;
+        return;
+    }
+
+    const float interpolationWeights[8] = { 0.f, 1.f, 1 / 7.f, 2 / 7.f, 3 / 7.f, 4 / 7.f, 5 / 7.f, 6 / 7.f };
+    float endpoints[2][4] = { { maxValue }, { minValue } };
+    float palette[8][4];
+    uint8_t indices[blockTexelCount], bestIndices[blockTexelCount];
+    uint8_t bestEndpoints[2] {};
+    float bestError = FLT_MAX;
+
+    for (uint32_t iteration = 0; iteration <= refineIterationCount; iteration++)
+    {
+        int32_t endpoint0 = clampi((int32_t)lroundf(endpoints[0][0]), 0, 255);
+        int32_t endpoint1 = clampi((int32_t)lroundf(endpoints[1][0]), 0, 255);
+
+        if (endpoint0 < endpoint1)
+        {
+            int32_t temp = endpoint0;
+            endpoint0 = endpoint1;
+            endpoint1 = temp;
+        }
+
+        if (endpoint0 == endpoint1) // equal endpoints would select the 6 value mode
+        {
+            if (endpoint0 < 255)
+                endpoint0++;
+            else
+                endpoint1--;
+        }
+
+        buildPaletteBC4((uint8_t)endpoint0, (uint8_t)endpoint1, palette);
+        float error = findIndices(pixels, palette, 8, 1, indices);
+
+        if (error < bestError)
+        {
+            bestError = error;
+            bestEndpoints[0] = (uint8_t)endpoint0;
+            bestEndpoints[1] = (uint8_t)endpoint1;
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+
+        if (!refineEndpoints(pixels, 1, indices, interpolationWeights, endpoints))
+            break;
+    }
+
+    uint64_t bits = 0;
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        bits |= (uint64_t)bestIndices[i] << (3 * i);
+    }
+
+    dst[0] = bestEndpoints[0];
+    dst[1] = bestEndpoints[1];
+
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        dst[2 + i] = (uint8_t)(bits >> (8 * i));
+    }
+}
+
+static void decompressBlockBC4(const uint8_t *src, uint8_t values[16])
+{
+    uint8_t palette[8];
+    palette[0] = src[0];
+    palette[1] = src[1];
+
+    if (src[0] > src[1])
+    {
+        for (uint32_t i = 1; i < 7; i++)
+        {
+            palette[i + 1] = (uint8_t)(((7 - i) * src[0] + i * src[1] + 3) / 7);
+        }
+    }
+    else
+    {
+        for (uint32_t i = 1; i < 5; i++)
+        {
+            palette[i + 1] = (uint8_t)(((5 - i) * src[0] + i * src[1] + 2) / 5);
+        }
+
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t bits = 0;
+
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        bits |= (uint64_t)src[2 + i] << (8 * i);
+    }
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        values[i] = palette[(bits >> (3 * i)) & 7];
+    }
+}
+
+void compressBlockBC5(const uint8_t *red, uint32_t redStride, const uint8_t *green, uint32_t greenStride, uint8_t *dst)
+{
+    ASSERT(red && green && dst);
+    compressBlockBC4(red, redStride, dst);
+    compressBlockBC4(green, greenStride, dst + blockSizeInBytes / 2);
+}
+
+bool decompressBlockBC5(const uint8_t *src, uint8_t red[16], uint8_t green[16])
+{
+    ASSERT(src && red && green);
+    decompressBlockBC4(src, red);
+    decompressBlockBC4(src + blockSizeInBytes / 2, green);
+    return true;
+}
+#pragma endregion
+
+#pragma region BC7
+struct ModeBC7
+{
+    uint8_t channelCount; // alpha is implicitly 255 when 3
+    uint8_t colorBits; // without the p-bit
+    bool sharedPBit; // one p-bit per subset instead of per endpoint
+    uint8_t indexBits;
+    const uint8_t *weights;
+};
+
+static constexpr ModeBC7 mode1 = { 3, 6, true, 3, weights3 };
+static constexpr ModeBC7 mode6 = { 4, 7, false, 4, weights4 };
+
+struct SubsetEncoding
+{
+    uint8_t endpoints[2][4]; // quantized, without the p-bit
+    uint8_t pBits[2];
+    uint8_t indices[blockTexelCount];
+    float error;
+};
+
+static inline uint8_t unquantizeBC7(uint32_t value, uint32_t bitCount)
+{
+    return (uint8_t)((value << (8 - bitCount)) | (value >> (2 * bitCount - 8)));
+}
+
+// returns the error of the unquantized endpoint, fills the codes for the given p-bit
+typedef float (*QuantizeEndpointFunc)(const float endpoint[4], const ModeBC7 &mode, uint32_t pBit, uint8_t codes[4], uint8_t values[4]);
+
+static float quantizeEndpointBC7Scalar(const float endpoint[4], const ModeBC7 &mode, uint32_t pBit, uint8_t codes[4], uint8_t values[4])
+{
+    uint32_t bitCount = mode.colorBits + 1;
+    float scale = ((1 << bitCount) - 1) / 255.f;
+    float error = 0.f;
+
+    for (uint32_t c = 0; c < mode.channelCount; c++)
+    {
+        int32_t code = clampi((int32_t)lroundf((clampf(endpoint[c], 0.f, 255.f) * scale - pBit) / 2), 0, (1 << mode.colorBits) - 1);
+        codes[c] = (uint8_t)code;
+        values[c] = unquantizeBC7((uint32_t)code << 1 | pBit, bitCount);
+        float diff = values[c] - endpoint[c];
+        error += diff * diff;
+    }
+
+    return error;
+}
+
+// all channels at once, rounds half away from zero like lroundf, so the codes match the scalar version
+TARGET_SSE41 static float quantizeEndpointBC7Sse41(const float endpoint[4], const ModeBC7 &mode, uint32_t pBit, uint8_t codes[4], uint8_t values[4])
+{
+    uint32_t bitCount = mode.colorBits + 1;
+    __m128 original = _mm_loadu_ps(endpoint);
+    __m128 x = _mm_min_ps(_mm_max_ps(original, _mm_setzero_ps()), _mm_set1_ps(255.f));
+    x = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(x, _mm_set1_ps(((1 << bitCount) - 1) / 255.f)), _mm_set1_ps((float)pBit)), _mm_set1_ps(2.f));
+
+    // x is at least -0.5 here, whatever that rounds to is clamped to 0 anyway
+    __m128 truncated = _mm_round_ps(x, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    __m128 rounded = _mm_add_ps(truncated, _mm_and_ps(_mm_cmpge_ps(_mm_sub_ps(x, truncated), _mm_set1_ps(0.5f)), _mm_set1_ps(1.f)));
+    __m128i code = _mm_min_epi32(_mm_max_epi32(_mm_cvttps_epi32(rounded), _mm_setzero_si128()), _mm_set1_epi32((1 << mode.colorBits) - 1));
+
+    __m128i value = _mm_or_si128(_mm_slli_epi32(code, 1), _mm_set1_epi32((int32_t)pBit));
+    value = _mm_or_si128(_mm_sll_epi32(value, _mm_cvtsi32_si128(8 - bitCount)), _mm_srl_epi32(value, _mm_cvtsi32_si128(2 * bitCount - 8)));
+
+    __m128 diff = _mm_sub_ps(_mm_cvtepi32_ps(value), original);
+    float errors[4];
+    _mm_storeu_ps(errors, _mm_mul_ps(diff, diff));
+    float error = 0.f;
+
+    for (uint32_t c = 0; c < mode.channelCount; c++) // in channel order, like the scalar sum
+    {
+        error += errors[c];
+    }
+
+    uint32_t packedCodes = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(code, code), _mm_setzero_si128()));
+    uint32_t packedValues = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packus_epi32(value, value), _mm_setzero_si128()));
+    memcpy(codes, &packedCodes, 4);
+    memcpy(values, &packedValues, 4);
+    return error;
+}
+
+static QuantizeEndpointFunc quantizeEndpointBC7 = quantizeEndpointBC7Scalar;
+
+static void quantizeEndpointsBC7(const float endpoints[2][4], const ModeBC7 &mode, SubsetEncoding &encoding, uint8_t values[2][4])
+{
+    uint8_t codes[2][2][4], candidateValues[2][2][4]; // [pBit][endpoint]
+    float errors[2][2];
+
+    for (uint32_t p = 0; p < 2; p++)
+    {
+        for (uint32_t e = 0; e < 2; e++)
+        {
+            errors[p][e] = quantizeEndpointBC7(endpoints[e], mode, p, codes[p][e], candidateValues[p][e]);
+        }
+    }
+
+    for (uint32_t e = 0; e < 2; e++)
+    {
+        uint32_t p;
+
+        if (mode.sharedPBit)
+            p = errors[1][0] + errors[1][1] < errors[0][0] + errors[0][1] ? 1 : 0;
+        else
+            p = errors[1][e] < errors[0][e] ? 1 : 0;
+
+        encoding.pBits[e] = (uint8_t)p;
+        memcpy(encoding.endpoints[e], codes[p][e], 4);
+        memcpy(values[e], candidateValues[p][e], 4);
+    }
+}
+
+static void encodeSubsetBC7(const BlockPixels &pixels, const ModeBC7 &mode, SubsetEncoding &encoding)
+{
+    uint32_t paletteSize = 1 << mode.indexBits;
+    float interpolationWeights[16];
+    loadInterpolationWeights(mode.weights, paletteSize, interpolationWeights);
+
+    float endpoints[2][4];
+    fitEndpoints(pixels, mode.channelCount, endpoints);
+    SubsetEncoding candidate;
+    encoding.error = FLT_MAX;
+
+    for (uint32_t iteration = 0; iteration <= refineIterationCount; iteration++)
+    {
+        uint8_t values[2][4];
+        quantizeEndpointsBC7(endpoints, mode, candidate, values);
+        float palette[16][4];
+
+        for (uint32_t k = 0; k < paletteSize; k++)
+        {
+            for (uint32_t c = 0; c < mode.channelCount; c++)
+            {
+                palette[k][c] = (float)(((64 - mode.weights[k]) * values[0][c] + mode.weights[k] * values[1][c] + 32) >> 6);
+            }
+        }
+
+        candidate.error = findIndices(pixels, palette, paletteSize, mode.channelCount, candidate.indices);
+
+        if (candidate.error < encoding.error)
+            encoding = candidate;
+
+        if (encoding.error == 0.f || !refineEndpoints(pixels, mode.channelCount, candidate.indices, interpolationWeights, endpoints))
+            break;
+    }
+}
+
+// swaps the endpoints if needed, so that the most significant index bit of the anchor texel is 0
+static void fixAnchorBC7(SubsetEncoding &encoding, const ModeBC7 &mode, uint32_t anchorIndex)
+{
+    uint32_t maxIndex = (1 << mode.indexBits) - 1;
+
+    if (encoding.indices[anchorIndex] <= maxIndex >> 1)
+        return;
+
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        uint8_t temp = encoding.endpoints[0][c];
+        encoding.endpoints[0][c] = encoding.endpoints[1][c];
+        encoding.endpoints[1][c] = temp;
+    }
+
+    uint8_t temp = encoding.pBits[0];
+    encoding.pBits[0] = encoding.pBits[1];
+    encoding.pBits[1] = temp;
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        encoding.indices[i] = (uint8_t)(maxIndex - encoding.indices[i]);
+    }
+}
+
+static float encodeBC7Mode6(const BlockPixels &pixels, uint8_t *dst)
+{
+    SubsetEncoding encoding;
+    encodeSubsetBC7(pixels, mode6, encoding);
+    fixAnchorBC7(encoding, mode6, 0);
+
+    BitWriter writer {};
+    writer.write(1 << 6, 7);
+
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        writer.write(encoding.endpoints[0][c], 7);
+        writer.write(encoding.endpoints[1][c], 7);
+    }
+
+    writer.write(encoding.pBits[0], 1);
+    writer.write(encoding.pBits[1], 1);
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        writer.write(encoding.indices[i], i ? 4 : 3);
+    }
+
+    ASSERT(writer.offset == 128);
+    memcpy(dst, writer.words, blockSizeInBytes);
+    return encoding.error;
+}
+
+// the channel sums of the block and the channel products of every texel and of the block, the moments of a subset
+// are what is left after subtracting the moments of the other one
+static void computeBlockMoments(const BlockPixels &pixels, float totalSums[3], float totalProducts[6], float texelProducts[blockTexelCount][6])
+{
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        totalSums[c] = 0.f;
+    }
+
+    for (uint32_t k = 0; k < 6; k++)
+    {
+        totalProducts[k] = 0.f;
+    }
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        for (uint32_t c = 0, k = 0; c < 3; c++)
+        {
+            totalSums[c] += pixels.channels[c][i];
+
+            for (uint32_t d = c; d < 3; d++, k++)
+            {
+                texelProducts[i][k] = pixels.channels[c][i] * pixels.channels[d][i];
+                totalProducts[k] += texelProducts[i][k];
+            }
+        }
+    }
+}
+
+// how badly the subsets of a partition fit a line, from the variance left after removing the principal axis
+static float estimatePartitionError(const float sums[2][3], const float products[2][6], const uint32_t counts[2])
+{
+    float error = 0.f;
+
+    for (uint32_t s = 0; s < 2; s++)
+    {
+        if (!counts[s])
+            continue;
+
+        float invCount = 1.f / counts[s];
+        float covariance[3][3];
+
+        for (uint32_t c = 0, k = 0; c < 3; c++)
+        {
+            for (uint32_t d = c; d < 3; d++, k++)
+            {
+                covariance[c][d] = covariance[d][c] = products[s][k] - sums[s][c] * sums[s][d] * invCount;
+            }
+        }
+
+        // two power iterations from the column of the largest variance and a Rayleigh quotient estimate the largest eigenvalue
+        uint32_t column = covariance[0][0] > covariance[1][1] ? (covariance[0][0] > covariance[2][2] ? 0 : 2) : (covariance[1][1] > covariance[2][2] ? 1 : 2);
+        float vector[3] = { covariance[0][column], covariance[1][column], covariance[2][column] };
+
+        for (uint32_t iteration = 0; iteration < 2; iteration++)
+        {
+            float next[3];
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                next[c] = covariance[c][0] * vector[0] + covariance[c][1] * vector[1] + covariance[c][2] * vector[2];
+            }
+
+            float scale = fmaxf(fmaxf(fabsf(next[0]), fabsf(next[1])), fabsf(next[2]));
+            scale = scale > 1e-6f ? 1.f / scale : 0.f;
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                vector[c] = next[c] * scale;
+            }
+        }
+
+        float lengthSquared = vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2];
+        float eigenvalue = 0.f;
+
+        if (lengthSquared > 1e-6f)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                eigenvalue += vector[c] * (covariance[c][0] * vector[0] + covariance[c][1] * vector[1] + covariance[c][2] * vector[2]);
+            }
+
+            eigenvalue /= lengthSquared;
+        }
+
+        error += covariance[0][0] + covariance[1][1] + covariance[2][2] - eigenvalue;
+    }
+
+    return error;
+}
+
+// estimates the error of all 64 two subset partitions, the SIMD versions run one partition per lane
+// and do the same operations in the same order, so all of them pick the same candidates
+typedef void (*EstimatePartitionErrorsFunc)(const BlockPixels &pixels, float errors[64]);
+
+static void estimatePartitionErrorsScalar(const BlockPixels &pixels, float errors[64])
+{
+    float totalSums[3], totalProducts[6];
+    float texelProducts[blockTexelCount][6];
+    computeBlockMoments(pixels, totalSums, totalProducts, texelProducts);
+
+    for (uint32_t partition = 0; partition < 64; partition++)
+    {
+        float sums[2][3] {}, products[2][6] {};
+        uint32_t counts[2] = { 0, 0 };
+
+        for (uint32_t i = 0; i < blockTexelCount; i++)
+        {
+            if (!(partitionTable2[partition] >> i & 1))
+                continue;
+
+            counts[1]++;
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                sums[1][c] += pixels.channels[c][i];
+            }
+
+            for (uint32_t k = 0; k < 6; k++)
+            {
+                products[1][k] += texelProducts[i][k];
+            }
+        }
+
+        counts[0] = blockTexelCount - counts[1];
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            sums[0][c] = totalSums[c] - sums[1][c];
+        }
+
+        for (uint32_t k = 0; k < 6; k++)
+        {
+            products[0][k] = totalProducts[k] - products[1][k];
+        }
+
+        errors[partition] = estimatePartitionError(sums, products, counts);
+    }
+}
+
+TARGET_SSE41 static __m128 estimateSubsetErrorSse41(const __m128 sums[3], const __m128 products[6], __m128 count)
+{
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 epsilon = _mm_set1_ps(1e-6f);
+    __m128 invCount = _mm_div_ps(one, count);
+    __m128 covariance[3][3];
+
+    for (uint32_t c = 0, k = 0; c < 3; c++)
+    {
+        for (uint32_t d = c; d < 3; d++, k++)
+        {
+            covariance[c][d] = covariance[d][c] = _mm_sub_ps(products[k], _mm_mul_ps(_mm_mul_ps(sums[c], sums[d]), invCount));
+        }
+    }
+
+    __m128 firstLarger = _mm_cmpgt_ps(covariance[0][0], covariance[1][1]);
+    __m128 useColumn0 = _mm_and_ps(firstLarger, _mm_cmpgt_ps(covariance[0][0], covariance[2][2]));
+    __m128 useColumn1 = _mm_andnot_ps(firstLarger, _mm_cmpgt_ps(covariance[1][1], covariance[2][2]));
+    __m128 vector[3];
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        vector[c] = _mm_blendv_ps(_mm_blendv_ps(covariance[c][2], covariance[c][1], useColumn1), covariance[c][0], useColumn0);
+    }
+
+    __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    for (uint32_t iteration = 0; iteration < 2; iteration++)
+    {
+        __m128 next[3];
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            next[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(covariance[c][0], vector[0]), _mm_mul_ps(covariance[c][1], vector[1])), _mm_mul_ps(covariance[c][2], vector[2]));
+        }
+
+        __m128 scale = _mm_max_ps(_mm_max_ps(_mm_and_ps(next[0], absMask), _mm_and_ps(next[1], absMask)), _mm_and_ps(next[2], absMask));
+        scale = _mm_and_ps(_mm_div_ps(one, scale), _mm_cmpgt_ps(scale, epsilon));
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            vector[c] = _mm_mul_ps(next[c], scale);
+        }
+    }
+
+    __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vector[0], vector[0]), _mm_mul_ps(vector[1], vector[1])), _mm_mul_ps(vector[2], vector[2]));
+    __m128 eigenvalue = _mm_setzero_ps();
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        __m128 row = _mm_add_ps(_mm_add_ps(_mm_mul_ps(covariance[c][0], vector[0]), _mm_mul_ps(covariance[c][1], vector[1])), _mm_mul_ps(covariance[c][2], vector[2]));
+        eigenvalue = _mm_add_ps(eigenvalue, _mm_mul_ps(vector[c], row));
+    }
+
+    eigenvalue = _mm_and_ps(_mm_div_ps(eigenvalue, lengthSquared), _mm_cmpgt_ps(lengthSquared, epsilon));
+    __m128 error = _mm_sub_ps(_mm_add_ps(_mm_add_ps(covariance[0][0], covariance[1][1]), covariance[2][2]), eigenvalue);
+    return _mm_and_ps(error, _mm_cmpgt_ps(count, _mm_setzero_ps()));
+}
+
+TARGET_SSE41 static void estimatePartitionErrorsSse41(const BlockPixels &pixels, float errors[64])
+{
+    float totalSums[3], totalProducts[6];
+    float texelProducts[blockTexelCount][6];
+    computeBlockMoments(pixels, totalSums, totalProducts, texelProducts);
+    __m128 one = _mm_set1_ps(1.f);
+
+    for (uint32_t partition = 0; partition < 64; partition += 4)
+    {
+        __m128i bits = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)&partitionTable2[partition]));
+        __m128 sums[2][3], products[2][6], counts[2];
+        counts[1] = _mm_setzero_ps();
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            sums[1][c] = _mm_setzero_ps();
+        }
+
+        for (uint32_t k = 0; k < 6; k++)
+        {
+            products[1][k] = _mm_setzero_ps();
+        }
+
+        for (uint32_t i = 0; i < blockTexelCount; i++) // adding zero for the lanes that skip the texel keeps the sums exact
+        {
+            __m128 inSecond = _mm_castsi128_ps(_mm_srai_epi32(_mm_slli_epi32(bits, 31), 31));
+            bits = _mm_srli_epi32(bits, 1);
+            counts[1] = _mm_add_ps(counts[1], _mm_and_ps(inSecond, one));
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                sums[1][c] = _mm_add_ps(sums[1][c], _mm_and_ps(inSecond, _mm_set1_ps(pixels.channels[c][i])));
+            }
+
+            for (uint32_t k = 0; k < 6; k++)
+            {
+                products[1][k] = _mm_add_ps(products[1][k], _mm_and_ps(inSecond, _mm_set1_ps(texelProducts[i][k])));
+            }
+        }
+
+        counts[0] = _mm_sub_ps(_mm_set1_ps((float)blockTexelCount), counts[1]);
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            sums[0][c] = _mm_sub_ps(_mm_set1_ps(totalSums[c]), sums[1][c]);
+        }
+
+        for (uint32_t k = 0; k < 6; k++)
+        {
+            products[0][k] = _mm_sub_ps(_mm_set1_ps(totalProducts[k]), products[1][k]);
+        }
+
+        __m128 error = _mm_add_ps(estimateSubsetErrorSse41(sums[0], products[0], counts[0]), estimateSubsetErrorSse41(sums[1], products[1], counts[1]));
+        _mm_storeu_ps(errors + partition, error);
+    }
+}
+
+TARGET_AVX2 static __m256 estimateSubsetErrorAvx2(const __m256 sums[3], const __m256 products[6], __m256 count)
+{
+    __m256 one = _mm256_set1_ps(1.f);
+    __m256 epsilon = _mm256_set1_ps(1e-6f);
+    __m256 invCount = _mm256_div_ps(one, count);
+    __m256 covariance[3][3];
+
+    for (uint32_t c = 0, k = 0; c < 3; c++)
+    {
+        for (uint32_t d = c; d < 3; d++, k++)
+        {
+            covariance[c][d] = covariance[d][c] = _mm256_sub_ps(products[k], _mm256_mul_ps(_mm256_mul_ps(sums[c], sums[d]), invCount));
+        }
+    }
+
+    __m256 firstLarger = _mm256_cmp_ps(covariance[0][0], covariance[1][1], _CMP_GT_OQ);
+    __m256 useColumn0 = _mm256_and_ps(firstLarger, _mm256_cmp_ps(covariance[0][0], covariance[2][2], _CMP_GT_OQ));
+    __m256 useColumn1 = _mm256_andnot_ps(firstLarger, _mm256_cmp_ps(covariance[1][1], covariance[2][2], _CMP_GT_OQ));
+    __m256 vector[3];
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        vector[c] = _mm256_blendv_ps(_mm256_blendv_ps(covariance[c][2], covariance[c][1], useColumn1), covariance[c][0], useColumn0);
+    }
+
+    __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+
+    for (uint32_t iteration = 0; iteration < 2; iteration++)
+    {
+        __m256 next[3];
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            next[c] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(covariance[c][0], vector[0]), _mm256_mul_ps(covariance[c][1], vector[1])), _mm256_mul_ps(covariance[c][2], vector[2]));
+        }
+
+        __m256 scale = _mm256_max_ps(_mm256_max_ps(_mm256_and_ps(next[0], absMask), _mm256_and_ps(next[1], absMask)), _mm256_and_ps(next[2], absMask));
+        scale = _mm256_and_ps(_mm256_div_ps(one, scale), _mm256_cmp_ps(scale, epsilon, _CMP_GT_OQ));
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            vector[c] = _mm256_mul_ps(next[c], scale);
+        }
+    }
+
+    __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vector[0], vector[0]), _mm256_mul_ps(vector[1], vector[1])), _mm256_mul_ps(vector[2], vector[2]));
+    __m256 eigenvalue = _mm256_setzero_ps();
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        __m256 row = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(covariance[c][0], vector[0]), _mm256_mul_ps(covariance[c][1], vector[1])), _mm256_mul_ps(covariance[c][2], vector[2]));
+        eigenvalue = _mm256_add_ps(eigenvalue, _mm256_mul_ps(vector[c], row));
+    }
+
+    eigenvalue = _mm256_and_ps(_mm256_div_ps(eigenvalue, lengthSquared), _mm256_cmp_ps(lengthSquared, epsilon, _CMP_GT_OQ));
+    __m256 error = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(covariance[0][0], covariance[1][1]), covariance[2][2]), eigenvalue);
+    return _mm256_and_ps(error, _mm256_cmp_ps(count, _mm256_setzero_ps(), _CMP_GT_OQ));
+}
+
+TARGET_AVX2 static void estimatePartitionErrorsAvx2(const BlockPixels &pixels, float errors[64])
+{
+    float totalSums[3], totalProducts[6];
+    float texelProducts[blockTexelCount][6];
+    computeBlockMoments(pixels, totalSums, totalProducts, texelProducts);
+    __m256 one = _mm256_set1_ps(1.f);
+
+    for (uint32_t partition = 0; partition < 64; partition += 8)
+    {
+        __m256i bits = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&partitionTable2[partition]));
+        __m256 sums[2][3], products[2][6], counts[2];
+        counts[1] = _mm256_setzero_ps();
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            sums[1][c] = _mm256_setzero_ps();
+        }
+
+        for (uint32_t k = 0; k < 6; k++)
+        {
+            products[1][k] = _mm256_setzero_ps();
+        }
+
+        for (uint32_t i = 0; i < blockTexelCount; i++) // adding zero for the lanes that skip the texel keeps the sums exact
+        {
+            __m256 inSecond = _mm256_castsi256_ps(_mm256_srai_epi32(_mm256_slli_epi32(bits, 31), 31));
+            bits = _mm256_srli_epi32(bits, 1);
+            counts[1] = _mm256_add_ps(counts[1], _mm256_and_ps(inSecond, one));
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                sums[1][c] = _mm256_add_ps(sums[1][c], _mm256_and_ps(inSecond, _mm256_set1_ps(pixels.channels[c][i])));
+            }
+
+            for (uint32_t k = 0; k < 6; k++)
+            {
+                products[1][k] = _mm256_add_ps(products[1][k], _mm256_and_ps(inSecond, _mm256_set1_ps(texelProducts[i][k])));
+            }
+        }
+
+        counts[0] = _mm256_sub_ps(_mm256_set1_ps((float)blockTexelCount), counts[1]);
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            sums[0][c] = _mm256_sub_ps(_mm256_set1_ps(totalSums[c]), sums[1][c]);
+        }
+
+        for (uint32_t k = 0; k < 6; k++)
+        {
+            products[0][k] = _mm256_sub_ps(_mm256_set1_ps(totalProducts[k]), products[1][k]);
+        }
+
+        __m256 error = _mm256_add_ps(estimateSubsetErrorAvx2(sums[0], products[0], counts[0]), estimateSubsetErrorAvx2(sums[1], products[1], counts[1]));
+        _mm256_storeu_ps(errors + partition, error);
+    }
+}
+
+static EstimatePartitionErrorsFunc estimatePartitionErrors = estimatePartitionErrorsScalar;
+
+// opaque blocks only, tries the partitions that fit two lines best
+static float encodeBC7Mode1(const BlockPixels &pixels, uint8_t *dst)
+{
+    float errors[64];
+    estimatePartitionErrors(pixels, errors);
+
+    uint32_t candidates[64];
+    float candidateErrors[64];
+    uint32_t candidateCount = 0;
+
+    for (uint32_t partition = 0; partition < 64; partition++)
+    {
+        float error = errors[partition];
+        uint32_t position = min(candidateCount, partitionCandidateCount - 1);
+
+        if (candidateCount == partitionCandidateCount && error >= candidateErrors[position])
+            continue;
+
+        while (position > 0 && candidateErrors[position - 1] > error) // insertion sort, keeps the best candidates
+        {
+            candidates[position] = candidates[position - 1];
+            candidateErrors[position] = candidateErrors[position - 1];
+            position--;
+        }
+
+        candidates[position] = partition;
+        candidateErrors[position] = error;
+        candidateCount = min(candidateCount + 1, partitionCandidateCount);
+    }
+
+    float bestError = FLT_MAX;
+    uint32_t bestPartition = 0;
+    SubsetEncoding bestEncodings[2];
+
+    for (uint32_t candidate = 0; candidate < candidateCount; candidate++)
+    {
+        uint32_t partition = candidates[candidate];
+        BlockPixels subsets[2];
+        uint8_t texels[2][blockTexelCount];
+        subsets[0].count = subsets[1].count = 0;
+
+        for (uint32_t i = 0; i < blockTexelCount; i++)
+        {
+            uint32_t s = partitionTable2[partition] >> i & 1;
+            uint32_t index = subsets[s].count++;
+            texels[s][index] = (uint8_t)i;
+
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                subsets[s].channels[c][index] = pixels.channels[c][i];
+            }
+        }
+
+        for (uint32_t s = 0; s < 2; s++) // pad with the first texel, the SIMD index search reads full rows
+        {
+            for (uint32_t index = subsets[s].count; index < blockTexelCount; index++)
+            {
+                for (uint32_t c = 0; c < 4; c++)
+                {
+                    subsets[s].channels[c][index] = subsets[s].channels[c][0];
+                }
+            }
+        }
+
+        SubsetEncoding encodings[2];
+        float error = 0.f;
+
+        for (uint32_t s = 0; s < 2 && error < bestError; s++)
+        {
+            encodeSubsetBC7(subsets[s], mode1, encodings[s]);
+            error += encodings[s].error;
+
+            uint8_t indices[blockTexelCount] {}; // scatter back to texel order
+            for (uint32_t index = 0; index < subsets[s].count; index++)
+            {
+                indices[texels[s][index]] = encodings[s].indices[index];
+            }
+            memcpy(encodings[s].indices, indices, sizeof(indices));
+        }
+
+        if (error < bestError)
+        {
+            bestError = error;
+            bestPartition = partition;
+            bestEncodings[0] = encodings[0];
+            bestEncodings[1] = encodings[1];
+        }
+    }
+
+    uint32_t anchors[2] = { 0, anchorTable2[bestPartition] };
+
+    for (uint32_t s = 0; s < 2; s++)
+    {
+        fixAnchorBC7(bestEncodings[s], mode1, anchors[s]);
+    }
+
+    BitWriter writer {};
+    writer.write(1 << 1, 2);
+    writer.write(bestPartition, 6);
+
+    for (uint32_t c = 0; c < 3; c++)
+    {
+        for (uint32_t s = 0; s < 2; s++)
+        {
+            writer.write(bestEncodings[s].endpoints[0][c], 6);
+            writer.write(bestEncodings[s].endpoints[1][c], 6);
+        }
+    }
+
+    writer.write(bestEncodings[0].pBits[0], 1);
+    writer.write(bestEncodings[1].pBits[0], 1);
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        uint32_t s = partitionTable2[bestPartition] >> i & 1;
+        writer.write(bestEncodings[s].indices[i], i == anchors[s] ? 2 : 3);
+    }
+
+    ASSERT(writer.offset == 128);
+    memcpy(dst, writer.words, blockSizeInBytes);
+    return bestError;
+}
+
+void compressBlockBC7(const uint8_t *rgba, uint32_t stride, uint8_t *dst)
+{
+    ASSERT(rgba && dst);
+    BlockPixels pixels;
+    pixels.count = blockTexelCount;
+    bool opaque = true;
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        const uint8_t *texel = rgba + (i / 4) * stride + (i % 4) * 4;
+
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            pixels.channels[c][i] = texel[c];
+        }
+
+        opaque = opaque && texel[3] == 255;
+    }
+
+    float error = encodeBC7Mode6(pixels, dst);
+
+    if (opaque && error > mode1ErrorThreshold)
+    {
+        uint8_t block[blockSizeInBytes];
+
+        if (encodeBC7Mode1(pixels, block) < error)
+            memcpy(dst, block, blockSizeInBytes);
+    }
+}
+
+bool decompressBlockBC7(const uint8_t *src, uint8_t rgba[16][4])
+{
+    ASSERT(src && rgba);
+    BitReader reader {};
+    memcpy(reader.words, src, blockSizeInBytes);
+
+    if ((src[0] & 0x7F) == 1 << 6)
+    {
+        reader.offset = 7;
+        uint8_t endpoints[2][4];
+
+        for (uint32_t c = 0; c < 4; c++)
+        {
+            endpoints[0][c] = (uint8_t)reader.read(7);
+            endpoints[1][c] = (uint8_t)reader.read(7);
+        }
+
+        for (uint32_t e = 0; e < 2; e++)
+        {
+            uint32_t pBit = reader.read(1);
+
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                endpoints[e][c] = (uint8_t)(endpoints[e][c] << 1 | pBit);
+            }
+        }
+
+        for (uint32_t i = 0; i < blockTexelCount; i++)
+        {
+            uint32_t weight = weights4[reader.read(i ? 4 : 3)];
+
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                rgba[i][c] = (uint8_t)(((64 - weight) * endpoints[0][c] + weight * endpoints[1][c] + 32) >> 6);
+            }
+        }
+
+        return true;
+    }
+
+    if ((src[0] & 3) == 1 << 1)
+    {
+        reader.offset = 2;
+        uint32_t partition = reader.read(6);
+        uint8_t endpoints[2][2][4]; // [subset][endpoint]
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            for (uint32_t s = 0; s < 2; s++)
+            {
+                endpoints[s][0][c] = (uint8_t)reader.read(6);
+                endpoints[s][1][c] = (uint8_t)reader.read(6);
+            }
+        }
+
+        for (uint32_t s = 0; s < 2; s++)
+        {
+            uint32_t pBit = reader.read(1);
+
+            for (uint32_t e = 0; e < 2; e++)
+            {
+                for (uint32_t c = 0; c < 3; c++)
+                {
+                    endpoints[s][e][c] = unquantizeBC7(endpoints[s][e][c] << 1 | pBit, 7);
+                }
+            }
+        }
+
+        uint32_t anchors[2] = { 0, anchorTable2[partition] };
+
+        for (uint32_t i = 0; i < blockTexelCount; i++)
+        {
+            uint32_t s = partitionTable2[partition] >> i & 1;
+            uint32_t weight = weights3[reader.read(i == anchors[s] ? 2 : 3)];
+
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                rgba[i][c] = (uint8_t)(((64 - weight) * endpoints[s][0][c] + weight * endpoints[s][1][c] + 32) >> 6);
+            }
+
+            rgba[i][3] = 255;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+#pragma endregion
+
+#pragma region BC6H
+static constexpr uint32_t modeBitsBC6 = 0x03; // mode 11, one region with 10 bit endpoints
+static constexpr uint32_t endpointBitsBC6 = 10;
+static constexpr uint32_t maxEndpointBC6 = (1 << endpointBitsBC6) - 1;
+
+static inline uint32_t unquantizeBC6(uint32_t value)
+{
+    if (value == 0)
+        return 0;
+    if (value == maxEndpointBC6)
+        return 0xFFFF;
+
+    return ((value << 16) + 0x8000) >> endpointBitsBC6;
+}
+
+// the nearest code after unquantization, x is in the interpolation domain [0, 0xFFFF]
+static inline uint32_t quantizeBC6(float x)
+{
+    int32_t code = clampi((int32_t)((x - 32.f) / 64.f), 0, maxEndpointBC6 - 1);
+    float lowError = fabsf(x - unquantizeBC6((uint32_t)code));
+    float highError = fabsf(x - unquantizeBC6((uint32_t)code + 1));
+    return (uint32_t)code + (highError < lowError ? 1 : 0);
+}
+
+void compressBlockBC6(const uint16_t *rgb, uint32_t stride, uint8_t *dst)
+{
+    ASSERT(rgb && dst);
+    BlockPixels pixels;
+    pixels.count = blockTexelCount;
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        const uint16_t *texel = rgb + (i / 4) * stride + (i % 4) * 3;
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            uint16_t half = texel[c];
+
+            if (half & 0x8000) // negative
+                half = 0;
+            else if (half > 0x7BFF) // inf or nan
+                half = 0x7BFF;
+
+            pixels.channels[c][i] = half * 64.f / 31.f; // inverse of the final unsigned unquantization
+        }
+
+        pixels.channels[3][i] = 0.f;
+    }
+
+    float interpolationWeights[16];
+    loadInterpolationWeights(weights4, 16, interpolationWeights);
+    float endpoints[2][4];
+    fitEndpoints(pixels, 3, endpoints);
+
+    uint32_t codes[2][3], bestCodes[2][3] {};
+    uint8_t indices[blockTexelCount], bestIndices[blockTexelCount] {};
+    float bestError = FLT_MAX;
+
+    for (uint32_t iteration = 0; iteration <= refineIterationCount; iteration++)
+    {
+        float palette[16][4];
+        uint32_t values[2][3];
+
+        for (uint32_t e = 0; e < 2; e++)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                codes[e][c] = quantizeBC6(clampf(endpoints[e][c], 0.f, 65535.f));
+                values[e][c] = unquantizeBC6(codes[e][c]);
+            }
+        }
+
+        for (uint32_t k = 0; k < 16; k++)
+        {
+            for (uint32_t c = 0; c < 3; c++)
+            {
+                palette[k][c] = (float)(((64 - weights4[k]) * values[0][c] + weights4[k] * values[1][c] + 32) >> 6);
+            }
+        }
+
+        float error = findIndices(pixels, palette, 16, 3, indices);
+
+        if (error < bestError)
+        {
+            bestError = error;
+            memcpy(bestCodes, codes, sizeof(codes));
+            memcpy(bestIndices, indices, sizeof(indices));
+        }
+
+        if (bestError == 0.f || !refineEndpoints(pixels, 3, indices, interpolationWeights, endpoints))
+            break;
+    }
+
+    if (bestIndices[0] > 7) // the anchor index has an implicit 0 as its most significant bit
+    {
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            uint32_t temp = bestCodes[0][c];
+            bestCodes[0][c] = bestCodes[1][c];
+            bestCodes[1][c] = temp;
+        }
+
+        for (uint32_t i = 0; i < blockTexelCount; i++)
+        {
+            bestIndices[i] = (uint8_t)(15 - bestIndices[i]);
+        }
+    }
+
+    BitWriter writer {};
+    writer.write(modeBitsBC6, 5);
+
+    for (uint32_t e = 0; e < 2; e++)
+    {
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            writer.write(bestCodes[e][c], endpointBitsBC6);
+        }
+    }
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        writer.write(bestIndices[i], i ? 4 : 3);
+    }
+
+    ASSERT(writer.offset == 128);
+    memcpy(dst, writer.words, blockSizeInBytes);
+}
+
+bool decompressBlockBC6(const uint8_t *src, uint16_t rgb[16][3])
+{
+    ASSERT(src && rgb);
+    BitReader reader {};
+    memcpy(reader.words, src, blockSizeInBytes);
+
+    if (reader.read(5) != modeBitsBC6)
+        return false;
+
+    uint32_t values[2][3];
+
+    for (uint32_t e = 0; e < 2; e++)
+    {
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            values[e][c] = unquantizeBC6(reader.read(endpointBitsBC6));
+        }
+    }
+
+    for (uint32_t i = 0; i < blockTexelCount; i++)
+    {
+        uint32_t weight = weights4[reader.read(i ? 4 : 3)];
+
+        for (uint32_t c = 0; c < 3; c++)
+        {
+            uint32_t value = ((64 - weight) * values[0][c] + weight * values[1][c] + 32) >> 6;
+            rgb[i][c] = (uint16_t)((value * 31) >> 6);
+        }
+    }
+
+    return true;
+}
+#pragma endregion
+
+void initBlockCompression(float quality, SimdIsa maxIsa)
+{
+    ASSERT(quality >= 0.f && quality <= 1.f);
+    refineIterationCount = 1 + (uint32_t)(quality * 4); // 0.1 gives 1 least squares pass
+    partitionCandidateCount = 1 + (uint32_t)(quality * 32); // 0.1 gives 4 out of 64
+    mode1ErrorThreshold = (1.f - quality) * blockTexelCount * 3 * 4; // 0.1 tolerates a RMS error of ~1.9 per channel
+
+    SimdIsa isa = (SimdIsa)min((uint32_t)getMaxSimdIsa(), (uint32_t)maxIsa);
+
+    switch (isa)
+    {
+    case SimdIsa::Scalar:
+        findIndices = findIndicesScalar;
+        estimatePartitionErrors = estimatePartitionErrorsScalar;
+        quantizeEndpointBC7 = quantizeEndpointBC7Scalar;
+        break;
+    case SimdIsa::Sse41:
+        findIndices = findIndicesSse41;
+        estimatePartitionErrors = estimatePartitionErrorsSse41;
+        quantizeEndpointBC7 = quantizeEndpointBC7Sse41;
+        break;
+    case SimdIsa::Avx2:
+        findIndices = findIndicesAvx2;
+        estimatePartitionErrors = estimatePartitionErrorsAvx2;
+        quantizeEndpointBC7 = quantizeEndpointBC7Sse41; // four channels fill a 128-bit register already
+        break;
+    }
+}
\ No newline at end of file
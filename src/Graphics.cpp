@@ -127,6 +127,11 @@ void freeCmd(Cmd cmd)
     vkFreeCommandBuffers(device, cmd.commandPool, 1, &cmd.commandBuffer);
 }
 
+uint32_t getStagingBufferSize()
+{
+    return stagingBuffer.size;
+}
+
 GpuBuffer createGpuBuffer(uint32_t size,
     VkBufferUsageFlags usageFlags,
     VkMemoryPropertyFlags propertyFlags,
@@ -192,69 +197,219 @@ GpuImage createGpuImage(VkFormat format, VkExtent2D extent, uint8_t mipLevels, V
     return image;
 }
 
-static void copyStagingBufferToImage(GpuImage &image, VkBufferImageCopy *copyRegions, uint32_t copyRegionCount, QueueFamily dstQueueFamily, VkImageLayout dstLayout);
-static void copyImageToStagingBuffer(const GpuImage &image, VkBufferImageCopy *copyRegions, uint32_t copyRegionCount, QueueFamily srcQueueFamily, VkImageLayout srcLayout);
+static void recordStagingBufferToImagesCopy(Cmd transferCmd, GpuImage *images, uint32_t imageCount, const VkBufferImageCopy *copyRegions, const uint32_t *copyRegionCounts,
+    VkImageLayout oldLayout);
+static void copyStagingBufferToImages(GpuImage *images, uint32_t imageCount, const VkBufferImageCopy *copyRegions, const uint32_t *copyRegionCounts, QueueFamily dstQueueFamily, VkImageLayout dstLayout,
+    VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED);
+static void copyImagesToStagingBuffer(const GpuImage *images, uint32_t imageCount, const VkBufferImageCopy *copyRegions, const uint32_t *copyRegionCounts, QueueFamily srcQueueFamily, VkImageLayout srcLayout);
+
+static constexpr uint32_t stagingImageAlignment = 16; // the largest texel size, so that every copy region stays aligned
+
+struct CopyRegionsInfo
+{
+    VkBufferImageCopy *copyRegions;
+    uint32_t bufferOffset;
+};
+
+// one region per level and face, returns the data size of the image
+static uint32_t fillCopyRegions(const Image &image, VkBufferImageCopy *copyRegions, uint32_t bufferOffset)
+{
+    memset(copyRegions, 0, image.faceCount * image.levelCount * sizeof(VkBufferImageCopy));
+    CopyRegionsInfo info { copyRegions, bufferOffset };
+
+    return iterateImageLevelFaces(image, [](const Image &image, uint8_t level, uint8_t face, uint16_t mipWidth, uint16_t mipHeight, uint32_t dataOffset, uint32_t dataSize, void *userData)
+    {
+        UNUSED(dataSize);
+        CopyRegionsInfo &info = *(CopyRegionsInfo *)userData;
+        uint8_t index = level * image.faceCount + face;
+        info.copyRegions[index].bufferOffset = info.bufferOffset + dataOffset;
+        info.copyRegions[index].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        info.copyRegions[index].imageSubresource.mipLevel = level;
+        info.copyRegions[index].imageSubresource.baseArrayLayer = face;
+        info.copyRegions[index].imageSubresource.layerCount = 1;
+        info.copyRegions[index].imageExtent = { mipWidth, mipHeight, 1 };
+    }, &info);
+}
 
 void copyImage(const Image &srcImage, GpuImage &dstImage, QueueFamily dstQueueFamily, VkImageLayout dstLayout)
 {
-    ASSERT(srcImage.data && srcImage.dataSize);
-    ASSERT(srcImage.levelCount == dstImage.levelCount);
-    ASSERT(srcImage.faceCount == dstImage.layerCount);
+    copyImages(&srcImage, &dstImage, 1, dstQueueFamily, dstLayout);
+}
+
+void copyImage(const GpuImage &srcImage, Image &dstImage, QueueFamily srcQueueFamily, VkImageLayout srcLayout)
+{
+    copyImages(&srcImage, &dstImage, 1, srcQueueFamily, srcLayout);
+}
+
+void copyImages(const Image *srcImages, GpuImage *dstImages, uint32_t imageCount, QueueFamily dstQueueFamily, VkImageLayout dstLayout)
+{
+    copyImages(srcImages, dstImages, imageCount, [](uint8_t *const *stagingData, uint32_t imageCount, void *userData)
+    {
+        const Image *images = (const Image *)userData;
+
+        for (uint32_t i = 0; i < imageCount; i++)
+        {
+            ASSERT(images[i].data);
+            memcpy(stagingData[i], images[i].data, images[i].dataSize);
+        }
+    }, (void *)srcImages, dstQueueFamily, dstLayout);
+}
+
+void copyImages(const Image *srcImages, GpuImage *dstImages, uint32_t imageCount, FillStagingCallback fillCallback, void *userData, QueueFamily dstQueueFamily, VkImageLayout dstLayout)
+{
+    ZoneScoped;
+    ASSERT(srcImages && dstImages && imageCount && fillCallback);
+    uint32_t copyRegionCount = 0;
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        ASSERT(srcImages[i].dataSize);
+        ASSERT(srcImages[i].levelCount <= dstImages[i].levelCount); // the missing levels are left for blitGpuImageMips
+        ASSERT(srcImages[i].faceCount == dstImages[i].layerCount);
+        ASSERT(srcImages[i].format == dstImages[i].format);
+        ASSERT(srcImages[i].width == dstImages[i].extent.width);
+        ASSERT(srcImages[i].height == dstImages[i].extent.height);
+        copyRegionCount += srcImages[i].faceCount * srcImages[i].levelCount;
+    }
+
+    VkBufferImageCopy *copyRegions = new VkBufferImageCopy[copyRegionCount];
+    uint32_t *copyRegionCounts = new uint32_t[imageCount];
+    uint8_t **stagingData = new uint8_t *[imageCount];
+    uint32_t bufferOffset = 0;
+
+    for (uint32_t i = 0, regionOffset = 0; i < imageCount; i++)
+    {
+        bufferOffset = aligned(bufferOffset, stagingImageAlignment);
+        ASSERT(bufferOffset + srcImages[i].dataSize <= stagingBuffer.size);
+        stagingData[i] = (uint8_t *)stagingBufferMappedData + bufferOffset;
+        fillCopyRegions(srcImages[i], copyRegions + regionOffset, bufferOffset);
+        copyRegionCounts[i] = srcImages[i].faceCount * srcImages[i].levelCount;
+        regionOffset += copyRegionCounts[i];
+        bufferOffset += srcImages[i].dataSize;
+    }
+
+    fillCallback(stagingData, imageCount, userData);
+    copyStagingBufferToImages(dstImages, imageCount, copyRegions, copyRegionCounts, dstQueueFamily, dstLayout);
+    delete[] copyRegions;
+    delete[] copyRegionCounts;
+    delete[] stagingData;
+}
+
+void copyImageRows(const Image &srcImage, GpuImage &dstImage, FillStagingRowsCallback fillCallback, void *userData, QueueFamily dstQueueFamily, VkImageLayout dstLayout)
+{
+    ZoneScoped;
+    ASSERT(fillCallback);
+    ASSERT(srcImage.dataSize && srcImage.levelCount == 1 && srcImage.faceCount == 1);
+    ASSERT(dstImage.layerCount == 1);
     ASSERT(srcImage.format == dstImage.format);
     ASSERT(srcImage.width == dstImage.extent.width);
     ASSERT(srcImage.height == dstImage.extent.height);
+    uint32_t rowSize = srcImage.dataSize / srcImage.height;
+    uint32_t halfSize = stagingBuffer.size / 2 / stagingImageAlignment * stagingImageAlignment;
+    uint32_t rowsPerStrip = min(halfSize / rowSize, srcImage.height);
+    ASSERT(rowsPerStrip);
+    Cmd stripCmds[2] {};
+    VkFence stripFences[2] {};
+    VkFenceCreateInfo fenceCreateInfo = initFenceCreateInfo();
+
+    for (uint32_t firstRow = 0, half = 0; firstRow < srcImage.height; firstRow += rowsPerStrip, half ^= 1)
+    {
+        uint32_t rowCount = min(rowsPerStrip, srcImage.height - firstRow);
+        bool lastStrip = firstRow + rowCount == srcImage.height;
+        VkBufferImageCopy copyRegion {};
+        copyRegion.bufferOffset = half * halfSize;
+        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copyRegion.imageSubresource.layerCount = 1;
+        copyRegion.imageOffset = { 0, (int32_t)firstRow, 0 };
+        copyRegion.imageExtent = { srcImage.width, rowCount, 1 };
+        uint32_t copyRegionCount = 1;
+        VkImageLayout oldLayout = firstRow ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+
+        if (stripCmds[half].commandBuffer) // the copy of the strip before the previous one still reads this half
+        {
+            vkVerify(vkWaitForFences(device, 1, &stripFences[half], true, UINT64_MAX));
+            vkVerify(vkResetFences(device, 1, &stripFences[half]));
+            freeCmd(stripCmds[half]);
+            stripCmds[half] = {};
+        }
+
+        fillCallback((uint8_t *)stagingBufferMappedData + copyRegion.bufferOffset, (uint16_t)firstRow, (uint16_t)rowCount, userData);
 
-    uint8_t copyRegionsCount = srcImage.faceCount * srcImage.levelCount;
-    VkBufferImageCopy *copyRegions = (VkBufferImageCopy *)alloca(copyRegionsCount * sizeof(VkBufferImageCopy));
-    memset(copyRegions, 0, copyRegionsCount * sizeof(VkBufferImageCopy));
-    memcpy(stagingBuffer.mappedData, srcImage.data, srcImage.dataSize);
+        if (lastStrip) // also hands the image over to dstQueueFamily, the transfer queue runs it after the other strips
+        {
+            copyStagingBufferToImages(&dstImage, 1, &copyRegion, &copyRegionCount, dstQueueFamily, dstLayout, oldLayout);
+            break;
+        }
+
+        // the strips before the last one stay in the copy layout on the transfer queue, the next strip is filled into the other half meanwhile
+        if (!stripFences[half])
+            vkVerify(vkCreateFence(device, &fenceCreateInfo, nullptr, &stripFences[half]));
+
+        stripCmds[half] = allocateCmd(transferCommandPool);
+        beginOneTimeCmd(stripCmds[half]);
+        beginCmdLabel(stripCmds[half], __FUNCTION__);
+        recordStagingBufferToImagesCopy(stripCmds[half], &dstImage, 1, &copyRegion, &copyRegionCount, oldLayout);
+        endCmdLabel(stripCmds[half]);
+        endAndSubmitOneTimeCmd(stripCmds[half], transferQueue, nullptr, nullptr, stripFences[half]);
+    }
 
-    iterateImageLevelFaces(srcImage, [](const Image &image, uint8_t level, uint8_t face, uint16_t mipWidth, uint16_t mipHeight, uint32_t dataOffset, uint32_t dataSize, void *userData)
+    for (uint32_t half = 0; half < 2; half++)
     {
-        UNUSED(dataSize);
-        VkBufferImageCopy *copyRegions = (VkBufferImageCopy *)userData;
-        uint8_t index = level * image.faceCount + face;
-        copyRegions[index].bufferOffset = dataOffset;
-        copyRegions[index].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyRegions[index].imageSubresource.mipLevel = level;
-        copyRegions[index].imageSubresource.baseArrayLayer = face;
-        copyRegions[index].imageSubresource.layerCount = 1;
-        copyRegions[index].imageExtent = { mipWidth, mipHeight, 1 };
-    }, copyRegions);
+        if (stripCmds[half].commandBuffer) // done by now, the last strip was copied after it, but the fence has to say so before the free
+        {
+            vkVerify(vkWaitForFences(device, 1, &stripFences[half], true, UINT64_MAX));
+            freeCmd(stripCmds[half]);
+        }
 
-    copyStagingBufferToImage(dstImage, copyRegions, copyRegionsCount, dstQueueFamily, dstLayout);
+        if (stripFences[half])
+            vkDestroyFence(device, stripFences[half], nullptr);
+    }
 }
 
-void copyImage(const GpuImage &srcImage, Image &dstImage, QueueFamily srcQueueFamily, VkImageLayout srcLayout)
+void copyImages(const GpuImage *srcImages, Image *dstImages, uint32_t imageCount, QueueFamily srcQueueFamily, VkImageLayout srcLayout)
 {
-    dstImage.levelCount = srcImage.levelCount;
-    dstImage.faceCount = srcImage.layerCount;
-    dstImage.format = srcImage.format;
-    dstImage.width = (uint16_t)srcImage.extent.width;
-    dstImage.height = (uint16_t)srcImage.extent.height;
+    ZoneScoped;
+    ASSERT(srcImages && dstImages && imageCount);
+    uint32_t copyRegionCount = 0;
 
-    uint8_t copyRegionsCount = dstImage.faceCount * dstImage.levelCount;
-    VkBufferImageCopy *copyRegions = (VkBufferImageCopy *)alloca(copyRegionsCount * sizeof(VkBufferImageCopy));
-    memset(copyRegions, 0, copyRegionsCount * sizeof(VkBufferImageCopy));
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        dstImages[i].levelCount = srcImages[i].levelCount;
+        dstImages[i].faceCount = srcImages[i].layerCount;
+        dstImages[i].format = srcImages[i].format;
+        dstImages[i].width = (uint16_t)srcImages[i].extent.width;
+        dstImages[i].height = (uint16_t)srcImages[i].extent.height;
+        copyRegionCount += dstImages[i].faceCount * dstImages[i].levelCount;
+    }
 
-    dstImage.dataSize = iterateImageLevelFaces(dstImage, [](const Image &image, uint8_t level, uint8_t face, uint16_t mipWidth, uint16_t mipHeight, uint32_t dataOffset, uint32_t dataSize, void *userData)
+    VkBufferImageCopy *copyRegions = new VkBufferImageCopy[copyRegionCount];
+    uint32_t *copyRegionCounts = new uint32_t[imageCount];
+    uint32_t *bufferOffsets = new uint32_t[imageCount];
+    uint32_t bufferOffset = 0;
+
+    for (uint32_t i = 0, regionOffset = 0; i < imageCount; i++)
     {
-        UNUSED(dataSize);
-        VkBufferImageCopy *copyRegions = (VkBufferImageCopy *)userData;
-        uint8_t index = level * image.faceCount + face;
-        copyRegions[index].bufferOffset = dataOffset;
-        copyRegions[index].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyRegions[index].imageSubresource.mipLevel = level;
-        copyRegions[index].imageSubresource.baseArrayLayer = face;
-        copyRegions[index].imageSubresource.layerCount = 1;
-        copyRegions[index].imageExtent = { mipWidth, mipHeight, 1 };
-    }, copyRegions);
+        bufferOffset = aligned(bufferOffset, stagingImageAlignment);
+        bufferOffsets[i] = bufferOffset;
+        dstImages[i].dataSize = fillCopyRegions(dstImages[i], copyRegions + regionOffset, bufferOffset);
+        copyRegionCounts[i] = dstImages[i].faceCount * dstImages[i].levelCount;
+        regionOffset += copyRegionCounts[i];
+        bufferOffset += dstImages[i].dataSize;
+        ASSERT(bufferOffset <= stagingBuffer.size);
+    }
 
-    copyImageToStagingBuffer(srcImage, copyRegions, copyRegionsCount, srcQueueFamily, srcLayout);
+    copyImagesToStagingBuffer(srcImages, imageCount, copyRegions, copyRegionCounts, srcQueueFamily, srcLayout);
 
-    delete[] dstImage.data;
-    dstImage.data = new uint8_t[dstImage.dataSize];
-    memcpy(dstImage.data, stagingBuffer.mappedData, dstImage.dataSize);
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        delete[] dstImages[i].data;
+        dstImages[i].data = new uint8_t[dstImages[i].dataSize];
+        memcpy(dstImages[i].data, stagingBufferMappedData + bufferOffsets[i], dstImages[i].dataSize);
+    }
+
+    delete[] copyRegions;
+    delete[] copyRegionCounts;
+    delete[] bufferOffsets;
 }
 
 GpuImage createAndCopyGpuImage(const Image &image, QueueFamily dstQueueFamily, VkImageUsageFlags usageFlags, GpuImageType type, VkImageLayout dstLayout, VkImageAspectFlags aspectFlags, uint8_t sampleCount)
@@ -265,6 +420,18 @@ GpuImage createAndCopyGpuImage(const Image &image, QueueFamily dstQueueFamily, V
     return gpuImage;
 }
 
+void copyImageToBuffer(Cmd cmd, const GpuImage &srcImage, const Image &dstImage, GpuBuffer &dstBuffer)
+{
+    ASSERT(dstImage.levelCount == srcImage.levelCount && dstImage.faceCount == srcImage.layerCount && dstImage.format == srcImage.format);
+    uint32_t copyRegionCount = dstImage.faceCount * dstImage.levelCount;
+    VkBufferImageCopy *copyRegions = new VkBufferImageCopy[copyRegionCount];
+    uint32_t dataSize = fillCopyRegions(dstImage, copyRegions, 0);
+    ASSERT(dataSize <= dstBuffer.size);
+    UNUSED(dataSize);
+    vkCmdCopyImageToBuffer(cmd.commandBuffer, srcImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dstBuffer.buffer, copyRegionCount, copyRegions);
+    delete[] copyRegions;
+}
+
 void blitGpuImageMips(Cmd cmd, GpuImage &gpuImage, VkImageLayout oldLayout, VkImageLayout newLayout, StageFlags srcStage, StageFlags dstStage)
 {
     ZoneScoped;
@@ -536,37 +703,66 @@ void copyBufferToStagingBuffer(GpuBuffer &buffer, VkBufferCopy *copyRegions, uin
     freeCmd(transferCmd);
 }
 
-static void copyStagingBufferToImage(GpuImage &image, VkBufferImageCopy *copyRegions, uint32_t copyRegionCount, QueueFamily dstQueueFamily, VkImageLayout dstLayout)
+// the same barrier for every image, the images are in the same state
+static ImageBarrier *initImageBarriers(const GpuImage *images, uint32_t imageCount, const ImageBarrier &barrier)
+{
+    ImageBarrier *imageBarriers = new ImageBarrier[imageCount];
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        imageBarriers[i] = barrier;
+        imageBarriers[i].image = images[i];
+    }
+
+    return imageBarriers;
+}
+
+// leaves the images in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+static void recordStagingBufferToImagesCopy(Cmd transferCmd, GpuImage *images, uint32_t imageCount, const VkBufferImageCopy *copyRegions, const uint32_t *copyRegionCounts,
+    VkImageLayout oldLayout)
+{
+    bool keepContents = oldLayout != VK_IMAGE_LAYOUT_UNDEFINED; // earlier copies into the images, e.g. the previous strips of copyImageRows
+    ImageBarrier imageBarrier {};
+    imageBarrier.srcStageMask = keepContents ? StageFlags::Copy : StageFlags::None;
+    imageBarrier.dstStageMask = StageFlags::Copy;
+    imageBarrier.srcAccessMask = keepContents ? AccessFlags::Write : AccessFlags::None;
+    imageBarrier.dstAccessMask = AccessFlags::Write;
+    imageBarrier.oldLayout = oldLayout;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    ImageBarrier *copyBarriers = initImageBarriers(images, imageCount, imageBarrier);
+    pipelineBarrier(transferCmd, nullptr, 0, copyBarriers, imageCount);
+    delete[] copyBarriers;
+
+    for (uint32_t i = 0; i < imageCount; copyRegions += copyRegionCounts[i], i++)
+    {
+        vkCmdCopyBufferToImage(transferCmd.commandBuffer, stagingBuffer.buffer, images[i].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegionCounts[i], copyRegions);
+    }
+}
+
+static void copyStagingBufferToImages(GpuImage *images, uint32_t imageCount, const VkBufferImageCopy *copyRegions, const uint32_t *copyRegionCounts, QueueFamily dstQueueFamily, VkImageLayout dstLayout,
+    VkImageLayout oldLayout)
 {
     ZoneScoped;
     Cmd transferCmd = allocateCmd(transferCommandPool);
+    beginOneTimeCmd(transferCmd);
+    beginCmdLabel(transferCmd, __FUNCTION__);
+    recordStagingBufferToImagesCopy(transferCmd, images, imageCount, copyRegions, copyRegionCounts, oldLayout);
+    ImageBarrier imageBarrier {};
 
     if (dstQueueFamily == QueueFamily::None || dstQueueFamily == QueueFamily::Transfer)
     {
-        beginOneTimeCmd(transferCmd);
-        beginCmdLabel(transferCmd, __FUNCTION__);
-        ImageBarrier imageBarrier {};
-        imageBarrier.image = image;
-        imageBarrier.srcStageMask = StageFlags::None;
-        imageBarrier.dstStageMask = StageFlags::Copy;
-        imageBarrier.srcAccessMask = AccessFlags::None;
-        imageBarrier.dstAccessMask = AccessFlags::Write;
-        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        pipelineBarrier(transferCmd, nullptr, 0, &imageBarrier, 1);
-        vkCmdCopyBufferToImage(transferCmd.commandBuffer, stagingBuffer.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegionCount, copyRegions);
-
         if (dstLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL)
         {
             imageBarrier = {};
-            imageBarrier.image = image;
             imageBarrier.srcStageMask = StageFlags::Copy;
             imageBarrier.dstStageMask = StageFlags::None;
             imageBarrier.srcAccessMask = AccessFlags::Write;
             imageBarrier.dstAccessMask = AccessFlags::None;
             imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
             imageBarrier.newLayout = dstLayout;
-            pipelineBarrier(transferCmd, nullptr, 0, &imageBarrier, 1);
+            ImageBarrier *layoutBarriers = initImageBarriers(images, imageCount, imageBarrier);
+            pipelineBarrier(transferCmd, nullptr, 0, layoutBarriers, imageCount);
+            delete[] layoutBarriers;
         }
 
         endCmdLabel(transferCmd);
@@ -600,21 +796,8 @@ static void copyStagingBufferToImage(GpuImage &image, VkBufferImageCopy *copyReg
     VkSemaphoreCreateInfo semaphoreCreateInfo = initSemaphoreCreateInfo();
     vkVerify(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
     VkSemaphoreSubmitInfoKHR ownershipReleaseFinishedInfo = initSemaphoreSubmitInfo(semaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR);
-    ImageBarrier imageBarrier {};
 
-    beginOneTimeCmd(transferCmd);
-    beginCmdLabel(transferCmd, __FUNCTION__);
-    imageBarrier.image = image;
-    imageBarrier.srcStageMask = StageFlags::None;
-    imageBarrier.dstStageMask = StageFlags::Copy;
-    imageBarrier.srcAccessMask = AccessFlags::None;
-    imageBarrier.dstAccessMask = AccessFlags::Write;
-    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    pipelineBarrier(transferCmd, nullptr, 0, &imageBarrier, 1);
-    vkCmdCopyBufferToImage(transferCmd.commandBuffer, stagingBuffer.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegionCount, copyRegions);
     imageBarrier = {};
-    imageBarrier.image = image;
     imageBarrier.srcStageMask = StageFlags::Copy;
     imageBarrier.dstStageMask = StageFlags::None;
     imageBarrier.srcAccessMask = AccessFlags::Write;
@@ -623,21 +806,24 @@ static void copyStagingBufferToImage(GpuImage &image, VkBufferImageCopy *copyReg
     imageBarrier.newLayout = dstLayout;
     imageBarrier.srcQueueFamily = QueueFamily::Transfer;
     imageBarrier.dstQueueFamily = dstQueueFamily;
-    pipelineBarrier(transferCmd, nullptr, 0, &imageBarrier, 1);
+    ImageBarrier *releaseBarriers = initImageBarriers(images, imageCount, imageBarrier);
+    pipelineBarrier(transferCmd, nullptr, 0, releaseBarriers, imageCount);
+    delete[] releaseBarriers;
     endCmdLabel(transferCmd);
     endAndSubmitOneTimeCmd(transferCmd, transferQueue, nullptr, &ownershipReleaseFinishedInfo, WaitForFence::No);
 
     beginOneTimeCmd(dstCmd);
     beginCmdLabel(dstCmd, "QFO Acquire");
     imageBarrier = {};
-    imageBarrier.image = image;
     imageBarrier.dstStageMask = dstStageMask;
     imageBarrier.dstAccessMask = AccessFlags::Read | AccessFlags::Write;
     imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     imageBarrier.newLayout = dstLayout;
     imageBarrier.srcQueueFamily = QueueFamily::Transfer;
     imageBarrier.dstQueueFamily = dstQueueFamily;
-    pipelineBarrier(dstCmd, nullptr, 0, &imageBarrier, 1);
+    ImageBarrier *acquireBarriers = initImageBarriers(images, imageCount, imageBarrier);
+    pipelineBarrier(dstCmd, nullptr, 0, acquireBarriers, imageCount);
+    delete[] acquireBarriers;
     endCmdLabel(dstCmd);
     endAndSubmitOneTimeCmd(dstCmd, dstQueue, &ownershipReleaseFinishedInfo, nullptr, WaitForFence::Yes);
 
@@ -646,94 +832,99 @@ static void copyStagingBufferToImage(GpuImage &image, VkBufferImageCopy *copyReg
     freeCmd(dstCmd);
 }
 
-static void copyImageToStagingBuffer(const GpuImage &image, VkBufferImageCopy *copyRegions, uint32_t copyRegionCount, QueueFamily srcQueueFamily, VkImageLayout srcLayout)
+static void copyImagesToStagingBuffer(const GpuImage *images, uint32_t imageCount, const VkBufferImageCopy *copyRegions, const uint32_t *copyRegionCounts, QueueFamily srcQueueFamily, VkImageLayout srcLayout)
 {
     ZoneScoped;
     Cmd transferCmd = allocateCmd(transferCommandPool);
-    BufferBarrier bufferBarrier {}; // this barrier is needed because copyStagingBufferToImage has no fence to make vkCmdCopyBufferToImage changes visible
+    BufferBarrier bufferBarrier {}; // this barrier is needed because copyStagingBufferToImages has no fence to make vkCmdCopyBufferToImage changes visible
     bufferBarrier.buffer = stagingBuffer;
     bufferBarrier.srcStageMask = StageFlags::Copy;
     bufferBarrier.dstStageMask = StageFlags::Copy;
     bufferBarrier.srcAccessMask = AccessFlags::Read;
     bufferBarrier.dstAccessMask = AccessFlags::Write;
+    ImageBarrier imageBarrier {};
+    VkSemaphore semaphore = nullptr;
+    VkSemaphoreSubmitInfoKHR ownershipReleaseFinishedInfo {};
+    Cmd srcCmd {};
 
     if (srcQueueFamily == QueueFamily::Transfer)
     {
-        beginCmdLabel(transferCmd, __FUNCTION__);
-        ImageBarrier imageBarrier {};
-        imageBarrier.image = image;
         imageBarrier.srcStageMask = StageFlags::None;
         imageBarrier.dstStageMask = StageFlags::Copy;
         imageBarrier.srcAccessMask = AccessFlags::None;
         imageBarrier.dstAccessMask = AccessFlags::Read;
         imageBarrier.oldLayout = srcLayout;
         imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-        pipelineBarrier(transferCmd, &bufferBarrier, 1, &imageBarrier, 1);
-        vkCmdCopyImageToBuffer(transferCmd.commandBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer.buffer, copyRegionCount, copyRegions);
-        endCmdLabel(transferCmd);
-        endAndSubmitOneTimeCmd(transferCmd, transferQueue, nullptr, nullptr, WaitForFence::Yes);
-        freeCmd(transferCmd);
-        return;
     }
-
-    VkQueue srcQueue;
-    Cmd srcCmd;
-    StageFlags srcStageMask;
-
-    switch (srcQueueFamily)
+    else
     {
-    case QueueFamily::Graphics:
-        srcQueue = graphicsQueue;
-        srcCmd = allocateCmd(graphicsCommandPool);
-        srcStageMask = StageFlags::FragmentShader;
-        break;
-    case QueueFamily::Compute:
-        srcQueue = computeQueue;
-        srcCmd = allocateCmd(computeCommandPool);;
-        srcStageMask = StageFlags::ComputeShader;
-        break;
-    default:
-        ASSERT(false);
-        return;
-    }
+        VkQueue srcQueue;
+        StageFlags srcStageMask;
 
-    VkSemaphore semaphore;
-    VkSemaphoreCreateInfo semaphoreCreateInfo = initSemaphoreCreateInfo();
-    vkVerify(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
-    VkSemaphoreSubmitInfoKHR ownershipReleaseFinishedInfo = initSemaphoreSubmitInfo(semaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR);
-    ImageBarrier imageBarrier {};
+        switch (srcQueueFamily)
+        {
+        case QueueFamily::Graphics:
+            srcQueue = graphicsQueue;
+            srcCmd = allocateCmd(graphicsCommandPool);
+            srcStageMask = StageFlags::FragmentShader;
+            break;
+        case QueueFamily::Compute:
+            srcQueue = computeQueue;
+            srcCmd = allocateCmd(computeCommandPool);
+            srcStageMask = StageFlags::ComputeShader;
+            break;
+        default:
+            ASSERT(false);
+            return;
+        }
 
-    beginOneTimeCmd(srcCmd);
-    beginCmdLabel(srcCmd, "QFO Release");
-    imageBarrier.image = image;
-    imageBarrier.srcStageMask = srcStageMask;
-    imageBarrier.srcAccessMask = AccessFlags::Read | AccessFlags::Write;
-    imageBarrier.oldLayout = srcLayout;
-    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    imageBarrier.srcQueueFamily = srcQueueFamily;
-    imageBarrier.dstQueueFamily = QueueFamily::Transfer;
-    pipelineBarrier(srcCmd, nullptr, 0, &imageBarrier, 1);
-    endCmdLabel(srcCmd);
-    endAndSubmitOneTimeCmd(srcCmd, srcQueue, nullptr, &ownershipReleaseFinishedInfo, WaitForFence::No);
+        VkSemaphoreCreateInfo semaphoreCreateInfo = initSemaphoreCreateInfo();
+        vkVerify(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore));
+        ownershipReleaseFinishedInfo = initSemaphoreSubmitInfo(semaphore, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR);
+
+        beginOneTimeCmd(srcCmd);
+        beginCmdLabel(srcCmd, "QFO Release");
+        imageBarrier.srcStageMask = srcStageMask;
+        imageBarrier.srcAccessMask = AccessFlags::Read | AccessFlags::Write;
+        imageBarrier.oldLayout = srcLayout;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageBarrier.srcQueueFamily = srcQueueFamily;
+        imageBarrier.dstQueueFamily = QueueFamily::Transfer;
+        ImageBarrier *releaseBarriers = initImageBarriers(images, imageCount, imageBarrier);
+        pipelineBarrier(srcCmd, nullptr, 0, releaseBarriers, imageCount);
+        delete[] releaseBarriers;
+        endCmdLabel(srcCmd);
+        endAndSubmitOneTimeCmd(srcCmd, srcQueue, nullptr, &ownershipReleaseFinishedInfo, WaitForFence::No);
+
+        imageBarrier = {};
+        imageBarrier.dstStageMask = StageFlags::Copy;
+        imageBarrier.dstAccessMask = AccessFlags::Read;
+        imageBarrier.oldLayout = srcLayout;
+        imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        imageBarrier.srcQueueFamily = srcQueueFamily;
+        imageBarrier.dstQueueFamily = QueueFamily::Transfer;
+    }
 
     beginOneTimeCmd(transferCmd);
     beginCmdLabel(transferCmd, __FUNCTION__);
-    imageBarrier = {};
-    imageBarrier.image = image;
-    imageBarrier.dstStageMask = StageFlags::Copy;
-    imageBarrier.dstAccessMask = AccessFlags::Read;
-    imageBarrier.oldLayout = srcLayout;
-    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    imageBarrier.srcQueueFamily = srcQueueFamily;
-    imageBarrier.dstQueueFamily = QueueFamily::Transfer;
-    pipelineBarrier(transferCmd, &bufferBarrier, 1, &imageBarrier, 1);
-    vkCmdCopyImageToBuffer(transferCmd.commandBuffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer.buffer, copyRegionCount, copyRegions);
-    endCmdLabel(transferCmd);
-    endAndSubmitOneTimeCmd(transferCmd, transferQueue, &ownershipReleaseFinishedInfo, nullptr, WaitForFence::Yes);
+    ImageBarrier *copyBarriers = initImageBarriers(images, imageCount, imageBarrier);
+    pipelineBarrier(transferCmd, &bufferBarrier, 1, copyBarriers, imageCount);
+    delete[] copyBarriers;
 
-    vkDestroySemaphore(device, semaphore, nullptr);
+    for (uint32_t i = 0; i < imageCount; copyRegions += copyRegionCounts[i], i++)
+    {
+        vkCmdCopyImageToBuffer(transferCmd.commandBuffer, images[i].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer.buffer, copyRegionCounts[i], copyRegions);
+    }
+
+    endCmdLabel(transferCmd);
+    endAndSubmitOneTimeCmd(transferCmd, transferQueue, semaphore ? &ownershipReleaseFinishedInfo : nullptr, nullptr, WaitForFence::Yes);
     freeCmd(transferCmd);
-    freeCmd(srcCmd);
+
+    if (semaphore)
+    {
+        vkDestroySemaphore(device, semaphore, nullptr);
+        freeCmd(srcCmd);
+    }
 }
 
 GraphicsPipelineBuilder::GraphicsPipelineBuilder()
@@ -2,22 +2,31 @@
 #include "DebugUtils.hpp"
 #include "ImageUtils.hpp"
 #include "JobSystem.hpp"
+#include "Ktx2.hpp"
+#include "MipGeneration.hpp"
+#include "Parallel.hpp"
+#include "RadianceHdr.hpp"
 #include "ShaderUtils.hpp"
 #include "Utils.hpp"
 #include "VkUtils.hpp"
 #include "../src/shaders/common.h"
 
+#ifdef NATIVE_BLOCK_COMPRESSION
+#include "BlockCompression.hpp"
+#else
 #include <cmp_core.h>
+#endif
 #define KHRONOS_STATIC
 #include <ktx.h>
 #define STBI_NO_STDIO
 #define STBI_ONLY_JPEG
 #define STBI_ONLY_PNG
-#define STBI_ONLY_HDR
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#define MIPS_BLIT
+#if defined(VERIFY_GPU_COMPRESSION) && !defined(NATIVE_BLOCK_COMPRESSION)
+#error "The GPU encoders are verified against the native encoder and decoders"
+#endif
 
 extern VkPhysicalDeviceProperties physicalDeviceProperties;
 extern VkDevice device;
@@ -30,26 +39,82 @@ extern VkQueue computeQueue;
 static VkPipelineLayout commonPipelineLayout;
 static VkPipeline computeSkyboxPipeline;
 static VkPipeline computeBrdfLutPipeline;
-static VkPipeline computeIrradianceMapPipeline;
+static VkPipeline computeIrradianceShPipeline;
 static VkPipeline computePrefilteredMapPipeline;
 static VkPipeline normalizeNormalMapPipeline;
+static VkPipeline compressBC5Pipeline;
+static VkPipeline compressBC6Pipeline;
+static VkPipeline compressBC7Pipeline;
+static VkPipeline generateMipsRgba8Pipeline;
+static VkPipeline generateMipsRgba16fPipeline;
 
 static VkDescriptorSetLayout commonDescriptorSetLayout;
 static VkDescriptorSet commonDescriptorSet;
+static VkDescriptorSet envMapDescriptorSets[2]; // same layout, one per HDRI in flight while the env maps are baked
+static VkDescriptorSet envMapCompressionDescriptorSets[countOf(envMapDescriptorSets)]; // the bake set compresses the skybox, this one the prefiltered map
 static VkSampler linearClampSampler;
+static GpuBuffer mipCounterBuffer; // one atomic counter per face of every image of a batch for generateMips.h
+static GpuBuffer prefilteredMapSampleBuffer;
 
 static constexpr uint16_t skyboxFaceSize = 2048;
 static constexpr uint16_t brdfLutSize = 512;
-static constexpr uint16_t irradianceMapFaceSize = 32;
 static constexpr uint16_t prefilteredMapFaceSize = 128;
 static constexpr uint32_t prefilteredMapLevelCount = MAX_PREFILTERED_MAP_LOD + 1;
+// the mirror level needs a single sample, the rougher levels are smaller and read blurrier skybox mips
+static constexpr uint32_t prefilteredMapSampleCounts[prefilteredMapLevelCount] { 1, 256, 128, 96, 64 };
 
 static uint32_t maxWorkGroupSize2d = 0;
+static constexpr uint32_t compressionWorkGroupSize = 64; // one block per invocation
+
+struct CompressionConstants
+{
+    uint32_t level;
+    uint32_t firstBlock;
+    uint32_t srgb;
+};
+
+static CompressionDevice compressionDevices[] // indexed by ImagePurpose
+{
+    CompressionDevice::Cpu, // Undefined
+    CompressionDevice::Cpu, // Color
+    CompressionDevice::Cpu, // Normal
+    CompressionDevice::Cpu, // Shading
+    CompressionDevice::Gpu // HDRI, the env maps are already on the GPU
+};
+
+struct MipConstants
+{
+    uint32_t levelCount;
+    uint32_t srgb;
+    uint32_t imageIndex;
+};
+static_assert(sizeof(MipConstants) <= sizeof(CompressionConstants), "");
+
+struct PrefilteredMapConstants
+{
+    uint32_t level;
+    uint32_t firstSample;
+    uint32_t sampleCount;
+};
+static_assert(sizeof(PrefilteredMapConstants) <= sizeof(CompressionConstants), "");
+
+static PrefilteredMapConstants prefilteredMapConstants[prefilteredMapLevelCount];
+
+static constexpr uint32_t mipTileSize = 64; // level 0 texels per work group side
+
+static MipDevice mipDevice = MipDevice::Cpu;
+static MipFilter mipFilter = MipFilter::Box;
+static uint32_t supercompressionLevel = 0;
+static uint32_t gpuNormalizationMinTexelCount = 4096 * 4096;
+
+static constexpr uint32_t imageImportVersion = 2; // bump when the import output changes in a way the settings hash does not catch
 
 static constexpr float defaultCompressionQuality = 0.1f;
+#ifndef NATIVE_BLOCK_COMPRESSION
 static void *optionsBC5;
 static void *optionsBC6;
 static void *optionsBC7;
+#endif // !NATIVE_BLOCK_COMPRESSION
 
 static inline void findMaxWorkGroupSize2d()
 {
@@ -75,52 +140,182 @@ static inline uint32_t findBestWorkGroupCount2d(uint32_t workSize)
     return (workSize + workGroupSize - 1) / workGroupSize;
 }
 
+static inline MipDevice getMipDevice() // without a device the mips are made on the CPU
+{
+    return device ? mipDevice : MipDevice::Cpu;
+}
+
 static inline uint8_t calcMipLevelCount(uint16_t width, uint16_t height)
 {
     return (uint8_t)(log2f((float)max(width, height))) + 1;
 }
 
-void initImageUtils(const char *computeSkyboxShaderPath, const char *computeBrdfLutShaderPath, const char *computeIrradianceMapShaderPath, const char *computePrefilteredMapShaderPath, const char *normalizeNormalMapShaderPath)
+static float radicalInverseVdC(uint32_t bits)
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return (float)bits * 2.3283064365386963e-10f; // / 0x100000000
+}
+
+// the GGX samples of computePrefilteredMap.comp, V == N makes them the same for every texel,
+// so they are stored once per level in tangent space, as vec4(L, skybox lod)
+static void createPrefilteredMapSamples()
+{
+    const float pi = 3.14159265359f;
+    const float omegaTexel = 4.f * pi / (6.f * skyboxFaceSize * skyboxFaceSize);
+    const float mipBias = 1.f;
+    float *samples = (float *)stagingBufferMappedData;
+    uint32_t sampleCount = 0;
+
+    for (uint32_t level = 0; level < prefilteredMapLevelCount; level++)
+    {
+        float roughness = (float)level / (prefilteredMapLevelCount - 1);
+        float a2 = roughness * roughness * roughness * roughness;
+        uint32_t levelSampleCount = prefilteredMapSampleCounts[level];
+        prefilteredMapConstants[level].level = level;
+        prefilteredMapConstants[level].firstSample = sampleCount;
+
+        for (uint32_t i = 0; i < levelSampleCount; i++)
+        {
+            float u = (float)i / levelSampleCount;
+            float cosTheta2 = (1.f - u) / (1.f + (a2 - 1.f) * u);
+            float cosTheta = sqrtf(cosTheta2);
+            float sinTheta = sqrtf(1.f - cosTheta2);
+            float phi = 2.f * pi * radicalInverseVdC(i);
+            // L = reflect(-N, H)
+            float *sample = samples + sampleCount * 4;
+            sample[0] = 2.f * cosTheta * sinTheta * cosf(phi);
+            sample[1] = 2.f * cosTheta * sinTheta * sinf(phi);
+            sample[2] = 2.f * cosTheta2 - 1.f;
+            sample[3] = 0.f;
+
+            if (sample[2] <= 0.f) // NdotL, no weight
+                continue;
+
+            if (roughness > 0.f)
+            {
+                // skip the NdotH and HdotV terms in the PDF because they cancel out
+                float k = 1.f + cosTheta2 * (a2 - 1.f);
+                float distribution = a2 / (pi * k * k);
+                float omegaSample = 4.f / (distribution * levelSampleCount);
+                sample[3] = fmaxf(0.5f * log2f(omegaSample / omegaTexel), 0.f) + mipBias;
+            }
+
+            sampleCount++;
+        }
+
+        prefilteredMapConstants[level].sampleCount = sampleCount - prefilteredMapConstants[level].firstSample;
+    }
+
+    uint32_t samplesSize = sampleCount * sizeof(float[4]);
+    prefilteredMapSampleBuffer = createGpuBuffer(samplesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    setGpuBufferName(prefilteredMapSampleBuffer, NAMEOF(prefilteredMapSampleBuffer));
+    VkBufferCopy copyRegion { 0, 0, samplesSize };
+    copyStagingBufferToBuffer(prefilteredMapSampleBuffer, &copyRegion, 1);
+}
+
+void initCpuImageUtils()
+{
+    initMipGeneration();
+    initHdrDecoding();
+
+#ifdef NATIVE_BLOCK_COMPRESSION
+    initBlockCompression(defaultCompressionQuality);
+#else
+    CreateOptionsBC5(&optionsBC5);
+    SetQualityBC5(optionsBC5, defaultCompressionQuality);
+    CreateOptionsBC6(&optionsBC6);
+    SetQualityBC6(optionsBC6, defaultCompressionQuality);
+    CreateOptionsBC7(&optionsBC7);
+    SetQualityBC7(optionsBC7, defaultCompressionQuality);
+#endif // NATIVE_BLOCK_COMPRESSION
+}
+
+void terminateCpuImageUtils()
+{
+#ifndef NATIVE_BLOCK_COMPRESSION
+    DestroyOptionsBC5(optionsBC5);
+    DestroyOptionsBC6(optionsBC6);
+    DestroyOptionsBC7(optionsBC7);
+#endif // !NATIVE_BLOCK_COMPRESSION
+}
+
+void initImageUtils(const char *computeSkyboxShaderPath, const char *computeBrdfLutShaderPath, const char *computeIrradianceShShaderPath, const char *computePrefilteredMapShaderPath, const char *normalizeNormalMapShaderPath,
+    const char *compressBC5ShaderPath, const char *compressBC6ShaderPath, const char *compressBC7ShaderPath, const char *generateMipsRgba8ShaderPath, const char *generateMipsRgba16fShaderPath)
 {
     ASSERT(isValidString(computeSkyboxShaderPath));
     ASSERT(isValidString(computeBrdfLutShaderPath));
-    ASSERT(isValidString(computeIrradianceMapShaderPath));
+    ASSERT(isValidString(computeIrradianceShShaderPath));
     ASSERT(isValidString(computePrefilteredMapShaderPath));
     ASSERT(isValidString(normalizeNormalMapShaderPath));
+    ASSERT(isValidString(compressBC5ShaderPath));
+    ASSERT(isValidString(compressBC6ShaderPath));
+    ASSERT(isValidString(compressBC7ShaderPath));
+    ASSERT(isValidString(generateMipsRgba8ShaderPath));
+    ASSERT(isValidString(generateMipsRgba16fShaderPath));
     ASSERT(calcMipLevelCount(prefilteredMapFaceSize, prefilteredMapFaceSize) >= prefilteredMapLevelCount);
 
+    initCpuImageUtils();
     findMaxWorkGroupSize2d();
 
     VkSamplerCreateInfo samplerCreateInfo = initSamplerCreateInfo(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT);
     vkVerify(vkCreateSampler(device, &samplerCreateInfo, nullptr, &linearClampSampler));
 
+    mipCounterBuffer = createGpuBuffer(MAX_MIP_BATCH_SIZE * 6 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    setGpuBufferName(mipCounterBuffer, NAMEOF(mipCounterBuffer));
+    createPrefilteredMapSamples();
+
     // one set to rule them all
     VkDescriptorSetLayoutBinding setBindings[]
     {
         {0, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // hdri equirect
-        {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // skybox write | brdf lut | normal map
+        {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // skybox write | brdf lut
         {2, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // skybox read
-        {3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // irradiance
+        {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // irradiance sh
         {4, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, prefilteredMapLevelCount, VK_SHADER_STAGE_COMPUTE_BIT}, // prefiltered normalMapImage array
-        {5, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &linearClampSampler}
+        {5, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, &linearClampSampler},
+        {6, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // compression source, all levels and faces
+        {7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // compressed blocks
+        {8, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_MIP_BATCH_SIZE * MAX_MIP_LEVEL_COUNT, VK_SHADER_STAGE_COMPUTE_BIT}, // mip levels of a batch of images
+        {9, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // mip counters
+        {10, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_NORMAL_MAP_BATCH_SIZE, VK_SHADER_STAGE_COMPUTE_BIT}, // normal maps
+        {11, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT} // prefiltered map samples
     };
     VkDescriptorBindingFlags bindingFlags[countOf(setBindings)] {};
     bindingFlags[3] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    bindingFlags[8] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    bindingFlags[10] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
     VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo = initDescriptorSetLayoutBindingFlagsCreateInfo(bindingFlags, countOf(bindingFlags));
     VkDescriptorSetLayoutCreateInfo setLayoutCreateInfo = initDescriptorSetLayoutCreateInfo(setBindings, countOf(setBindings), &flagsInfo);
     vkVerify(vkCreateDescriptorSetLayout(device, &setLayoutCreateInfo, nullptr, &commonDescriptorSetLayout));
     VkDescriptorSetAllocateInfo setAllocateInfo = initDescriptorSetAllocateInfo(descriptorPool, &commonDescriptorSetLayout, 1);
     vkVerify(vkAllocateDescriptorSets(device, &setAllocateInfo, &commonDescriptorSet));
+    VkDescriptorSetLayout envMapSetLayouts[] { commonDescriptorSetLayout, commonDescriptorSetLayout };
+    static_assert(countOf(envMapSetLayouts) == countOf(envMapDescriptorSets), "");
+    setAllocateInfo = initDescriptorSetAllocateInfo(descriptorPool, envMapSetLayouts, countOf(envMapSetLayouts));
+    vkVerify(vkAllocateDescriptorSets(device, &setAllocateInfo, envMapDescriptorSets));
+    vkVerify(vkAllocateDescriptorSets(device, &setAllocateInfo, envMapCompressionDescriptorSets));
+
+    VkDescriptorBufferInfo samplesBufferInfo { prefilteredMapSampleBuffer.buffer, 0, VK_WHOLE_SIZE };
+    VkWriteDescriptorSet samplesWrites[]
+    {
+        initWriteDescriptorSetBuffer(commonDescriptorSet, 11, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &samplesBufferInfo),
+        initWriteDescriptorSetBuffer(envMapDescriptorSets[0], 11, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &samplesBufferInfo),
+        initWriteDescriptorSetBuffer(envMapDescriptorSets[1], 11, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &samplesBufferInfo)
+    };
+    vkUpdateDescriptorSets(device, countOf(samplesWrites), samplesWrites, 0, nullptr);
 
     VkPushConstantRange range {};
     range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-    range.size = sizeof(uint32_t);
+    range.size = sizeof(CompressionConstants); // the largest push constant block
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = initPipelineLayoutCreateInfo(&commonDescriptorSetLayout, 1, &range, 1);
     vkVerify(vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &commonPipelineLayout));
 
     uint32_t computeSkyboxWorkGroupSize = findBestWorkGroupSize2d(skyboxFaceSize);
     uint32_t computeBrdfLutWorkGroupSize = findBestWorkGroupSize2d(brdfLutSize);
-    uint32_t computeIrradianceMapWorkGroupSize = findBestWorkGroupSize2d(irradianceMapFaceSize);
     uint32_t computePrefilteredMapWorkGroupSize = findBestWorkGroupSize2d(prefilteredMapFaceSize);
 
     VkSpecializationMapEntry specEntry { 0, 0, sizeof(uint32_t) };
@@ -128,25 +323,35 @@ void initImageUtils(const char *computeSkyboxShaderPath, const char *computeBrdf
     {
         { 1, &specEntry, sizeof(uint32_t), &computeSkyboxWorkGroupSize },
         { 1, &specEntry, sizeof(uint32_t), &computeBrdfLutWorkGroupSize },
-        { 1, &specEntry, sizeof(uint32_t), &computeIrradianceMapWorkGroupSize },
         { 1, &specEntry, sizeof(uint32_t), &computePrefilteredMapWorkGroupSize },
         { 1, &specEntry, sizeof(uint32_t), &maxWorkGroupSize2d },
+        { 1, &specEntry, sizeof(uint32_t), &compressionWorkGroupSize },
     };
     VkShaderModule shaderModules[]
     {
         createShaderModuleFromSpv(device, computeSkyboxShaderPath),
         createShaderModuleFromSpv(device, computeBrdfLutShaderPath),
-        createShaderModuleFromSpv(device, computeIrradianceMapShaderPath),
+        createShaderModuleFromSpv(device, computeIrradianceShShaderPath),
         createShaderModuleFromSpv(device, computePrefilteredMapShaderPath),
-        createShaderModuleFromSpv(device, normalizeNormalMapShaderPath)
+        createShaderModuleFromSpv(device, normalizeNormalMapShaderPath),
+        createShaderModuleFromSpv(device, compressBC5ShaderPath),
+        createShaderModuleFromSpv(device, compressBC6ShaderPath),
+        createShaderModuleFromSpv(device, compressBC7ShaderPath),
+        createShaderModuleFromSpv(device, generateMipsRgba8ShaderPath),
+        createShaderModuleFromSpv(device, generateMipsRgba16fShaderPath)
     };
     VkPipelineShaderStageCreateInfo shaderStageCreateInfos[]
     {
         initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[0], &specInfos[0]),
         initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[1], &specInfos[1]),
-        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[2], &specInfos[2]),
-        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[3], &specInfos[3]),
-        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[4], &specInfos[4])
+        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[2]),
+        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[3], &specInfos[2]),
+        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[4], &specInfos[3]),
+        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[5], &specInfos[4]),
+        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[6], &specInfos[4]),
+        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[7], &specInfos[4]),
+        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[8]),
+        initPipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, shaderModules[9])
     };
     VkComputePipelineCreateInfo computePipelineCreateInfos[]
     {
@@ -154,27 +359,30 @@ void initImageUtils(const char *computeSkyboxShaderPath, const char *computeBrdf
         initComputePipelineCreateInfo(shaderStageCreateInfos[1], commonPipelineLayout),
         initComputePipelineCreateInfo(shaderStageCreateInfos[2], commonPipelineLayout),
         initComputePipelineCreateInfo(shaderStageCreateInfos[3], commonPipelineLayout),
-        initComputePipelineCreateInfo(shaderStageCreateInfos[4], commonPipelineLayout)
+        initComputePipelineCreateInfo(shaderStageCreateInfos[4], commonPipelineLayout),
+        initComputePipelineCreateInfo(shaderStageCreateInfos[5], commonPipelineLayout),
+        initComputePipelineCreateInfo(shaderStageCreateInfos[6], commonPipelineLayout),
+        initComputePipelineCreateInfo(shaderStageCreateInfos[7], commonPipelineLayout),
+        initComputePipelineCreateInfo(shaderStageCreateInfos[8], commonPipelineLayout),
+        initComputePipelineCreateInfo(shaderStageCreateInfos[9], commonPipelineLayout)
     };
     VkPipeline pipelines[countOf(computePipelineCreateInfos)];
     vkVerify(vkCreateComputePipelines(device, nullptr, countOf(computePipelineCreateInfos), computePipelineCreateInfos, nullptr, pipelines));
     computeSkyboxPipeline = pipelines[0];
     computeBrdfLutPipeline = pipelines[1];
-    computeIrradianceMapPipeline = pipelines[2];
+    computeIrradianceShPipeline = pipelines[2];
     computePrefilteredMapPipeline = pipelines[3];
     normalizeNormalMapPipeline = pipelines[4];
+    compressBC5Pipeline = pipelines[5];
+    compressBC6Pipeline = pipelines[6];
+    compressBC7Pipeline = pipelines[7];
+    generateMipsRgba8Pipeline = pipelines[8];
+    generateMipsRgba16fPipeline = pipelines[9];
 
     for (uint8_t i = 0; i < countOf(shaderModules); i++)
     {
         vkDestroyShaderModule(device, shaderModules[i], nullptr);
     }
-
-    CreateOptionsBC5(&optionsBC5);
-    SetQualityBC5(optionsBC5, defaultCompressionQuality);
-    CreateOptionsBC6(&optionsBC6);
-    SetQualityBC6(optionsBC6, defaultCompressionQuality);
-    CreateOptionsBC7(&optionsBC7);
-    SetQualityBC7(optionsBC7, defaultCompressionQuality);
 }
 
 void terminateImageUtils()
@@ -184,18 +392,80 @@ void terminateImageUtils()
     vkDestroyPipelineLayout(device, commonPipelineLayout, nullptr);
     vkDestroyPipeline(device, computeSkyboxPipeline, nullptr);
     vkDestroyPipeline(device, computeBrdfLutPipeline, nullptr);
-    vkDestroyPipeline(device, computeIrradianceMapPipeline, nullptr);
+    vkDestroyPipeline(device, computeIrradianceShPipeline, nullptr);
     vkDestroyPipeline(device, computePrefilteredMapPipeline, nullptr);
     vkDestroyPipeline(device, normalizeNormalMapPipeline, nullptr);
+    vkDestroyPipeline(device, compressBC5Pipeline, nullptr);
+    vkDestroyPipeline(device, compressBC6Pipeline, nullptr);
+    vkDestroyPipeline(device, compressBC7Pipeline, nullptr);
+    vkDestroyPipeline(device, generateMipsRgba8Pipeline, nullptr);
+    vkDestroyPipeline(device, generateMipsRgba16fPipeline, nullptr);
+    destroyGpuBuffer(mipCounterBuffer);
+    destroyGpuBuffer(prefilteredMapSampleBuffer);
+    terminateCpuImageUtils();
+}
 
-    DestroyOptionsBC5(optionsBC5);
-    DestroyOptionsBC5(optionsBC6);
-    DestroyOptionsBC5(optionsBC7);
+void setCompressionDevice(ImagePurpose purpose, CompressionDevice compressionDevice)
+{
+    ASSERT(purpose != ImagePurpose::Undefined && (uint8_t)purpose < countOf(compressionDevices));
+    compressionDevices[(uint8_t)purpose] = compressionDevice;
+}
+
+void setMipGeneration(MipDevice device, MipFilter filter)
+{
+    mipDevice = device;
+    mipFilter = filter;
+}
+
+void setSupercompressionLevel(uint32_t zstdLevel)
+{
+    ASSERT(zstdLevel <= 22);
+    supercompressionLevel = zstdLevel;
+}
+
+void setGpuNormalizationThreshold(uint32_t minTexelCount)
+{
+    gpuNormalizationMinTexelCount = minTexelCount;
+}
+
+uint64_t hashImageImportSettings(ImagePurpose purpose, uint64_t seed)
+{
+    ASSERT(purpose != ImagePurpose::Undefined && (uint8_t)purpose < countOf(compressionDevices));
+    uint64_t hash = hashValue(imageImportVersion, seed);
+    hash = hashValue(purpose, hash);
+    hash = hashValue(getMipDevice(), hash);
+    hash = hashValue(mipFilter, hash);
+    hash = hashValue(supercompressionLevel, hash);
+#ifdef ENABLE_COMPRESSION
+    hash = hashValue(compressionDevices[(uint8_t)purpose], hash);
+    hash = hashValue(defaultCompressionQuality, hash);
+#ifdef NATIVE_BLOCK_COMPRESSION
+    hash = hashValue("native", hash);
+#endif // NATIVE_BLOCK_COMPRESSION
+#endif // ENABLE_COMPRESSION
+#ifdef MIPS_BLIT
+    hash = hashValue("blit", hash);
+#endif // MIPS_BLIT
+
+    if (purpose == ImagePurpose::HDRI)
+    {
+        hash = hashValue(skyboxFaceSize, hash);
+        hash = hashValue(brdfLutSize, hash);
+        hash = hashValue(prefilteredMapFaceSize, hash);
+        hash = hashValue(prefilteredMapLevelCount, hash);
+        hash = hashValue(prefilteredMapSampleCounts, hash);
+    }
+    else if (purpose == ImagePurpose::Normal)
+    {
+        hash = hashValue(gpuNormalizationMinTexelCount, hash);
+    }
+
+    return hash;
 }
 
-static void normalizeNormalMap(Image &image);
+static void normalizeNormalMaps(Image *images, uint32_t imageCount);
 
-static Image importImage(const uint8_t *data, uint32_t dataSize, ImagePurpose purpose)
+static Image decodeImage(const uint8_t *data, uint32_t dataSize, ImagePurpose purpose)
 {
     ZoneScoped;
     ASSERT(data);
@@ -217,13 +487,7 @@ static Image importImage(const uint8_t *data, uint32_t dataSize, ImagePurpose pu
         image.dataSize = w * h * STBI_rgb_alpha;
         image.format = VK_FORMAT_R8G8B8A8_UNORM;
         break;
-    case ImagePurpose::HDRI:
-        ASSERT(stbi_is_hdr_from_memory((const uint8_t *)data, dataSize));
-        image.data = (uint8_t *)stbi_loadf_from_memory((const uint8_t *)data, dataSize, &w, &h, nullptr, STBI_rgb_alpha);
-        image.dataSize = w * h * STBI_rgb_alpha * sizeof(float);
-        image.format = VK_FORMAT_R32G32B32A32_SFLOAT;
-        break;
-    default:
+    default: // HDRIs are streamed by computeEnvMaps
         ASSERT(false);
         break;
     }
@@ -235,23 +499,10 @@ static Image importImage(const uint8_t *data, uint32_t dataSize, ImagePurpose pu
     image.faceCount = 1;
     image.levelCount = 1;
 
-    if (image.purpose == ImagePurpose::Normal)
-        normalizeNormalMap(image);
-
     return image;
 }
 
-void importImage(const uint8_t *data, uint32_t dataSize, ImagePurpose purpose, const char *outImageFilename)
-{
-    ZoneScoped;
-    ASSERT(isValidString(outImageFilename));
-    ZoneText(outImageFilename, strlen(outImageFilename));
-    Image image = importImage(data, dataSize, purpose);
-    writeImage(image, outImageFilename, GenerateMips::Yes, Compress::Yes);
-    destroyImage(image);
-}
-
-static Image importImage(const char *inImageFilename, ImagePurpose purpose)
+static Image decodeImage(const char *inImageFilename, ImagePurpose purpose)
 {
     ZoneScoped;
     ASSERT(isValidString(inImageFilename));
@@ -259,21 +510,21 @@ static Image importImage(const char *inImageFilename, ImagePurpose purpose)
     uint32_t dataSize = readFile(inImageFilename, nullptr, 0);
     uint8_t *data = new uint8_t[dataSize];
     readFile(inImageFilename, data, dataSize);
-    Image image = importImage(data, dataSize, purpose);
+    Image image = decodeImage(data, dataSize, purpose);
     delete[] data;
     return image;
 }
 
+void importImage(const uint8_t *data, uint32_t dataSize, ImagePurpose purpose, const char *outImageFilename)
+{
+    ImageImportInfo info { data, dataSize, nullptr, outImageFilename, purpose };
+    importImages(&info, 1);
+}
+
 void importImage(const char *inImageFilename, const char *outImageFilename, ImagePurpose purpose)
 {
-    ZoneScoped;
-    ASSERT(isValidString(inImageFilename));
-    ASSERT(isValidString(outImageFilename));
-    ZoneText(inImageFilename, strlen(inImageFilename));
-    ZoneText(outImageFilename, strlen(outImageFilename));
-    Image image = importImage(inImageFilename, purpose);
-    writeImage(image, outImageFilename, GenerateMips::Yes, Compress::Yes);
-    destroyImage(image);
+    ImageImportInfo info { nullptr, 0, inImageFilename, outImageFilename, purpose };
+    importImages(&info, 1);
 }
 
 static uint8_t getTexelSize(const Image &image)
@@ -328,6 +579,16 @@ static uint32_t calcImagaDataSize(const Image &image)
     return dataSize * image.faceCount * getTexelSize(image);
 }
 
+// image describes the layout of the data in buffer, which is destroyed afterwards
+static void readBackBuffer(GpuBuffer &buffer, Image &image)
+{
+    VkBufferCopy copyRegion { 0, 0, image.dataSize };
+    copyBufferToStagingBuffer(buffer, &copyRegion, 1);
+    image.data = new uint8_t[image.dataSize];
+    memcpy(image.data, stagingBufferMappedData, image.dataSize);
+    destroyGpuBuffer(buffer);
+}
+
 #ifdef ENABLE_COMPRESSION
 struct CompressBlockRowOptions
 {
@@ -335,6 +596,7 @@ struct CompressBlockRowOptions
     uint16_t mipHeight;
     uint16_t rowStride;
     uint16_t blockCountX;
+    uint16_t blockCountY;
     uint8_t *src;
     uint8_t *dst;
 };
@@ -342,33 +604,52 @@ struct CompressBlockRowOptions
 static constexpr uint8_t srcBlockSizeInTexels = 4;
 static constexpr uint8_t dstBlockSizeInBytes = 16;
 static constexpr uint8_t channelCount = 4; // always RGBA textures
+static constexpr uint16_t tileSizeInBlocks = 64; // 256x256 texels, so that every job costs about the same
+static constexpr uint32_t tileBlockCount = tileSizeInBlocks * tileSizeInBlocks;
 
-static void compressBlockRowBC7(int64_t blockRowIndex, void *userData)
+#ifndef NATIVE_BLOCK_COMPRESSION
+// Compressonator behind the interface of the native encoder
+static inline void compressBlockBC5(const uint8_t *red, uint32_t redStride, const uint8_t *green, uint32_t greenStride, uint8_t *dst)
 {
-    ZoneScoped;
-    ASSERT(userData);
-    CompressBlockRowOptions &opt = *(CompressBlockRowOptions *)userData;
-    uint8_t *srcBlock = opt.src + blockRowIndex * opt.rowStride * srcBlockSizeInTexels;
-    uint8_t *dstBlock = opt.dst + blockRowIndex * opt.blockCountX * dstBlockSizeInBytes;
+    CompressBlockBC5(red, redStride, green, greenStride, dst, optionsBC5);
+}
+
+static inline void compressBlockBC6(const uint16_t *rgb, uint32_t stride, uint8_t *dst)
+{
+    CompressBlockBC6(rgb, stride, dst, optionsBC6);
+}
+
+static inline void compressBlockBC7(const uint8_t *rgba, uint32_t stride, uint8_t *dst)
+{
+    CompressBlockBC7(rgba, stride, dst, optionsBC7);
+}
+#endif // !NATIVE_BLOCK_COMPRESSION
+
+// compresses blockCount blocks of the block row blockY, starting from the block blockX
+typedef void (*CompressBlocksFunc)(const CompressBlockRowOptions &opt, uint32_t blockY, uint32_t blockX, uint32_t blockCount);
+
+// compresses the single block of a mip that is smaller than a block
+typedef void (*CompressDegenerateBlockFunc)(const CompressBlockRowOptions &opt);
+
+static void compressBlocksBC7(const CompressBlockRowOptions &opt, uint32_t blockY, uint32_t blockX, uint32_t blockCount)
+{
+    const uint8_t *srcBlock = opt.src + blockY * opt.rowStride * srcBlockSizeInTexels + blockX * srcBlockSizeInTexels * channelCount;
+    uint8_t *dstBlock = opt.dst + (blockY * opt.blockCountX + blockX) * dstBlockSizeInBytes;
 
-    for (uint32_t x = 0; x < opt.blockCountX; x++)
+    for (uint32_t x = 0; x < blockCount; x++)
     {
-        CompressBlockBC7(srcBlock, opt.rowStride, dstBlock, optionsBC7);
+        compressBlockBC7(srcBlock, opt.rowStride, dstBlock);
         srcBlock += srcBlockSizeInTexels * channelCount;
         dstBlock += dstBlockSizeInBytes;
     }
 }
 
-static void compressDegenerateBlockBC7(int64_t blockRowIndex, void *userData)
+static void compressDegenerateBlockBC7(const CompressBlockRowOptions &opt)
 {
-    ZoneScoped;
-    ASSERT(userData);
-    CompressBlockRowOptions &opt = *(CompressBlockRowOptions *)userData;
-    uint8_t *srcBlock = opt.src + blockRowIndex * opt.rowStride * srcBlockSizeInTexels;
-    uint8_t *dstBlock = opt.dst + blockRowIndex * opt.blockCountX * dstBlockSizeInBytes;
+    const uint8_t *srcBlock = opt.src;
     uint8_t rgba[16][4];
     ASSERT(opt.mipWidth == opt.mipHeight && opt.mipWidth < 4 && isPowerOf2(opt.mipWidth));
-    ASSERT(opt.blockCountX == 1 && blockRowIndex == 0);
+    ASSERT(opt.blockCountX == 1 && opt.blockCountY == 1);
 
     for (uint8_t i = 0; i < 16; i++) // copy the first texel to all temp 16 texels
     {
@@ -382,19 +663,16 @@ static void compressDegenerateBlockBC7(int64_t blockRowIndex, void *userData)
         memcpy(rgba[5], srcBlock + 3 * channelCount, channelCount);
     }
 
-    CompressBlockBC7(rgba[0], 4, dstBlock, optionsBC7);
+    compressBlockBC7(rgba[0], 4 * channelCount, opt.dst);
 }
 
-static void compressBlockRowBC5(int64_t blockRowIndex, void *userData)
+static void compressBlocksBC5(const CompressBlockRowOptions &opt, uint32_t blockY, uint32_t blockX, uint32_t blockCount)
 {
-    ZoneScoped;
-    ASSERT(userData);
-    CompressBlockRowOptions &opt = *(CompressBlockRowOptions *)userData;
-    const uint8_t *srcBlock = opt.src + blockRowIndex * opt.rowStride * srcBlockSizeInTexels;
-    uint8_t *dstBlock = opt.dst + blockRowIndex * opt.blockCountX * dstBlockSizeInBytes;
+    const uint8_t *srcBlock = opt.src + blockY * opt.rowStride * srcBlockSizeInTexels + blockX * srcBlockSizeInTexels * channelCount;
+    uint8_t *dstBlock = opt.dst + (blockY * opt.blockCountX + blockX) * dstBlockSizeInBytes;
     uint8_t red[16], green[16]; // deinterleave red and green channels
 
-    for (uint32_t x = 0; x < opt.blockCountX; x++)
+    for (uint32_t x = 0; x < blockCount; x++)
     {
         const uint8_t *srcRow = srcBlock;
         for (uint8_t i = 0; i < 4; i++, srcRow += opt.rowStride)
@@ -408,22 +686,18 @@ static void compressBlockRowBC5(int64_t blockRowIndex, void *userData)
             }
         }
 
-        CompressBlockBC5(red, 4, green, 4, dstBlock, optionsBC5);
+        compressBlockBC5(red, 4, green, 4, dstBlock);
         srcBlock += srcBlockSizeInTexels * channelCount;
         dstBlock += dstBlockSizeInBytes;
     }
 }
 
-static void compressDegenerateBlockBC5(int64_t blockRowIndex, void *userData)
+static void compressDegenerateBlockBC5(const CompressBlockRowOptions &opt)
 {
-    ZoneScoped;
-    ASSERT(userData);
-    CompressBlockRowOptions &opt = *(CompressBlockRowOptions *)userData;
-    const uint8_t *srcBlock = opt.src + blockRowIndex * opt.rowStride * srcBlockSizeInTexels;
-    uint8_t *dstBlock = opt.dst + blockRowIndex * opt.blockCountX * dstBlockSizeInBytes;
+    const uint8_t *srcBlock = opt.src;
     uint8_t red[16], green[16]; // deinterleave red and green channels
     ASSERT(opt.mipWidth == opt.mipHeight && opt.mipWidth < 4 && isPowerOf2(opt.mipWidth));
-    ASSERT(opt.blockCountX == 1 && blockRowIndex == 0);
+    ASSERT(opt.blockCountX == 1 && opt.blockCountY == 1);
 
     for (uint8_t i = 0; i < 16; i++) // copy the first texel to all temp 16 texels
     {
@@ -441,19 +715,16 @@ static void compressDegenerateBlockBC5(int64_t blockRowIndex, void *userData)
         green[5] = (srcBlock + 3 * channelCount)[1];
     }
 
-    CompressBlockBC5(red, 4, green, 4, dstBlock, optionsBC5);
+    compressBlockBC5(red, 4, green, 4, opt.dst);
 }
 
-static void compressBlockRowBC6(int64_t blockRowIndex, void *userData)
+static void compressBlocksBC6(const CompressBlockRowOptions &opt, uint32_t blockY, uint32_t blockX, uint32_t blockCount)
 {
-    ZoneScoped;
-    ASSERT(userData);
-    CompressBlockRowOptions &opt = *(CompressBlockRowOptions *)userData;
-    const uint16_t *srcBlock = (const uint16_t *)opt.src + blockRowIndex * opt.rowStride * srcBlockSizeInTexels;
-    uint8_t *dstBlock = opt.dst + blockRowIndex * opt.blockCountX * dstBlockSizeInBytes;
+    const uint16_t *srcBlock = (const uint16_t *)opt.src + blockY * opt.rowStride * srcBlockSizeInTexels + blockX * srcBlockSizeInTexels * channelCount;
+    uint8_t *dstBlock = opt.dst + (blockY * opt.blockCountX + blockX) * dstBlockSizeInBytes;
     uint16_t rgb[16][3]; // copy red, green and blue channels
 
-    for (uint32_t x = 0; x < opt.blockCountX; x++)
+    for (uint32_t x = 0; x < blockCount; x++)
     {
         const uint16_t *srcRow = srcBlock;
         for (uint8_t i = 0; i < 4; i++, srcRow += opt.rowStride)
@@ -466,22 +737,18 @@ static void compressBlockRowBC6(int64_t blockRowIndex, void *userData)
             }
         }
 
-        CompressBlockBC6(rgb[0], 4 * 3, dstBlock, optionsBC6);
+        compressBlockBC6(rgb[0], 4 * 3, dstBlock);
         srcBlock += srcBlockSizeInTexels * channelCount;
         dstBlock += dstBlockSizeInBytes;
     }
 }
 
-static void compressDegenerateBlockBC6(int64_t blockRowIndex, void *userData)
+static void compressDegenerateBlockBC6(const CompressBlockRowOptions &opt)
 {
-    ZoneScoped;
-    ASSERT(userData);
-    CompressBlockRowOptions &opt = *(CompressBlockRowOptions *)userData;
-    const uint16_t *srcBlock = (const uint16_t *)opt.src + blockRowIndex * opt.rowStride * srcBlockSizeInTexels;
-    uint8_t *dstBlock = opt.dst + blockRowIndex * opt.blockCountX * dstBlockSizeInBytes;
+    const uint16_t *srcBlock = (const uint16_t *)opt.src;
     uint16_t rgb[16][3]; // copy red, green and blue channels
     ASSERT(opt.mipWidth == opt.mipHeight && opt.mipWidth < 4 && isPowerOf2(opt.mipWidth));
-    ASSERT(opt.blockCountX == 1 && blockRowIndex == 0);
+    ASSERT(opt.blockCountX == 1 && opt.blockCountY == 1);
 
     for (uint8_t i = 0; i < 16; i++) // copy the first texel to all temp 16 texels
     {
@@ -495,7 +762,60 @@ static void compressDegenerateBlockBC6(int64_t blockRowIndex, void *userData)
         memcpy(rgb[5], srcBlock + 3 * channelCount, 3 * sizeof(uint16_t));
     }
 
-    CompressBlockBC6(rgb[0], 4 * 3, dstBlock, optionsBC6);
+    compressBlockBC6(rgb[0], 4 * 3, opt.dst);
+}
+
+// either a rectangle of blocks of one level and face or several whole small levels and faces
+struct CompressTile
+{
+    uint16_t firstLevelFace;
+    uint16_t levelFaceCount;
+    uint16_t blockX;
+    uint16_t blockY;
+    uint16_t blockCountX; // 0 if the tile holds whole levels and faces
+    uint16_t blockCountY;
+};
+
+struct CompressImageContext
+{
+    const CompressBlockRowOptions *options;
+    const CompressTile *tiles;
+    CompressBlocksFunc compressBlocksFunc;
+    CompressDegenerateBlockFunc compressDegenerateBlockFunc;
+};
+
+static void compressTiles(uint32_t begin, uint32_t end, void *userData)
+{
+    ZoneScoped;
+    ASSERT(userData);
+    CompressImageContext &context = *(CompressImageContext *)userData;
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        const CompressTile &tile = context.tiles[i];
+
+        for (uint32_t j = tile.firstLevelFace; j < tile.firstLevelFace + tile.levelFaceCount; j++)
+        {
+            const CompressBlockRowOptions &opt = context.options[j];
+
+            if (opt.mipWidth < 4 || opt.mipHeight < 4) // separate function to avoid unnecessary branching in the general case
+            {
+                context.compressDegenerateBlockFunc(opt);
+                continue;
+            }
+
+            bool wholeLevelFace = tile.blockCountX == 0;
+            uint32_t blockX = wholeLevelFace ? 0 : tile.blockX;
+            uint32_t blockY = wholeLevelFace ? 0 : tile.blockY;
+            uint32_t blockCountX = wholeLevelFace ? opt.blockCountX : tile.blockCountX;
+            uint32_t blockCountY = wholeLevelFace ? opt.blockCountY : tile.blockCountY;
+
+            for (uint32_t y = blockY; y < blockY + blockCountY; y++)
+            {
+                context.compressBlocksFunc(opt, y, blockX, blockCountX);
+            }
+        }
+    }
 }
 
 static bool compressImage(const Image &image, Image &compressedImage)
@@ -503,8 +823,8 @@ static bool compressImage(const Image &image, Image &compressedImage)
     ZoneScoped;
     ASSERT(image.width % srcBlockSizeInTexels == 0 && image.height % srcBlockSizeInTexels == 0);
     VkFormat compressedFormat = VK_FORMAT_UNDEFINED;
-    JobFunc compressBlockRowJobFunc = nullptr;
-    JobFunc compressDegenerateBlockJobFunc = nullptr; // separate function to avoid unnecessary branching in the general case
+    CompressBlocksFunc compressBlocksFunc = nullptr;
+    CompressDegenerateBlockFunc compressDegenerateBlockFunc = nullptr;
 
     switch (image.purpose)
     {
@@ -515,8 +835,8 @@ static bool compressImage(const Image &image, Image &compressedImage)
 
         ASSERT(image.format == VK_FORMAT_R8G8B8A8_SRGB);
         compressedFormat = VK_FORMAT_BC7_SRGB_BLOCK;
-        compressBlockRowJobFunc = compressBlockRowBC7;
-        compressDegenerateBlockJobFunc = compressDegenerateBlockBC7;
+        compressBlocksFunc = compressBlocksBC7;
+        compressDegenerateBlockFunc = compressDegenerateBlockBC7;
         break;
     }
     case ImagePurpose::Shading:
@@ -526,8 +846,8 @@ static bool compressImage(const Image &image, Image &compressedImage)
 
         ASSERT(image.format == VK_FORMAT_R8G8B8A8_UNORM);
         compressedFormat = VK_FORMAT_BC7_UNORM_BLOCK;
-        compressBlockRowJobFunc = compressBlockRowBC7;
-        compressDegenerateBlockJobFunc = compressDegenerateBlockBC7;
+        compressBlocksFunc = compressBlocksBC7;
+        compressDegenerateBlockFunc = compressDegenerateBlockBC7;
         break;
     }
     case ImagePurpose::Normal:
@@ -537,8 +857,8 @@ static bool compressImage(const Image &image, Image &compressedImage)
 
         ASSERT(image.format == VK_FORMAT_R8G8B8A8_UNORM);
         compressedFormat = VK_FORMAT_BC5_UNORM_BLOCK;
-        compressBlockRowJobFunc = compressBlockRowBC5;
-        compressDegenerateBlockJobFunc = compressDegenerateBlockBC5;
+        compressBlocksFunc = compressBlocksBC5;
+        compressDegenerateBlockFunc = compressDegenerateBlockBC5;
         break;
     }
     case ImagePurpose::HDRI:
@@ -548,8 +868,8 @@ static bool compressImage(const Image &image, Image &compressedImage)
 
         ASSERT(image.format == VK_FORMAT_R16G16B16A16_SFLOAT);
         compressedFormat = VK_FORMAT_BC6H_UFLOAT_BLOCK;
-        compressBlockRowJobFunc = compressBlockRowBC6;
-        compressDegenerateBlockJobFunc = compressDegenerateBlockBC6;
+        compressBlocksFunc = compressBlocksBC6;
+        compressDegenerateBlockFunc = compressDegenerateBlockBC6;
         break;
     }
     default:
@@ -558,39 +878,24 @@ static bool compressImage(const Image &image, Image &compressedImage)
         return false;
     }
 
+    if (compressedFormat == VK_FORMAT_UNDEFINED) // already compressed
+    {
+        compressedImage = {};
+        return false;
+    }
+
     compressedImage = image;
     compressedImage.format = compressedFormat;
     compressedImage.dataSize = 0;
-    uint16_t jobCount = 0;
+    uint32_t levelFaceCount = image.levelCount * image.faceCount;
+    Token token = createToken(); // only holds the job data
+    CompressBlockRowOptions *options = (CompressBlockRowOptions *)allocateJobData(token, levelFaceCount * sizeof(CompressBlockRowOptions));
+
     uint16_t mipWidth = image.width;
     uint16_t mipHeight = image.height;
-
-    for (uint8_t i = 0; i < image.levelCount; i++)
-    {
-        uint16_t blockCountX = (uint16_t)aligned(mipWidth, srcBlockSizeInTexels) / srcBlockSizeInTexels;
-        uint16_t blockCountY = (uint16_t)aligned(mipHeight, srcBlockSizeInTexels) / srcBlockSizeInTexels;
-        compressedImage.dataSize += blockCountX * blockCountY * dstBlockSizeInBytes;
-        jobCount += blockCountY;
-
-        if (mipWidth > 1)
-            mipWidth >>= 1;
-        if (mipHeight > 1)
-            mipHeight >>= 1;
-    }
-
-    compressedImage.dataSize *= image.faceCount;
-    jobCount *= image.faceCount;
-
-    compressedImage.data = new uint8_t[compressedImage.dataSize];
-    JobInfo *jobInfos = new JobInfo[jobCount];
-    CompressBlockRowOptions *options = new CompressBlockRowOptions[image.levelCount * image.faceCount];
-
-    mipWidth = image.width;
-    mipHeight = image.height;
     uint8_t texelSize = getTexelSize(image);
-    uint16_t jobIndex = 0;
     uint32_t srcDataOffset = 0;
-    uint32_t dstDataOffset = 0;
+    uint32_t maxTileCount = 0;
 
     for (uint8_t i = 0; i < image.levelCount; i++)
     {
@@ -600,6 +905,12 @@ static bool compressImage(const Image &image, Image &compressedImage)
         uint32_t srcMipSize = mipWidth * mipHeight * texelSize;
         uint32_t dstMipSize = blockCountX * blockCountY * dstBlockSizeInBytes;
 
+        if (mipWidth < 4 || mipHeight < 4) // mip is smaller that the min block size
+        {
+            ASSERT(blockCountX == 1 && blockCountY == 1);
+            ASSERT(mipWidth == mipHeight && isPowerOf2(mipWidth)); // handle only 1x1 or 2x2 for now
+        }
+
         for (uint8_t j = 0; j < image.faceCount; j++)
         {
             uint8_t index = i * image.faceCount + j;
@@ -607,23 +918,12 @@ static bool compressImage(const Image &image, Image &compressedImage)
             options[index].mipHeight = mipHeight;
             options[index].rowStride = mipWidth * channelCount;
             options[index].blockCountX = blockCountX;
+            options[index].blockCountY = blockCountY;
             options[index].src = image.data + srcDataOffset;
-            options[index].dst = compressedImage.data + dstDataOffset;
+            options[index].dst = (uint8_t *)(uintptr_t)compressedImage.dataSize; // turned into a pointer once the data is allocated
             srcDataOffset += srcMipSize;
-            dstDataOffset += dstMipSize;
-
-            if (mipWidth < 4 || mipHeight < 4) // mip is smaller that the min block size
-            {
-                ASSERT(blockCountX == 1);
-                ASSERT(mipWidth == mipHeight && isPowerOf2(mipWidth)); // handle only 1x1 or 2x2 for now
-                jobInfos[jobIndex++] = { compressDegenerateBlockJobFunc, 0, &options[index] };
-                continue;
-            }
-
-            for (uint16_t y = 0; y < blockCountY; y++)
-            {
-                jobInfos[jobIndex++] = { compressBlockRowJobFunc, y, &options[index] };
-            }
+            compressedImage.dataSize += dstMipSize;
+            maxTileCount += ((blockCountX + tileSizeInBlocks - 1) / tileSizeInBlocks) * ((blockCountY + tileSizeInBlocks - 1) / tileSizeInBlocks);
         }
 
         if (mipWidth > 1)
@@ -632,70 +932,535 @@ static bool compressImage(const Image &image, Image &compressedImage)
             mipHeight >>= 1;
     }
 
-    Token token = createToken();
-    enqueueJobs(jobInfos, jobCount, token);
-    waitForToken(token);
-    destroyToken(token);
-
-    delete[] jobInfos;
-    delete[] options;
-
-    return true;
-}
-#endif // ENABLE_COMPRESSION
-
-uint32_t iterateImageLevelFaces(const Image &image, IterateCallback callback, void *userData)
-{
-    uint32_t dataOffset = 0;
-    uint16_t mipWidth = image.width;
-    uint16_t mipHeight = image.height;
-    uint8_t texelSize = getTexelSize(image);
+    compressedImage.data = new uint8_t[compressedImage.dataSize];
+    CompressTile *tiles = (CompressTile *)allocateJobData(token, maxTileCount * sizeof(CompressTile));
+    uint32_t tileCount = 0;
+    uint32_t batchBlockCount = 0; // of the last tile if it batches small levels and faces
 
-    for (uint8_t i = 0; i < image.levelCount; i++)
+    for (uint32_t i = 0; i < levelFaceCount; i++)
     {
-        uint32_t mipSize = mipWidth * mipHeight * texelSize;
+        CompressBlockRowOptions &opt = options[i];
+        opt.dst = compressedImage.data + (uintptr_t)opt.dst;
+        uint32_t blockCount = opt.blockCountX * opt.blockCountY;
 
-        if (texelSize == 1 && (mipWidth < 4 || mipHeight < 4)) // compressed
+        if (blockCount < tileBlockCount) // small and degenerate mips come last, so the batch holds consecutive levels and faces
         {
-            ASSERT(mipWidth == mipHeight && isPowerOf2(mipWidth));
-            mipSize = 16;
+            if (!batchBlockCount || batchBlockCount + blockCount > tileBlockCount)
+            {
+                tiles[tileCount++] = { (uint16_t)i, 0, 0, 0, 0, 0 };
+                batchBlockCount = 0;
+            }
+
+            tiles[tileCount - 1].levelFaceCount++;
+            batchBlockCount += blockCount;
+            continue;
         }
 
-        for (uint8_t j = 0; j < image.faceCount; j++, dataOffset += mipSize)
+        batchBlockCount = 0;
+
+        for (uint16_t y = 0; y < opt.blockCountY; y += tileSizeInBlocks)
         {
-            callback(image, i, j, mipWidth, mipHeight, dataOffset, mipSize, userData);
+            for (uint16_t x = 0; x < opt.blockCountX; x += tileSizeInBlocks)
+            {
+                tiles[tileCount++] = { (uint16_t)i, 1, x, y, (uint16_t)min(opt.blockCountX - x, tileSizeInBlocks), (uint16_t)min(opt.blockCountY - y, tileSizeInBlocks) };
+            }
         }
-
-        if (mipWidth > 1)
-            mipWidth >>= 1;
-        if (mipHeight > 1)
-            mipHeight >>= 1;
     }
 
-    return dataOffset;
-}
+    ASSERT(tileCount <= maxTileCount);
+    CompressImageContext context { options, tiles, compressBlocksFunc, compressDegenerateBlockFunc };
+    parallelFor(0, tileCount, 1, compressTiles, &context);
+    destroyToken(token);
 
-#ifndef MIPS_BLIT
-static void generateMipsCompute(GpuImage &gpuImage)
-{
-    static_assert(false, ""); // TODO
+    return true;
 }
-#endif // !MIPS_BLIT
 
-void createImageMips(Image &image)
+// encodes all levels and faces of an image owned by the compute queue, only the blocks are read back
+// fills the layout of compressedImage, not its data, and returns the encoder of purpose
+static VkPipeline initGpuCompressedImage(const GpuImage &gpuImage, ImagePurpose purpose, Image &compressedImage)
 {
-    ZoneScoped;
-    ASSERT(image.data && image.dataSize);
-    ASSERT(isPowerOf2(image.width) && isPowerOf2(image.height));
-    ASSERT(image.faceCount == 1 || image.faceCount == 6);
-    ASSERT(image.levelCount == 1);
-    ASSERT(image.format == VK_FORMAT_R8G8B8A8_SRGB ||
-        image.format == VK_FORMAT_R8G8B8A8_UNORM ||
-        image.format == VK_FORMAT_R16G16B16A16_SFLOAT);
+    ASSERT(gpuImage.extent.width % srcBlockSizeInTexels == 0 && gpuImage.extent.height % srcBlockSizeInTexels == 0);
+    VkFormat compressedFormat = VK_FORMAT_UNDEFINED;
+    VkPipeline compressPipeline = nullptr;
 
-    image.levelCount = calcMipLevelCount(image.width, image.height);
+    switch (purpose)
+    {
+    case ImagePurpose::Color:
+        ASSERT(gpuImage.format == VK_FORMAT_R8G8B8A8_SRGB);
+        compressedFormat = VK_FORMAT_BC7_SRGB_BLOCK;
+        compressPipeline = compressBC7Pipeline;
+        break;
+    case ImagePurpose::Shading:
+        ASSERT(gpuImage.format == VK_FORMAT_R8G8B8A8_UNORM);
+        compressedFormat = VK_FORMAT_BC7_UNORM_BLOCK;
+        compressPipeline = compressBC7Pipeline;
+        break;
+    case ImagePurpose::Normal:
+        ASSERT(gpuImage.format == VK_FORMAT_R8G8B8A8_UNORM);
+        compressedFormat = VK_FORMAT_BC5_UNORM_BLOCK;
+        compressPipeline = compressBC5Pipeline;
+        break;
+    case ImagePurpose::HDRI:
+        ASSERT(gpuImage.format == VK_FORMAT_R16G16B16A16_SFLOAT);
+        compressedFormat = VK_FORMAT_BC6H_UFLOAT_BLOCK;
+        compressPipeline = compressBC6Pipeline;
+        break;
+    default:
+        ASSERT(false);
+        compressedImage = {};
+        return nullptr;
+    }
 
-    VkImageUsageFlags usageFlags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    compressedImage = {};
+    compressedImage.width = (uint16_t)gpuImage.extent.width;
+    compressedImage.height = (uint16_t)gpuImage.extent.height;
+    compressedImage.format = compressedFormat;
+    compressedImage.faceCount = gpuImage.layerCount;
+    compressedImage.levelCount = gpuImage.levelCount;
+    compressedImage.purpose = purpose;
+    compressedImage.dataSize = calcImagaDataSize(compressedImage);
+
+    return compressPipeline;
+}
+
+// a 2D array view covers both plain images and cubemaps
+static VkImageView createCompressionSourceView(const GpuImage &gpuImage)
+{
+    VkImageSubresourceRange range = initImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT, 0, gpuImage.levelCount, 0, gpuImage.layerCount);
+    VkImageViewCreateInfo imageViewCreateInfo = initImageViewCreateInfo(gpuImage.image, gpuImage.format, VK_IMAGE_VIEW_TYPE_2D_ARRAY, range);
+    VkImageView imageView;
+    vkVerify(vkCreateImageView(device, &imageViewCreateInfo, nullptr, &imageView));
+    return imageView;
+}
+
+// descriptorSet must neither be used by any pending submission nor be bound in a command buffer that is being recorded
+static void writeCompressionDescriptors(VkDescriptorSet descriptorSet, VkImageView imageView, VkImageLayout layout, const GpuBuffer &blockBuffer)
+{
+    ASSERT(layout == VK_IMAGE_LAYOUT_GENERAL || layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    VkDescriptorImageInfo imageInfo { nullptr, imageView, layout };
+    VkDescriptorBufferInfo bufferInfo { blockBuffer.buffer, 0, VK_WHOLE_SIZE };
+    VkWriteDescriptorSet writes[]
+    {
+        initWriteDescriptorSetImage(descriptorSet, 6, 1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &imageInfo),
+        initWriteDescriptorSetBuffer(descriptorSet, 7, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfo)
+    };
+    vkUpdateDescriptorSets(device, countOf(writes), writes, 0, nullptr);
+}
+
+// records the compression of every level and face of gpuImage into blockBuffer, both written into descriptorSet by writeCompressionDescriptors
+static void recordGpuImageCompression(Cmd cmd, const GpuImage &gpuImage, VkImageLayout layout, VkPipeline compressPipeline,
+    const Image &compressedImage, const GpuBuffer &blockBuffer, VkDescriptorSet descriptorSet)
+{
+    ScopedGpuZone(cmd, "Compress image");
+    ImageBarrier imageBarrier {};
+    imageBarrier.image = gpuImage;
+    imageBarrier.srcStageMask = StageFlags::ComputeShader;
+    imageBarrier.dstStageMask = StageFlags::ComputeShader;
+    imageBarrier.srcAccessMask = AccessFlags::Write;
+    imageBarrier.dstAccessMask = AccessFlags::Read;
+    imageBarrier.oldLayout = layout;
+    imageBarrier.newLayout = layout;
+    pipelineBarrier(cmd, nullptr, 0, &imageBarrier, 1);
+    vkCmdBindDescriptorSets(cmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, commonPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdBindPipeline(cmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, compressPipeline);
+
+    CompressionConstants constants {};
+    constants.srgb = gpuImage.format == VK_FORMAT_R8G8B8A8_SRGB;
+    uint16_t mipWidth = compressedImage.width;
+    uint16_t mipHeight = compressedImage.height;
+
+    for (uint8_t i = 0; i < compressedImage.levelCount; i++)
+    {
+        uint32_t blockCountX = aligned(mipWidth, srcBlockSizeInTexels) / srcBlockSizeInTexels;
+        uint32_t blockCountY = aligned(mipHeight, srcBlockSizeInTexels) / srcBlockSizeInTexels;
+        uint32_t blockCount = blockCountX * blockCountY * compressedImage.faceCount;
+        constants.level = i;
+        vkCmdPushConstants(cmd.commandBuffer, commonPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(cmd.commandBuffer, (blockCount + compressionWorkGroupSize - 1) / compressionWorkGroupSize, 1, 1);
+        constants.firstBlock += blockCount;
+
+        if (mipWidth > 1)
+            mipWidth >>= 1;
+        if (mipHeight > 1)
+            mipHeight >>= 1;
+    }
+
+    ASSERT(constants.firstBlock * dstBlockSizeInBytes == compressedImage.dataSize);
+    BufferBarrier bufferBarrier {};
+    bufferBarrier.buffer = blockBuffer;
+    bufferBarrier.srcStageMask = StageFlags::ComputeShader;
+    bufferBarrier.dstStageMask = StageFlags::Copy;
+    bufferBarrier.srcAccessMask = AccessFlags::Write;
+    bufferBarrier.dstAccessMask = AccessFlags::Read;
+    pipelineBarrier(cmd, &bufferBarrier, 1, nullptr, 0);
+}
+
+static bool compressGpuImage(const GpuImage &gpuImage, VkImageLayout layout, ImagePurpose purpose, Image &compressedImage)
+{
+    ZoneScoped;
+    VkPipeline compressPipeline = initGpuCompressedImage(gpuImage, purpose, compressedImage);
+
+    if (!compressPipeline)
+        return false;
+
+    GpuBuffer blockBuffer = createGpuBuffer(compressedImage.dataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    setGpuBufferName(blockBuffer, NAMEOF(blockBuffer));
+    VkImageView imageView = createCompressionSourceView(gpuImage);
+    writeCompressionDescriptors(commonDescriptorSet, imageView, layout, blockBuffer);
+
+    Cmd computeCmd = allocateCmd(QueueFamily::Compute);
+    beginOneTimeCmd(computeCmd);
+    recordGpuImageCompression(computeCmd, gpuImage, layout, compressPipeline, compressedImage, blockBuffer, commonDescriptorSet);
+    GpuZoneCollect(computeCmd);
+    endAndSubmitOneTimeCmd(computeCmd, computeQueue, nullptr, nullptr, WaitForFence::Yes);
+    freeCmd(computeCmd);
+
+    readBackBuffer(blockBuffer, compressedImage);
+    vkDestroyImageView(device, imageView, nullptr);
+
+    return true;
+}
+
+#ifdef VERIFY_GPU_COMPRESSION
+static constexpr double maxGpuCompressionPsnrLoss = 1.0; // in dB
+
+static float halfToFloat(uint16_t half) // no negative values in compressed images
+{
+    uint32_t exponent = half >> 10 & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+    return exponent ? ldexpf(1.f + mantissa / 1024.f, (int32_t)exponent - 15) : ldexpf(mantissa / 1024.f, -14);
+}
+
+// decodes the GPU blocks and the native CPU encoder output of every level and compares both with the source,
+// only whole blocks are compared, so levels below 4x4 and the partial blocks at the edges are skipped,
+// BC6H is compared after a x / (1 + x) tone mapping
+static void verifyGpuCompression(const Image &image, const Image &compressedImage)
+{
+    ZoneScoped;
+    ASSERT(image.width == compressedImage.width && image.height == compressedImage.height && image.faceCount == compressedImage.faceCount);
+    ASSERT(image.levelCount == compressedImage.levelCount);
+    uint8_t texelSize = getTexelSize(image);
+    uint16_t mipWidth = image.width;
+    uint16_t mipHeight = image.height;
+    const uint8_t *srcLevel = image.data;
+    const uint8_t *dstLevel = compressedImage.data;
+    double squaredErrorSums[2] {}; // GPU, CPU
+    uint32_t valueCount = 0;
+
+    for (uint32_t level = 0; level < image.levelCount; level++)
+    {
+        uint32_t blockCountX = aligned(mipWidth, srcBlockSizeInTexels) / srcBlockSizeInTexels; // of the compressed level
+        uint32_t blockCountY = aligned(mipHeight, srcBlockSizeInTexels) / srcBlockSizeInTexels;
+        uint32_t rowStride = mipWidth * texelSize;
+
+        for (uint8_t face = 0; face < image.faceCount; face++)
+        {
+            for (uint32_t y = 0; y < mipHeight / srcBlockSizeInTexels; y++)
+            {
+                for (uint32_t x = 0; x < mipWidth / srcBlockSizeInTexels; x++)
+                {
+                    const uint8_t *srcBlock = srcLevel + face * mipHeight * rowStride + (y * rowStride + x * texelSize) * srcBlockSizeInTexels;
+                    uint8_t cpuBlock[dstBlockSizeInBytes];
+                    const uint8_t *blocks[] { dstLevel + ((face * blockCountY + y) * blockCountX + x) * dstBlockSizeInBytes, cpuBlock };
+
+                    switch (compressedImage.format)
+                    {
+                    case VK_FORMAT_BC5_UNORM_BLOCK:
+                    {
+                        uint8_t red[16], green[16];
+
+                        for (uint8_t i = 0; i < 16; i++)
+                        {
+                            red[i] = srcBlock[(i / 4) * rowStride + (i % 4) * channelCount];
+                            green[i] = srcBlock[(i / 4) * rowStride + (i % 4) * channelCount + 1];
+                        }
+
+                        compressBlockBC5(red, 4, green, 4, cpuBlock);
+
+                        for (uint8_t k = 0; k < 2; k++)
+                        {
+                            uint8_t decodedRed[16], decodedGreen[16];
+                            VERIFY(decompressBlockBC5(blocks[k], decodedRed, decodedGreen));
+
+                            for (uint8_t i = 0; i < 16; i++)
+                            {
+                                squaredErrorSums[k] += (decodedRed[i] - red[i]) * (decodedRed[i] - red[i]) + (decodedGreen[i] - green[i]) * (decodedGreen[i] - green[i]);
+                            }
+                        }
+
+                        valueCount += 16 * 2;
+                        break;
+                    }
+                    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+                    {
+                        uint16_t rgb[16][3];
+
+                        for (uint8_t i = 0; i < 16; i++)
+                        {
+                            memcpy(rgb[i], srcBlock + (i / 4) * rowStride + (i % 4) * texelSize, 3 * sizeof(uint16_t));
+                        }
+
+                        compressBlockBC6(rgb[0], 4 * 3, cpuBlock);
+
+                        for (uint8_t k = 0; k < 2; k++)
+                        {
+                            uint16_t decoded[16][3];
+                            VERIFY(decompressBlockBC6(blocks[k], decoded));
+
+                            for (uint8_t i = 0; i < 16 * 3; i++)
+                            {
+                                uint16_t half = rgb[i / 3][i % 3];
+                                float decodedValue = halfToFloat(decoded[i / 3][i % 3]);
+                                float value = half & 0x8000 ? 0.f : halfToFloat(min(half, (uint16_t)0x7BFF)); // clamped like the encoders do
+                                double error = 255.0 * (decodedValue / (1.f + decodedValue) - value / (1.f + value));
+                                squaredErrorSums[k] += error * error;
+                            }
+                        }
+
+                        valueCount += 16 * 3;
+                        break;
+                    }
+                    case VK_FORMAT_BC7_UNORM_BLOCK:
+                    case VK_FORMAT_BC7_SRGB_BLOCK:
+                    {
+                        compressBlockBC7(srcBlock, rowStride, cpuBlock);
+
+                        for (uint8_t k = 0; k < 2; k++)
+                        {
+                            uint8_t decoded[16][4];
+                            VERIFY(decompressBlockBC7(blocks[k], decoded));
+
+                            for (uint8_t i = 0; i < 16 * 4; i++)
+                            {
+                                int32_t error = decoded[i / 4][i % 4] - srcBlock[(i / 16) * rowStride + i % 16];
+                                squaredErrorSums[k] += error * error;
+                            }
+                        }
+
+                        valueCount += 16 * 4;
+                        break;
+                    }
+                    default:
+                        ASSERT(false);
+                        return;
+                    }
+                }
+            }
+        }
+
+        srcLevel += image.faceCount * mipHeight * rowStride;
+        dstLevel += image.faceCount * blockCountY * blockCountX * dstBlockSizeInBytes;
+
+        if (mipWidth > 1)
+            mipWidth >>= 1;
+        if (mipHeight > 1)
+            mipHeight >>= 1;
+    }
+
+    double psnrs[2];
+
+    for (uint8_t k = 0; k < 2; k++)
+    {
+        double meanSquaredError = squaredErrorSums[k] / valueCount;
+        psnrs[k] = meanSquaredError > 0.0 ? 10.0 * log10(255.0 * 255.0 / meanSquaredError) : 99.0;
+    }
+
+    char message[64];
+    int32_t messageSize = snprintf(message, sizeof(message), "GPU compression PSNR: %.2f dB, CPU: %.2f dB", psnrs[0], psnrs[1]);
+    TracyMessage(message, messageSize);
+    ASSERT(psnrs[0] >= psnrs[1] - maxGpuCompressionPsnrLoss);
+}
+#endif // VERIFY_GPU_COMPRESSION
+
+// uploads the image for the compute encoders
+static bool compressImageOnGpu(const Image &image, Image &compressedImage)
+{
+    ZoneScoped;
+
+    if (getTexelSize(image) == 1) // already compressed
+    {
+        compressedImage = {};
+        return false;
+    }
+
+    GpuImage gpuImage = createAndCopyGpuImage(image, QueueFamily::Compute, VK_IMAGE_USAGE_SAMPLED_BIT, image.faceCount == 1 ? GpuImageType::Image2D : GpuImageType::Image2DCubemap);
+    setGpuImageName(gpuImage, NAMEOF(gpuImage));
+    bool compressed = compressGpuImage(gpuImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, image.purpose, compressedImage);
+    destroyGpuImage(gpuImage);
+
+#ifdef VERIFY_GPU_COMPRESSION
+    if (compressed)
+        verifyGpuCompression(image, compressedImage);
+#endif // VERIFY_GPU_COMPRESSION
+
+    return compressed;
+}
+#endif // ENABLE_COMPRESSION
+
+uint32_t iterateImageLevelFaces(const Image &image, IterateCallback callback, void *userData)
+{
+    uint32_t dataOffset = 0;
+    uint16_t mipWidth = image.width;
+    uint16_t mipHeight = image.height;
+    uint8_t texelSize = getTexelSize(image);
+
+    for (uint8_t i = 0; i < image.levelCount; i++)
+    {
+        uint32_t mipSize = mipWidth * mipHeight * texelSize;
+
+        if (texelSize == 1 && (mipWidth < 4 || mipHeight < 4)) // compressed
+        {
+            ASSERT(mipWidth == mipHeight && isPowerOf2(mipWidth));
+            mipSize = 16;
+        }
+
+        for (uint8_t j = 0; j < image.faceCount; j++, dataOffset += mipSize)
+        {
+            callback(image, i, j, mipWidth, mipHeight, dataOffset, mipSize, userData);
+        }
+
+        if (mipWidth > 1)
+            mipWidth >>= 1;
+        if (mipHeight > 1)
+            mipHeight >>= 1;
+    }
+
+    return dataOffset;
+}
+
+// storage views of every level for generateMips.h, 2D arrays cover both plain images and cubemaps
+static void createMipLevelViews(const GpuImage &gpuImage, VkImageView *levelViews)
+{
+    ASSERT(gpuImage.levelCount <= MAX_MIP_LEVEL_COUNT);
+
+    for (uint8_t i = 0; i < gpuImage.levelCount; i++)
+    {
+        VkImageSubresourceRange range = initImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, gpuImage.layerCount);
+        VkImageViewCreateInfo imageViewCreateInfo = initImageViewCreateInfo(gpuImage.image, gpuImage.format, VK_IMAGE_VIEW_TYPE_2D_ARRAY, range);
+        vkVerify(vkCreateImageView(device, &imageViewCreateInfo, nullptr, &levelViews[i]));
+    }
+}
+
+static void destroyMipLevelViews(const GpuImage &gpuImage, VkImageView *levelViews)
+{
+    for (uint8_t i = 0; i < gpuImage.levelCount; i++)
+    {
+        vkDestroyImageView(device, levelViews[i], nullptr);
+    }
+}
+
+// must happen before descriptorSet is bound in the command buffer, the levels of image i go to the elements from i * MAX_MIP_LEVEL_COUNT
+static void writeMipDescriptors(const GpuImage *gpuImages, VkImageView (*levelViews)[MAX_MIP_LEVEL_COUNT], uint32_t imageCount,
+    VkDescriptorSet descriptorSet = commonDescriptorSet)
+{
+    ASSERT(imageCount && imageCount <= MAX_MIP_BATCH_SIZE);
+    VkDescriptorImageInfo imageInfos[MAX_MIP_BATCH_SIZE][MAX_MIP_LEVEL_COUNT];
+    VkWriteDescriptorSet writes[MAX_MIP_BATCH_SIZE + 1];
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        for (uint8_t j = 0; j < gpuImages[i].levelCount; j++)
+        {
+            imageInfos[i][j] = { nullptr, levelViews[i][j], VK_IMAGE_LAYOUT_GENERAL };
+        }
+
+        writes[i] = initWriteDescriptorSetImage(descriptorSet, 8, gpuImages[i].levelCount, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos[i]);
+        writes[i].dstArrayElement = i * MAX_MIP_LEVEL_COUNT;
+    }
+
+    VkDescriptorBufferInfo bufferInfo { mipCounterBuffer.buffer, 0, VK_WHOLE_SIZE };
+    writes[imageCount] = initWriteDescriptorSetBuffer(descriptorSet, 9, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfo);
+    vkUpdateDescriptorSets(device, imageCount + 1, writes, 0, nullptr);
+}
+
+// one dispatch per image for all its levels and faces, level 0 must be written and every level in the general layout, which it stays in,
+// bit i of srgbMask is set if image i is an sRGB image behind UNORM views
+static void generateMipsCompute(Cmd cmd, const GpuImage *gpuImages, uint32_t imageCount, uint32_t srgbMask, VkDescriptorSet descriptorSet = commonDescriptorSet)
+{
+    ASSERT(imageCount && imageCount <= MAX_MIP_BATCH_SIZE);
+    ScopedGpuZone(cmd, "Generate mips");
+
+    // the counters may still be in use by a previous submission, e.g. the bake of the previous HDRI
+    BufferBarrier bufferBarrier {};
+    bufferBarrier.buffer = mipCounterBuffer;
+    bufferBarrier.srcStageMask = StageFlags::ComputeShader;
+    bufferBarrier.dstStageMask = StageFlags::Clear;
+    bufferBarrier.srcAccessMask = AccessFlags::Read | AccessFlags::Write;
+    bufferBarrier.dstAccessMask = AccessFlags::Write;
+    pipelineBarrier(cmd, &bufferBarrier, 1, nullptr, 0);
+
+    vkCmdFillBuffer(cmd.commandBuffer, mipCounterBuffer.buffer, 0, VK_WHOLE_SIZE, 0);
+    bufferBarrier = {};
+    bufferBarrier.buffer = mipCounterBuffer;
+    bufferBarrier.srcStageMask = StageFlags::Clear;
+    bufferBarrier.dstStageMask = StageFlags::ComputeShader;
+    bufferBarrier.srcAccessMask = AccessFlags::Write;
+    bufferBarrier.dstAccessMask = AccessFlags::Read | AccessFlags::Write;
+    ImageBarrier imageBarriers[MAX_MIP_BATCH_SIZE] {};
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        ASSERT(gpuImages[i].levelCount > 1 && gpuImages[i].levelCount <= MAX_MIP_LEVEL_COUNT);
+        ASSERT(gpuImages[i].format == VK_FORMAT_R8G8B8A8_UNORM || gpuImages[i].format == VK_FORMAT_R16G16B16A16_SFLOAT);
+        ASSERT(gpuImages[i].layerCount <= 6);
+        imageBarriers[i].image = gpuImages[i];
+        imageBarriers[i].srcStageMask = StageFlags::ComputeShader | StageFlags::Copy;
+        imageBarriers[i].dstStageMask = StageFlags::ComputeShader;
+        imageBarriers[i].srcAccessMask = AccessFlags::Write;
+        imageBarriers[i].dstAccessMask = AccessFlags::Read | AccessFlags::Write;
+        imageBarriers[i].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageBarriers[i].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    }
+
+    pipelineBarrier(cmd, &bufferBarrier, 1, imageBarriers, imageCount);
+    vkCmdBindDescriptorSets(cmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, commonPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        const GpuImage &gpuImage = gpuImages[i];
+        MipConstants constants { gpuImage.levelCount, srgbMask >> i & 1, i };
+        vkCmdBindPipeline(cmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, gpuImage.format == VK_FORMAT_R8G8B8A8_UNORM ? generateMipsRgba8Pipeline : generateMipsRgba16fPipeline);
+        vkCmdPushConstants(cmd.commandBuffer, commonPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+        vkCmdDispatch(cmd.commandBuffer, (gpuImage.extent.width + mipTileSize - 1) / mipTileSize, (gpuImage.extent.height + mipTileSize - 1) / mipTileSize, gpuImage.layerCount);
+    }
+}
+
+static MipTexelFormat getMipTexelFormat(const Image &image)
+{
+    switch (image.format)
+    {
+    case VK_FORMAT_R8G8B8A8_SRGB:
+        return MipTexelFormat::Rgba8Srgb;
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        return image.purpose == ImagePurpose::Normal ? MipTexelFormat::Rgba8Normal : MipTexelFormat::Rgba8Unorm;
+    case VK_FORMAT_R16G16B16A16_SFLOAT:
+        return MipTexelFormat::Rgba16Float;
+    }
+
+    ASSERT(false);
+    return MipTexelFormat::Rgba8Unorm;
+}
+
+static void createImageMipsOnCpu(Image &image)
+{
+    ZoneScoped;
+    Image mippedImage = image;
+    mippedImage.levelCount = calcMipLevelCount(image.width, image.height);
+    mippedImage.dataSize = calcImagaDataSize(mippedImage);
+    mippedImage.data = new uint8_t[mippedImage.dataSize];
+    memcpy(mippedImage.data, image.data, image.dataSize);
+    generateMips(mippedImage.data, mippedImage.width, mippedImage.height, mippedImage.faceCount, mippedImage.levelCount, getMipTexelFormat(mippedImage), mipFilter);
+
+    delete[] image.data;
+    image = mippedImage;
+}
+
+// all images share one upload, one submission per MAX_MIP_BATCH_SIZE of them and one readback,
+// so their mip chains must fit into the staging buffer together
+static void createImagesMipsOnGpu(Image *images, uint32_t imageCount)
+{
+    ZoneScoped;
+    VkImageUsageFlags usageFlags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
     QueueFamily queueFamily;
     VkImageLayout imageLayout;
 #ifdef MIPS_BLIT
@@ -707,148 +1472,628 @@ void createImageMips(Image &image)
     queueFamily = QueueFamily::Compute;
     imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 #endif
-    GpuImage gpuImage = createAndCopyGpuImage(image, queueFamily, usageFlags, image.faceCount == 1 ? GpuImageType::Image2D : GpuImageType::Image2DCubemap, imageLayout);
+    GpuImage *gpuImages = new GpuImage[imageCount];
+    VkFormat *formats = new VkFormat[imageCount];
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        Image &image = images[i];
+        ASSERT(image.data && image.dataSize);
+        ASSERT(isPowerOf2(image.width) && isPowerOf2(image.height));
+        ASSERT(image.faceCount == 1 || image.faceCount == 6);
+        ASSERT(image.levelCount == 1);
+        ASSERT(image.format == VK_FORMAT_R8G8B8A8_SRGB ||
+            image.format == VK_FORMAT_R8G8B8A8_UNORM ||
+            image.format == VK_FORMAT_R16G16B16A16_SFLOAT);
+
+        formats[i] = image.format;
+#ifndef MIPS_BLIT
+        if (image.format == VK_FORMAT_R8G8B8A8_SRGB) // no storage support, the bytes are the same and generateMips.h converts to linear itself
+            image.format = VK_FORMAT_R8G8B8A8_UNORM;
+#endif
+        gpuImages[i] = createGpuImage(image.format, { image.width, image.height }, calcMipLevelCount(image.width, image.height), usageFlags,
+            image.faceCount == 1 ? GpuImageType::Image2D : GpuImageType::Image2DCubemap);
+    }
+
+    copyImages(images, gpuImages, imageCount, queueFamily, imageLayout); // only the first levels
+
+#ifdef MIPS_BLIT
+    Cmd cmd = allocateCmd(queueFamily);
+    beginOneTimeCmd(cmd);
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        blitGpuImageMips(cmd, gpuImages[i], imageLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+
+    endAndSubmitOneTimeCmd(cmd, graphicsQueue, nullptr, nullptr, WaitForFence::Yes);
+    freeCmd(cmd);
+    imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+#else
+    VkImageView levelViews[MAX_MIP_BATCH_SIZE][MAX_MIP_LEVEL_COUNT];
+
+    // the level views go through commonDescriptorSet, so only a batch of images fits into a submission
+    for (uint32_t first = 0; first < imageCount; first += MAX_MIP_BATCH_SIZE)
+    {
+        uint32_t batchSize = min(MAX_MIP_BATCH_SIZE, imageCount - first);
+        uint32_t srgbMask = 0;
+
+        for (uint32_t i = 0; i < batchSize; i++)
+        {
+            createMipLevelViews(gpuImages[first + i], levelViews[i]);
+            srgbMask |= (uint32_t)(formats[first + i] == VK_FORMAT_R8G8B8A8_SRGB) << i;
+        }
+
+        writeMipDescriptors(gpuImages + first, levelViews, batchSize);
+
+        Cmd cmd = allocateCmd(queueFamily);
+        beginOneTimeCmd(cmd);
+        generateMipsCompute(cmd, gpuImages + first, batchSize, srgbMask);
+        endAndSubmitOneTimeCmd(cmd, computeQueue, nullptr, nullptr, WaitForFence::Yes);
+        freeCmd(cmd);
+
+        for (uint32_t i = 0; i < batchSize; i++)
+        {
+            destroyMipLevelViews(gpuImages[first + i], levelViews[i]);
+        }
+    }
+#endif
+
+    copyImages(gpuImages, images, imageCount, queueFamily, imageLayout);
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        images[i].format = formats[i];
+        destroyGpuImage(gpuImages[i]);
+    }
+
+    delete[] gpuImages;
+    delete[] formats;
+}
+
+static bool hasGpuMips(const Image &image)
+{
+    bool gpu = getMipDevice() == MipDevice::Gpu;
+#ifndef MIPS_BLIT
+    gpu = gpu && calcMipLevelCount(image.width, image.height) <= MAX_MIP_LEVEL_COUNT; // generateMips.h goes up to 4096x4096
+#else
+    UNUSED(image);
+#endif
+    return gpu;
+}
+
+static void createImagesMips(Image *images, uint32_t imageCount)
+{
+    ZoneScoped;
+    ASSERT(images && imageCount);
+    Image *gpuBatch = new Image[imageCount];
+    uint32_t *gpuBatchIndices = new uint32_t[imageCount];
+    uint32_t gpuBatchSize = 0;
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        ASSERT(images[i].levelCount == 1);
+
+        if (hasGpuMips(images[i]))
+        {
+            gpuBatch[gpuBatchSize] = images[i];
+            gpuBatchIndices[gpuBatchSize++] = i;
+        }
+        else
+        {
+            createImageMipsOnCpu(images[i]);
+        }
+    }
+
+    if (gpuBatchSize)
+        createImagesMipsOnGpu(gpuBatch, gpuBatchSize);
+
+    for (uint32_t i = 0; i < gpuBatchSize; i++)
+    {
+        images[gpuBatchIndices[i]] = gpuBatch[i];
+    }
+
+    delete[] gpuBatch;
+    delete[] gpuBatchIndices;
+}
+
+void createImageMips(Image &image)
+{
+    createImagesMips(&image, 1);
+}
+
+void writeImage(Image &image, const char *outImageFilename, GenerateMips generateMips, Compress compress)
+{
+    ZoneScoped;
+    ASSERT(isValidString(outImageFilename));
+    ZoneText(outImageFilename, strlen(outImageFilename));
+    ASSERT(image.faceCount == 1 || image.faceCount == 6);
+
+    if (generateMips == GenerateMips::Yes && image.levelCount == 1)
+        createImageMips(image);
+
+    Image compressedImage = {};
+
+#ifdef ENABLE_COMPRESSION
+    if (compress == Compress::Yes)
+    {
+        if (compressionDevices[(uint8_t)image.purpose] == CompressionDevice::Gpu)
+            compressImageOnGpu(image, compressedImage);
+        else
+            compressImage(image, compressedImage);
+    }
+#else
+    UNUSED(compress);
+#endif // ENABLE_COMPRESSION
+
+    ktxTexture2 *texture;
+    ktxTextureCreateInfo createInfo {};
+    createInfo.vkFormat = compressedImage.data ? compressedImage.format : image.format;
+    createInfo.baseWidth = image.width;
+    createInfo.baseHeight = image.height;
+    createInfo.baseDepth = 1;
+    createInfo.numDimensions = 2;
+    createInfo.numLevels = image.levelCount;
+    createInfo.numLayers = 1;
+    createInfo.numFaces = image.faceCount;
+    createInfo.isArray = false;
+    createInfo.generateMipmaps = false;
+
+    VERIFY(ktxTexture2_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) == KTX_SUCCESS);
+
+    iterateImageLevelFaces(compressedImage.data ? compressedImage : image,
+        [](const Image &image, uint8_t level, uint8_t face, uint16_t mipWidth, uint16_t mipHeight, uint32_t dataOffset, uint32_t dataSize, void *userData)
+    {
+        UNUSED(mipWidth);
+        UNUSED(mipHeight);
+        VERIFY(ktxTexture_SetImageFromMemory(ktxTexture(userData), level, 0, face, image.data + dataOffset, dataSize) == KTX_SUCCESS);
+    }, texture);
+
+    if (supercompressionLevel)
+        VERIFY(ktxTexture2_DeflateZstd(texture, supercompressionLevel) == KTX_SUCCESS);
+
+    uint8_t *fileData;
+    size_t fileDataSize;
+    VERIFY(ktxTexture_WriteToMemory(ktxTexture(texture), &fileData, &fileDataSize) == KTX_SUCCESS);
+    ktxTexture_Destroy(ktxTexture(texture));
+    writeFile(outImageFilename, fileData, (uint32_t)fileDataSize);
+    free(fileData);
+
+    destroyImage(compressedImage);
+}
+
+#pragma region KTX2 loading
+static Image getKtx2ImageLayout(const Ktx2File &file)
+{
+    Image image {};
+    image.width = file.width;
+    image.height = file.height;
+    image.format = (VkFormat)file.vkFormat;
+    image.faceCount = file.faceCount;
+    image.levelCount = file.levelCount;
+    image.dataSize = calcImagaDataSize(image);
+    VERIFY(image.dataSize == file.dataSize); // the faces of a level are tightly packed in both
+    return image;
+}
+
+Image loadImage(const char *inImageFilename)
+{
+    ZoneScoped;
+    Ktx2File file = openKtx2File(inImageFilename);
+    Image image = getKtx2ImageLayout(file);
+    image.data = (uint8_t *)malloc(image.dataSize);
+    readKtx2Levels(&file, &image.data, 1);
+    closeKtx2File(file);
+    return image;
+}
+
+void loadGpuImages(const char *const *inImageFilenames, GpuImage *gpuImages, uint32_t imageCount, QueueFamily dstQueueFamily, VkImageUsageFlags usageFlags)
+{
+    ZoneScoped;
+    ASSERT(inImageFilenames && gpuImages && imageCount);
+    Ktx2File *files = new Ktx2File[imageCount];
+    Image *images = new Image[imageCount];
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        files[i] = openKtx2File(inImageFilenames[i]);
+        images[i] = getKtx2ImageLayout(files[i]);
+        GpuImageType type = images[i].faceCount == 6 ? GpuImageType::Image2DCubemap : GpuImageType::Image2D;
+        gpuImages[i] = createGpuImage(images[i].format, { images[i].width, images[i].height }, images[i].levelCount, usageFlags | VK_IMAGE_USAGE_TRANSFER_DST_BIT, type);
+    }
+
+    FillStagingCallback fillCallback = [](uint8_t *const *stagingData, uint32_t imageCount, void *userData)
+    {
+        readKtx2Levels((const Ktx2File *)userData, stagingData, imageCount);
+    };
+
+    uint32_t stagingBufferSize = getStagingBufferSize();
+    uint32_t firstImage = 0;
+    uint32_t dataSize = 0;
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        uint32_t alignedDataSize = aligned(images[i].dataSize, 16); // the copies align every image to 16 bytes
+
+        if (i > firstImage && dataSize + alignedDataSize > stagingBufferSize)
+        {
+            copyImages(images + firstImage, gpuImages + firstImage, i - firstImage, fillCallback, files + firstImage, dstQueueFamily);
+            firstImage = i;
+            dataSize = 0;
+        }
+
+        dataSize += alignedDataSize;
+    }
+
+    copyImages(images + firstImage, gpuImages + firstImage, imageCount - firstImage, fillCallback, files + firstImage, dstQueueFamily);
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        closeKtx2File(files[i]);
+    }
+
+    delete[] files;
+    delete[] images;
+}
+#pragma endregion
+
+void destroyImage(Image &image)
+{
+    free(image.data);
+    image = {};
+}
+
+#pragma region Import pipeline
+static constexpr uint32_t importBatchSize = 4; // images decoded while the GPU steps of the previous batch run
+static_assert(importBatchSize <= MAX_MIP_BATCH_SIZE, "The mips of a batch take one submission");
+static_assert(importBatchSize <= MAX_NORMAL_MAP_BATCH_SIZE, "The normal maps of a batch take one submission");
+
+struct ImportImagesContext
+{
+    const ImageImportInfo *infos;
+    Image *images;
+};
+
+static void decodeImageJob(int64_t imageIndex, void *userData)
+{
+    ZoneScoped;
+    ASSERT(userData);
+    ImportImagesContext &context = *(ImportImagesContext *)userData;
+    const ImageImportInfo &info = context.infos[imageIndex];
+
+    if (info.data)
+        context.images[imageIndex] = decodeImage(info.data, info.dataSize, info.purpose);
+    else
+        context.images[imageIndex] = decodeImage(info.inImageFilename, info.purpose);
+}
+
+static bool hasGpuNormalization(const Image &image)
+{
+    return image.purpose == ImagePurpose::Normal && device != VK_NULL_HANDLE && image.width * image.height * image.faceCount >= gpuNormalizationMinTexelCount;
+}
+
+// a continuation of the decode of its batch, the GPU steps are left to preprocessImages
+static void prepareImageJob(int64_t imageIndex, void *userData)
+{
+    ZoneScoped;
+    ASSERT(userData);
+    ImportImagesContext &context = *(ImportImagesContext *)userData;
+    Image &image = context.images[imageIndex];
+
+    if (hasGpuNormalization(image))
+        return; // the mips must come after the normalization
+
+    if (image.purpose == ImagePurpose::Normal)
+    {
+        ASSERT(image.format == VK_FORMAT_R8G8B8A8_UNORM);
+        renormalizeNormals(image.data, image.width * image.height * image.faceCount);
+    }
+
+    if (!hasGpuMips(image))
+        createImageMipsOnCpu(image);
+}
+
+static void compressImageJob(int64_t imageIndex, void *userData)
+{
+    ZoneScoped;
+    ASSERT(userData);
+#ifdef ENABLE_COMPRESSION
+    ImportImagesContext &context = *(ImportImagesContext *)userData;
+    Image &image = context.images[imageIndex];
+    Image compressedImage {};
+
+    // the GPU compressed images are done by now, so no Vulkan calls are made on the worker
+    if (compressionDevices[(uint8_t)image.purpose] == CompressionDevice::Cpu && compressImage(image, compressedImage))
+    {
+        destroyImage(image);
+        image = compressedImage;
+    }
+#else
+    UNUSED(imageIndex);
+    UNUSED(userData);
+#endif // ENABLE_COMPRESSION
+}
+
+// a continuation of the compression of its batch
+static void writeImageJob(int64_t imageIndex, void *userData)
+{
+    ZoneScoped;
+    ASSERT(userData);
+    ImportImagesContext &context = *(ImportImagesContext *)userData;
+    writeImage(context.images[imageIndex], context.infos[imageIndex].outImageFilename, GenerateMips::No, Compress::No);
+    destroyImage(context.images[imageIndex]);
+}
+
+static void enqueueImportJobs(JobFunc func, uint32_t firstImage, uint32_t imageCount, ImportImagesContext &context, Token token)
+{
+    JobInfo jobInfos[importBatchSize];
+    ASSERT(imageCount <= countOf(jobInfos));
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        jobInfos[i] = { func, firstImage + i, &context, JobPriority::Background };
+    }
 
-    Cmd cmd = allocateCmd(queueFamily);
-    beginOneTimeCmd(cmd);
-#ifdef MIPS_BLIT
-    blitGpuImageMips(cmd, gpuImage, imageLayout, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-#else
-    generateMipsCompute(gpuImage);
-#endif
-    endAndSubmitOneTimeCmd(cmd, graphicsQueue, nullptr, nullptr, WaitForFence::Yes);
-    freeCmd(cmd);
+    enqueueJobs(jobInfos, imageCount, token);
+}
 
-    copyImage(gpuImage, image, queueFamily);
-    destroyGpuImage(gpuImage);
+static void enqueueImportJobsAfter(JobFunc func, uint32_t firstImage, uint32_t imageCount, ImportImagesContext &context, Token dependency, Token token)
+{
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        enqueueJobAfter({ func, firstImage + i, &context, JobPriority::Background }, dependency, token);
+    }
 }
 
-void writeImage(Image &image, const char *outImageFilename, GenerateMips generateMips, Compress compress)
+// the GPU steps after prepareImageJob: normalization, mips and GPU compression,
+// the mips of as many images as the staging buffer holds are made at once
+static void preprocessImages(Image *images, uint32_t imageCount)
 {
     ZoneScoped;
-    ASSERT(isValidString(outImageFilename));
-    ZoneText(outImageFilename, strlen(outImageFilename));
-    ASSERT(image.faceCount == 1 || image.faceCount == 6);
 
-    if (generateMips == GenerateMips::Yes && image.levelCount == 1)
-        createImageMips(image);
+    Image normalMaps[importBatchSize];
+    uint32_t normalMapIndices[importBatchSize];
+    uint32_t normalMapCount = 0;
+    ASSERT(imageCount <= importBatchSize);
 
-    Image compressedImage = {};
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        if (hasGpuNormalization(images[i]))
+        {
+            normalMaps[normalMapCount] = images[i];
+            normalMapIndices[normalMapCount++] = i;
+        }
+    }
 
-#ifdef ENABLE_COMPRESSION
-    if (compress == Compress::Yes)
-        compressImage(image, compressedImage);
-#else
-    UNUSED(compress);
-#endif // ENABLE_COMPRESSION
+    if (normalMapCount)
+        normalizeNormalMaps(normalMaps, normalMapCount);
 
-    ktxTexture2 *texture;
-    ktxTextureCreateInfo createInfo {};
-    createInfo.vkFormat = compressedImage.data ? compressedImage.format : image.format;
-    createInfo.baseWidth = image.width;
-    createInfo.baseHeight = image.height;
-    createInfo.baseDepth = 1;
-    createInfo.numDimensions = 2;
-    createInfo.numLevels = image.levelCount;
-    createInfo.numLayers = 1;
-    createInfo.numFaces = image.faceCount;
-    createInfo.isArray = false;
-    createInfo.generateMipmaps = false;
+    for (uint32_t i = 0; i < normalMapCount; i++)
+    {
+        images[normalMapIndices[i]] = normalMaps[i];
+    }
 
-    VERIFY(ktxTexture2_Create(&createInfo, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture) == KTX_SUCCESS);
+    Image unmippedImages[importBatchSize]; // the ones prepareImageJob left to the GPU
+    uint32_t unmippedImageIndices[importBatchSize];
+    uint32_t unmippedImageCount = 0;
 
-    iterateImageLevelFaces(compressedImage.data ? compressedImage : image,
-        [](const Image &image, uint8_t level, uint8_t face, uint16_t mipWidth, uint16_t mipHeight, uint32_t dataOffset, uint32_t dataSize, void *userData)
+    for (uint32_t i = 0; i < imageCount; i++)
     {
-        UNUSED(mipWidth);
-        UNUSED(mipHeight);
-        VERIFY(ktxTexture_SetImageFromMemory(ktxTexture(userData), level, 0, face, image.data + dataOffset, dataSize) == KTX_SUCCESS);
-    }, texture);
+        if (images[i].levelCount == 1)
+        {
+            unmippedImages[unmippedImageCount] = images[i];
+            unmippedImageIndices[unmippedImageCount++] = i;
+        }
+    }
 
-    uint8_t *fileData;
-    size_t fileDataSize;
-    VERIFY(ktxTexture_WriteToMemory(ktxTexture(texture), &fileData, &fileDataSize) == KTX_SUCCESS);
-    ktxTexture_Destroy(ktxTexture(texture));
-    writeFile(outImageFilename, fileData, (uint32_t)fileDataSize);
-    free(fileData);
+    uint32_t stagingBufferSize = getStagingBufferSize();
+    uint32_t firstImage = 0;
+    uint32_t dataSize = 0;
 
-    destroyImage(compressedImage);
+    for (uint32_t i = 0; i < unmippedImageCount; i++)
+    {
+        Image mippedImage = unmippedImages[i];
+        mippedImage.levelCount = calcMipLevelCount(mippedImage.width, mippedImage.height);
+        uint32_t mippedDataSize = aligned(calcImagaDataSize(mippedImage), 16); // the copies align every image to 16 bytes
+
+        if (i > firstImage && dataSize + mippedDataSize > stagingBufferSize)
+        {
+            createImagesMips(unmippedImages + firstImage, i - firstImage);
+            firstImage = i;
+            dataSize = 0;
+        }
+
+        dataSize += mippedDataSize;
+    }
+
+    if (unmippedImageCount > firstImage)
+        createImagesMips(unmippedImages + firstImage, unmippedImageCount - firstImage);
+
+    for (uint32_t i = 0; i < unmippedImageCount; i++)
+    {
+        images[unmippedImageIndices[i]] = unmippedImages[i];
+    }
+
+#ifdef ENABLE_COMPRESSION
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        Image compressedImage {};
+
+        if (compressionDevices[(uint8_t)images[i].purpose] == CompressionDevice::Gpu && compressImageOnGpu(images[i], compressedImage))
+        {
+            destroyImage(images[i]);
+            images[i] = compressedImage;
+        }
+    }
+#endif // ENABLE_COMPRESSION
 }
 
-Image loadImage(const char *inImageFilename)
+void importImages(const ImageImportInfo *infos, uint32_t imageCount)
 {
     ZoneScoped;
-    ASSERT(isValidString(inImageFilename));
-    ZoneText(inImageFilename, strlen(inImageFilename));
-    ktxTexture2 *texture;
-    VERIFY(ktxTexture2_CreateFromNamedFile(inImageFilename, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &texture) == KTX_SUCCESS);
+    ASSERT(infos && imageCount);
 
-    Image image {};
-    image.width = (uint16_t)texture->baseWidth;
-    image.height = (uint16_t)texture->baseHeight;
-    image.format = (VkFormat)texture->vkFormat;
-    image.faceCount = (uint8_t)texture->numFaces;
-    image.levelCount = (uint8_t)texture->numLevels;
-    image.dataSize = calcImagaDataSize(image);
-    image.data = (uint8_t *)malloc(image.dataSize);
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        ASSERT(infos[i].data ? infos[i].dataSize != 0 : isValidString(infos[i].inImageFilename));
+        ASSERT(isValidString(infos[i].outImageFilename));
+        ASSERT(infos[i].purpose != ImagePurpose::Undefined && infos[i].purpose != ImagePurpose::HDRI); // env maps go through computeEnvMaps
+    }
 
-    uint32_t size = iterateImageLevelFaces(image, [](const Image &image, uint8_t level, uint8_t face, uint16_t mipWidth, uint16_t mipHeight, uint32_t dataOffset, uint32_t dataSize, void *userData)
+    ImportImagesContext context { infos, new Image[imageCount] };
+    Token decodeToken = createToken();
+    Token prepareToken = createToken();
+    Token compressTokens[2] { createToken(), createToken() };
+    Token writeTokens[2] { createToken(), createToken() }; // at most two batches wait for compression, which bounds the memory use
+    uint32_t nextCount = min(importBatchSize, imageCount);
+    enqueueImportJobs(decodeImageJob, 0, nextCount, context, decodeToken);
+    enqueueImportJobsAfter(prepareImageJob, 0, nextCount, context, decodeToken, prepareToken);
+
+    // the calling thread owns the GPU: while it works on one batch, the workers decode and prepare the next one
+    // and compress and write the previous ones, the CPU-only steps follow each other as continuations
+    for (uint32_t first = 0, batch = 0; first < imageCount; first += importBatchSize, batch++)
     {
-        UNUSED(mipWidth);
-        UNUSED(mipHeight);
-        ktxTexture2 *texture = (ktxTexture2 *)userData;
-        ktx_size_t ktxImageOffset;
-        ktxTexture_GetImageOffset(ktxTexture(texture), level, 0, face, &ktxImageOffset);
-        memcpy(image.data + dataOffset, texture->pData + ktxImageOffset, dataSize);
-    }, texture);
-    VERIFY(image.dataSize == size);
+        uint32_t count = min(importBatchSize, imageCount - first);
+        waitForToken(prepareToken);
+        destroyToken(prepareToken);
+        waitForToken(decodeToken); // done by now, its continuations may still be enqueueing
+        destroyToken(decodeToken);
 
-    ktxTexture_Destroy(ktxTexture(texture));
-    return image;
-}
+        if (first + count < imageCount)
+        {
+            nextCount = min(importBatchSize, imageCount - first - count);
+            decodeToken = createToken();
+            prepareToken = createToken();
+            enqueueImportJobs(decodeImageJob, first + count, nextCount, context, decodeToken);
+            enqueueImportJobsAfter(prepareImageJob, first + count, nextCount, context, decodeToken, prepareToken);
+        }
 
-void destroyImage(Image &image)
-{
-    free(image.data);
-    image = {};
+        preprocessImages(context.images + first, count);
+        uint32_t slot = batch % countOf(writeTokens);
+        waitForToken(writeTokens[slot]);
+        waitForToken(compressTokens[slot]);
+        enqueueImportJobs(compressImageJob, first, count, context, compressTokens[slot]);
+        enqueueImportJobsAfter(writeImageJob, first, count, context, compressTokens[slot], writeTokens[slot]);
+    }
+
+    for (uint32_t i = 0; i < countOf(writeTokens); i++)
+    {
+        waitForToken(writeTokens[i]);
+        destroyToken(writeTokens[i]);
+        waitForToken(compressTokens[i]);
+        destroyToken(compressTokens[i]);
+    }
+
+    delete[] context.images;
 }
+#pragma endregion
 
-static void normalizeNormalMap(Image &normalMapImage)
+// one upload, one submission with a dispatch per image and one readback for the whole batch
+static void normalizeNormalMapBatch(Image *images, uint32_t imageCount)
 {
     ZoneScoped;
-    ASSERT(normalMapImage.data && normalMapImage.dataSize);
-    ASSERT(normalMapImage.format == VK_FORMAT_R8G8B8A8_UNORM);
-    ASSERT(normalMapImage.purpose == ImagePurpose::Normal);
+    ASSERT(imageCount && imageCount <= MAX_NORMAL_MAP_BATCH_SIZE);
+    GpuImage gpuImages[MAX_NORMAL_MAP_BATCH_SIZE];
+    VkDescriptorImageInfo imageInfos[MAX_NORMAL_MAP_BATCH_SIZE];
 
-    GpuImage normalMapGpuImage = createAndCopyGpuImage(normalMapImage, QueueFamily::Compute, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT, GpuImageType::Image2D, VK_IMAGE_LAYOUT_GENERAL);
-    setGpuImageName(normalMapGpuImage, NAMEOF(normalMapGpuImage));
-    VkDescriptorImageInfo imageInfo { nullptr, normalMapGpuImage.imageView, VK_IMAGE_LAYOUT_GENERAL };
-    VkWriteDescriptorSet write = initWriteDescriptorSetImage(commonDescriptorSet, 1, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo);
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        ASSERT(images[i].data && images[i].dataSize);
+        ASSERT(images[i].format == VK_FORMAT_R8G8B8A8_UNORM);
+        ASSERT(images[i].purpose == ImagePurpose::Normal);
+        gpuImages[i] = createGpuImage(images[i].format, { images[i].width, images[i].height }, images[i].levelCount,
+            VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_STORAGE_BIT);
+        setGpuImageName(gpuImages[i], "normalMapGpuImage");
+        imageInfos[i] = { nullptr, gpuImages[i].imageView, VK_IMAGE_LAYOUT_GENERAL };
+    }
+
+    copyImages(images, gpuImages, imageCount, QueueFamily::Compute, VK_IMAGE_LAYOUT_GENERAL);
+    VkWriteDescriptorSet write = initWriteDescriptorSetImage(commonDescriptorSet, 10, imageCount, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos);
     vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
 
-    uint32_t workGroupCount = findBestWorkGroupCount2d(max(normalMapImage.width, normalMapImage.height));
     Cmd computeCmd = allocateCmd(QueueFamily::Compute);
     beginOneTimeCmd(computeCmd);
     {
-        ScopedGpuZoneAutoCollect(computeCmd, "Normalize normal map");
-        ImageBarrier imageBarrier {};
-        imageBarrier.image = normalMapGpuImage;
-        imageBarrier.srcStageMask = StageFlags::None;
-        imageBarrier.dstStageMask = StageFlags::ComputeShader;
-        imageBarrier.srcAccessMask = AccessFlags::None;
-        imageBarrier.dstAccessMask = AccessFlags::Read;
-        imageBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        imageBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-        pipelineBarrier(computeCmd, nullptr, 0, &imageBarrier, 1);
+        ScopedGpuZoneAutoCollect(computeCmd, "Normalize normal maps");
         vkCmdBindDescriptorSets(computeCmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, commonPipelineLayout, 0, 1, &commonDescriptorSet, 0, nullptr);
         vkCmdBindPipeline(computeCmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, normalizeNormalMapPipeline);
-        vkCmdDispatch(computeCmd.commandBuffer, workGroupCount, workGroupCount, 1);
+
+        for (uint32_t i = 0; i < imageCount; i++)
+        {
+            uint32_t workGroupCount = findBestWorkGroupCount2d(max(images[i].width, images[i].height));
+            vkCmdPushConstants(computeCmd.commandBuffer, commonPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(i), &i);
+            vkCmdDispatch(computeCmd.commandBuffer, workGroupCount, workGroupCount, 1);
+        }
     }
     endAndSubmitOneTimeCmd(computeCmd, computeQueue, nullptr, nullptr, WaitForFence::Yes);
     freeCmd(computeCmd);
 
-    copyImage(normalMapGpuImage, normalMapImage, QueueFamily::Compute);
-    destroyGpuImage(normalMapGpuImage);
+    copyImages(gpuImages, images, imageCount, QueueFamily::Compute, VK_IMAGE_LAYOUT_GENERAL);
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        destroyGpuImage(gpuImages[i]);
+    }
+}
+
+// as many images per batch as the staging buffer and the descriptor array hold
+static void normalizeNormalMaps(Image *images, uint32_t imageCount)
+{
+    ZoneScoped;
+    uint32_t stagingBufferSize = getStagingBufferSize();
+    uint32_t firstImage = 0;
+    uint32_t dataSize = 0;
+
+    for (uint32_t i = 0; i < imageCount; i++)
+    {
+        uint32_t alignedDataSize = aligned(images[i].dataSize, 16); // the copies align every image to 16 bytes
+
+        if (i > firstImage && (dataSize + alignedDataSize > stagingBufferSize || i - firstImage == MAX_NORMAL_MAP_BATCH_SIZE))
+        {
+            normalizeNormalMapBatch(images + firstImage, i - firstImage);
+            firstImage = i;
+            dataSize = 0;
+        }
+
+        dataSize += alignedDataSize;
+    }
+
+    normalizeNormalMapBatch(images + firstImage, imageCount - firstImage);
+}
+
+// the blocks are encoded on the GPU if the purpose asks for it, then only they are read back
+static Image readBackGpuImage(const GpuImage &gpuImage, VkImageLayout layout, ImagePurpose purpose)
+{
+    ZoneScoped;
+    Image image {};
+    image.purpose = purpose;
+
+#ifdef ENABLE_COMPRESSION
+    if (compressionDevices[(uint8_t)purpose] == CompressionDevice::Gpu)
+    {
+        compressGpuImage(gpuImage, layout, purpose, image);
+#ifdef VERIFY_GPU_COMPRESSION
+        Image sourceImage {};
+        copyImage(gpuImage, sourceImage, QueueFamily::Compute, layout);
+        verifyGpuCompression(sourceImage, image);
+        destroyImage(sourceImage);
+#endif // VERIFY_GPU_COMPRESSION
+    }
+    else
+#endif // ENABLE_COMPRESSION
+    {
+        copyImage(gpuImage, image, QueueFamily::Compute, layout);
+    }
+
+    return image;
+}
+
+static void writeGpuImage(const GpuImage &gpuImage, VkImageLayout layout, ImagePurpose purpose, const char *outImageFilename)
+{
+    ZoneScoped;
+    Image image = readBackGpuImage(gpuImage, layout, purpose);
+    writeImage(image, outImageFilename, GenerateMips::No, Compress::Yes); // already compressed images are written as they are
+    destroyImage(image);
 }
 
 void computeBrdfLut(const char *brdfLutPath)
@@ -857,7 +2102,7 @@ void computeBrdfLut(const char *brdfLutPath)
 
     GpuImage brdfLutGpuImage = createGpuImage(VK_FORMAT_R16G16B16A16_SFLOAT,
         { brdfLutSize, brdfLutSize }, 1,
-        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
     setGpuImageName(brdfLutGpuImage, NAMEOF(brdfLutGpuImage));
     VkDescriptorImageInfo imageInfo { nullptr, brdfLutGpuImage.imageView, VK_IMAGE_LAYOUT_GENERAL };
     VkWriteDescriptorSet write = initWriteDescriptorSetImage(commonDescriptorSet, 1, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &imageInfo);
@@ -884,91 +2129,201 @@ void computeBrdfLut(const char *brdfLutPath)
     endAndSubmitOneTimeCmd(computeCmd, computeQueue, nullptr, nullptr, WaitForFence::Yes);
     freeCmd(computeCmd);
 
-    Image image {};
-    image.purpose = ImagePurpose::HDRI;
-    copyImage(brdfLutGpuImage, image, QueueFamily::Compute);
-    writeImage(image, brdfLutPath, GenerateMips::No, Compress::Yes);
-    destroyImage(image);
-
+    writeGpuImage(brdfLutGpuImage, VK_IMAGE_LAYOUT_GENERAL, ImagePurpose::HDRI, brdfLutPath);
     destroyGpuImage(brdfLutGpuImage);
 }
 
-void computeEnvMaps(const char *hdriPath, const char *skyboxPath, const char *irradianceMapPath, const char *prefilteredMapPath)
+#pragma region Env map baking
+struct EnvMapReadback
+{
+    GpuBuffer buffer; // GPU compressed if the purpose of the env maps asks for it, otherwise as they are
+    VkImageView compressionView;
+    VkPipeline compressPipeline;
+    VkImageLayout layout;
+};
+
+struct EnvMapBake // the GPU side of one HDRI in flight
+{
+    GpuImage hdriGpuImage;
+    GpuImage skyboxGpuImage;
+    GpuImage prefilteredMapGpuImage;
+    GpuBuffer irradianceShBuffer;
+    EnvMapReadback readbacks[2]; // the skybox and the prefiltered map
+    VkImageView skyboxLevelViews[MAX_MIP_LEVEL_COUNT];
+    VkImageView prefilteredLevelViews[prefilteredMapLevelCount];
+    Cmd cmd;
+    VkFence fence;
+};
+
+struct BakeEnvMapsContext
+{
+    const EnvMapBakeInfo *infos;
+    HdrFile *hdris;
+    Image *envMaps; // the skybox and the prefiltered map of every HDRI
+};
+
+// only maps the file and finds its rows, the decoding happens during the upload
+static void openHdriJob(int64_t hdriIndex, void *userData)
+{
+    ZoneScoped;
+    ASSERT(userData);
+    BakeEnvMapsContext &context = *(BakeEnvMapsContext *)userData;
+    context.hdris[hdriIndex] = openHdrFile(context.infos[hdriIndex].hdriPath);
+}
+
+static void writeEnvMapJob(int64_t envMapIndex, void *userData)
 {
     ZoneScoped;
-    ASSERT(isValidString(hdriPath));
-    ASSERT(isValidString(skyboxPath));
-    ASSERT(isValidString(irradianceMapPath));
-    ASSERT(isValidString(prefilteredMapPath));
-
-    Image image = importImage(hdriPath, ImagePurpose::HDRI);
-    GpuImage hdriGpuImage = createAndCopyGpuImage(image, QueueFamily::Compute, VK_IMAGE_USAGE_SAMPLED_BIT);
-    setGpuImageName(hdriGpuImage, NAMEOF(hdriGpuImage));
-    destroyImage(image);
+    ASSERT(userData);
+    BakeEnvMapsContext &context = *(BakeEnvMapsContext *)userData;
+    const EnvMapBakeInfo &info = context.infos[envMapIndex / 2];
+    // the maps were read back on the calling thread, so only the CPU compression, if any, and the file write are left
+    writeImage(context.envMaps[envMapIndex], envMapIndex % 2 ? info.prefilteredMapPath : info.skyboxPath, GenerateMips::No, Compress::Yes);
+    destroyImage(context.envMaps[envMapIndex]);
+}
+
+// creates the buffer the env map is read back into and writes the compression descriptors, before the bake is recorded,
+// envMap gets the layout of the data, which is copied to the CPU by endEnvMapBake
+static void initEnvMapReadback(EnvMapReadback &readback, const GpuImage &gpuImage, VkImageLayout layout, VkDescriptorSet descriptorSet, Image &envMap)
+{
+    readback = {};
+    readback.layout = layout;
+
+#ifdef ENABLE_COMPRESSION
+    if (compressionDevices[(uint8_t)ImagePurpose::HDRI] == CompressionDevice::Gpu)
+    {
+        readback.compressPipeline = initGpuCompressedImage(gpuImage, ImagePurpose::HDRI, envMap);
+        readback.buffer = createGpuBuffer(envMap.dataSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+        readback.compressionView = createCompressionSourceView(gpuImage);
+        writeCompressionDescriptors(descriptorSet, readback.compressionView, layout, readback.buffer);
+    }
+    else
+#endif // ENABLE_COMPRESSION
+    {
+        UNUSED(descriptorSet);
+        envMap = {};
+        envMap.width = (uint16_t)gpuImage.extent.width;
+        envMap.height = (uint16_t)gpuImage.extent.height;
+        envMap.format = gpuImage.format;
+        envMap.faceCount = gpuImage.layerCount;
+        envMap.levelCount = gpuImage.levelCount;
+        envMap.purpose = ImagePurpose::HDRI;
+        envMap.dataSize = calcImagaDataSize(envMap);
+        readback.buffer = createGpuBuffer(envMap.dataSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    }
+
+    setGpuBufferName(readback.buffer, "envMapBuffer");
+}
+
+// recorded at the end of the bake rather than after its fence, as the compute queue would only run it behind the next bake
+static void recordEnvMapReadback(Cmd cmd, EnvMapReadback &readback, const GpuImage &gpuImage, VkDescriptorSet descriptorSet, const Image &envMap)
+{
+#ifdef ENABLE_COMPRESSION
+    if (readback.compressPipeline)
+    {
+        recordGpuImageCompression(cmd, gpuImage, readback.layout, readback.compressPipeline, envMap, readback.buffer, descriptorSet);
+        return;
+    }
+#endif // ENABLE_COMPRESSION
+    UNUSED(descriptorSet);
+
+    ScopedGpuZone(cmd, "Copy env map");
+    ImageBarrier imageBarrier {};
+    imageBarrier.image = gpuImage;
+    imageBarrier.srcStageMask = StageFlags::ComputeShader;
+    imageBarrier.dstStageMask = StageFlags::Copy;
+    imageBarrier.srcAccessMask = AccessFlags::Write;
+    imageBarrier.dstAccessMask = AccessFlags::Read;
+    imageBarrier.oldLayout = readback.layout;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    pipelineBarrier(cmd, nullptr, 0, &imageBarrier, 1);
+    copyImageToBuffer(cmd, gpuImage, envMap, readback.buffer);
+
+    BufferBarrier bufferBarrier {};
+    bufferBarrier.buffer = readback.buffer;
+    bufferBarrier.srcStageMask = StageFlags::Copy;
+    bufferBarrier.dstStageMask = StageFlags::Copy;
+    bufferBarrier.srcAccessMask = AccessFlags::Write;
+    bufferBarrier.dstAccessMask = AccessFlags::Read;
+    pipelineBarrier(cmd, &bufferBarrier, 1, nullptr, 0);
+}
+
+// records and submits the skybox, its mips, the irradiance SH, the prefiltered map and the readback of both maps into envMaps without waiting,
+// descriptorSet and compressionDescriptorSet must not be used by any pending submission
+static void beginEnvMapBake(EnvMapBake &bake, const HdrFile &hdri, VkDescriptorSet descriptorSet, VkDescriptorSet compressionDescriptorSet, Image *envMaps)
+{
+    ZoneScoped;
+    Image hdriImage {}; // only the layout, the rows are decoded straight into the staging buffer, a strip at a time
+    hdriImage.dataSize = hdri.width * hdri.height * 4 * sizeof(uint16_t);
+    hdriImage.width = hdri.width;
+    hdriImage.height = hdri.height;
+    hdriImage.faceCount = 1;
+    hdriImage.levelCount = 1;
+    hdriImage.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    hdriImage.purpose = ImagePurpose::HDRI;
+    bake.hdriGpuImage = createGpuImage(hdriImage.format, { hdri.width, hdri.height }, 1, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    setGpuImageName(bake.hdriGpuImage, "hdriGpuImage");
+    copyImageRows(hdriImage, bake.hdriGpuImage, [](uint8_t *stagingData, uint16_t firstRow, uint16_t rowCount, void *userData)
+    {
+        decodeHdrRows(*(const HdrFile *)userData, firstRow, rowCount, (uint16_t *)stagingData);
+    }, (void *)&hdri, QueueFamily::Compute);
 
     uint8_t skyboxLevelCount = calcMipLevelCount(skyboxFaceSize, skyboxFaceSize);
-    GpuImage skyboxGpuImage = createGpuImage(VK_FORMAT_R16G16B16A16_SFLOAT,
+    bake.skyboxGpuImage = createGpuImage(VK_FORMAT_R16G16B16A16_SFLOAT,
         { skyboxFaceSize, skyboxFaceSize }, skyboxLevelCount,
-        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
         GpuImageType::Image2DCubemap);
-    setGpuImageName(skyboxGpuImage, NAMEOF(skyboxGpuImage));
-    GpuImage irradianceMapGpuImage = createGpuImage(VK_FORMAT_R16G16B16A16_SFLOAT,
-        { irradianceMapFaceSize, irradianceMapFaceSize }, 1,
-        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-        GpuImageType::Image2DCubemap);
-    setGpuImageName(irradianceMapGpuImage, NAMEOF(irradianceMapGpuImage));
-    GpuImage prefilteredMapGpuImage = createGpuImage(VK_FORMAT_R16G16B16A16_SFLOAT,
+    setGpuImageName(bake.skyboxGpuImage, "skyboxGpuImage");
+    bake.irradianceShBuffer = createGpuBuffer(sizeof(IrradianceSh), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    setGpuBufferName(bake.irradianceShBuffer, "irradianceShBuffer");
+    bake.prefilteredMapGpuImage = createGpuImage(VK_FORMAT_R16G16B16A16_SFLOAT,
         { prefilteredMapFaceSize, prefilteredMapFaceSize }, prefilteredMapLevelCount,
-        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
         GpuImageType::Image2DCubemap);
-    setGpuImageName(prefilteredMapGpuImage, NAMEOF(prefilteredMapGpuImage));
+    setGpuImageName(bake.prefilteredMapGpuImage, "prefilteredMapGpuImage");
 
-    VkDescriptorImageInfo imageInfos[4 + prefilteredMapLevelCount]
+    VkDescriptorImageInfo imageInfos[3 + prefilteredMapLevelCount]
     {
-        { nullptr, hdriGpuImage.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
-        { nullptr, skyboxGpuImage.imageView, VK_IMAGE_LAYOUT_GENERAL },
-        { nullptr, skyboxGpuImage.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
-        { nullptr, irradianceMapGpuImage.imageView, VK_IMAGE_LAYOUT_GENERAL }
+        { nullptr, bake.hdriGpuImage.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+        { nullptr, bake.skyboxGpuImage.imageView, VK_IMAGE_LAYOUT_GENERAL },
+        { nullptr, bake.skyboxGpuImage.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }
     };
-
-    VkImageView imageViews[prefilteredMapLevelCount];
+    VkDescriptorBufferInfo bufferInfo { bake.irradianceShBuffer.buffer, 0, VK_WHOLE_SIZE };
 
     for (uint8_t i = 0; i < prefilteredMapLevelCount; i++)
     {
         VkImageSubresourceRange range = initImageSubresourceRange(VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
-        VkImageViewCreateInfo imageViewCreateInfo = initImageViewCreateInfo(prefilteredMapGpuImage.image, prefilteredMapGpuImage.format, VK_IMAGE_VIEW_TYPE_CUBE, range);
-        vkVerify(vkCreateImageView(device, &imageViewCreateInfo, nullptr, &imageViews[i]));
+        VkImageViewCreateInfo imageViewCreateInfo = initImageViewCreateInfo(bake.prefilteredMapGpuImage.image, bake.prefilteredMapGpuImage.format, VK_IMAGE_VIEW_TYPE_CUBE, range);
+        vkVerify(vkCreateImageView(device, &imageViewCreateInfo, nullptr, &bake.prefilteredLevelViews[i]));
 
-        imageInfos[4 + i] = { nullptr, imageViews[i], VK_IMAGE_LAYOUT_GENERAL };
+        imageInfos[3 + i] = { nullptr, bake.prefilteredLevelViews[i], VK_IMAGE_LAYOUT_GENERAL };
     }
 
     VkWriteDescriptorSet writes[]
     {
-        initWriteDescriptorSetImage(commonDescriptorSet, 0, 1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfos + 0),
-        initWriteDescriptorSetImage(commonDescriptorSet, 1, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos + 1),
-        initWriteDescriptorSetImage(commonDescriptorSet, 2, 1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfos + 2),
-        initWriteDescriptorSetImage(commonDescriptorSet, 3, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos + 3),
-        initWriteDescriptorSetImage(commonDescriptorSet, 4, prefilteredMapLevelCount, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos + 4)
+        initWriteDescriptorSetImage(descriptorSet, 0, 1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfos + 0),
+        initWriteDescriptorSetImage(descriptorSet, 1, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos + 1),
+        initWriteDescriptorSetImage(descriptorSet, 2, 1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, imageInfos + 2),
+        initWriteDescriptorSetBuffer(descriptorSet, 3, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfo),
+        initWriteDescriptorSetImage(descriptorSet, 4, prefilteredMapLevelCount, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, imageInfos + 3)
     };
     vkUpdateDescriptorSets(device, countOf(writes), writes, 0, nullptr);
 
-    VkSemaphore semaphore1, semaphore2;
-    VkSemaphoreCreateInfo semaphoreCreateInfo = initSemaphoreCreateInfo();
-    vkVerify(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore1));
-    vkVerify(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore2));
-    VkSemaphoreSubmitInfoKHR ownershipReleaseFinishedInfo1 = initSemaphoreSubmitInfo(semaphore1, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR);
-    VkSemaphoreSubmitInfoKHR ownershipReleaseFinishedInfo2 = initSemaphoreSubmitInfo(semaphore2, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR);
-    ImageBarrier imageBarriers[3] {};
+    createMipLevelViews(bake.skyboxGpuImage, bake.skyboxLevelViews);
+    writeMipDescriptors(&bake.skyboxGpuImage, &bake.skyboxLevelViews, 1, descriptorSet);
+    initEnvMapReadback(bake.readbacks[0], bake.skyboxGpuImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, descriptorSet, envMaps[0]);
+    initEnvMapReadback(bake.readbacks[1], bake.prefilteredMapGpuImage, VK_IMAGE_LAYOUT_GENERAL, compressionDescriptorSet, envMaps[1]);
+    ImageBarrier imageBarriers[2] {};
 
     uint32_t computeSkyboxWorkGroupCount = findBestWorkGroupCount2d(skyboxFaceSize);
-    uint32_t computeIrradianceMapWorkGroupCount = findBestWorkGroupCount2d(irradianceMapFaceSize);
-    uint32_t computePrefilteredMapWorkGroupCount = findBestWorkGroupCount2d(prefilteredMapFaceSize);
+    uint32_t computePrefilteredMapWorkGroupSize = findBestWorkGroupSize2d(prefilteredMapFaceSize);
 
-    Cmd computeCmd1 = allocateCmd(QueueFamily::Compute);
-    beginOneTimeCmd(computeCmd1);
+    // everything stays on the compute queue, so the graphics queue is free for other work meanwhile
+    bake.cmd = allocateCmd(QueueFamily::Compute);
+    beginOneTimeCmd(bake.cmd);
     {
-        ScopedGpuZoneAutoCollect(computeCmd1, "Compute skybox");
-        imageBarriers[0].image = skyboxGpuImage;
+        ScopedGpuZone(bake.cmd, "Compute skybox");
+        imageBarriers[0].image = bake.skyboxGpuImage;
         imageBarriers[0].srcStageMask = StageFlags::None;
         imageBarriers[0].dstStageMask = StageFlags::ComputeShader;
         imageBarriers[0].srcAccessMask = AccessFlags::None;
@@ -976,94 +2331,164 @@ void computeEnvMaps(const char *hdriPath, const char *skyboxPath, const char *ir
         imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
         imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_GENERAL;
         imageBarriers[1] = imageBarriers[0];
-        imageBarriers[1].image = irradianceMapGpuImage;
-        imageBarriers[2] = imageBarriers[0];
-        imageBarriers[2].image = prefilteredMapGpuImage;
-        pipelineBarrier(computeCmd1, nullptr, 0, imageBarriers, 3);
-        vkCmdBindDescriptorSets(computeCmd1.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, commonPipelineLayout, 0, 1, &commonDescriptorSet, 0, nullptr);
-        vkCmdBindPipeline(computeCmd1.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computeSkyboxPipeline);
-        vkCmdDispatch(computeCmd1.commandBuffer, computeSkyboxWorkGroupCount, computeSkyboxWorkGroupCount, 1);
+        imageBarriers[1].image = bake.prefilteredMapGpuImage;
+        pipelineBarrier(bake.cmd, nullptr, 0, imageBarriers, 2);
+        vkCmdBindDescriptorSets(bake.cmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, commonPipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+        vkCmdBindPipeline(bake.cmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computeSkyboxPipeline);
+        vkCmdDispatch(bake.cmd.commandBuffer, computeSkyboxWorkGroupCount, computeSkyboxWorkGroupCount, 1);
+    }
+
+    generateMipsCompute(bake.cmd, &bake.skyboxGpuImage, 1, 0, descriptorSet);
+
+    {
+        ScopedGpuZone(bake.cmd, "Compute irradiance");
         imageBarriers[0] = {};
-        imageBarriers[0].image = skyboxGpuImage;
+        imageBarriers[0].image = bake.skyboxGpuImage;
         imageBarriers[0].srcStageMask = StageFlags::ComputeShader;
+        imageBarriers[0].dstStageMask = StageFlags::ComputeShader;
         imageBarriers[0].srcAccessMask = AccessFlags::Write;
+        imageBarriers[0].dstAccessMask = AccessFlags::Read;
         imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-        imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imageBarriers[0].srcQueueFamily = QueueFamily::Compute;
-        imageBarriers[0].dstQueueFamily = QueueFamily::Graphics;
-        pipelineBarrier(computeCmd1, nullptr, 0, imageBarriers, 1);
+        imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        pipelineBarrier(bake.cmd, nullptr, 0, imageBarriers, 1);
+        vkCmdBindPipeline(bake.cmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computeIrradianceShPipeline);
+        vkCmdDispatch(bake.cmd.commandBuffer, 1, 1, 1); // a single work group does the whole reduction
+
+        BufferBarrier bufferBarrier {};
+        bufferBarrier.buffer = bake.irradianceShBuffer;
+        bufferBarrier.srcStageMask = StageFlags::ComputeShader;
+        bufferBarrier.dstStageMask = StageFlags::Copy;
+        bufferBarrier.srcAccessMask = AccessFlags::Write;
+        bufferBarrier.dstAccessMask = AccessFlags::Read;
+        pipelineBarrier(bake.cmd, &bufferBarrier, 1, nullptr, 0);
     }
-    endAndSubmitOneTimeCmd(computeCmd1, computeQueue, nullptr, &ownershipReleaseFinishedInfo1, WaitForFence::No);
-
-    Cmd graphicsCmd = allocateCmd(QueueFamily::Graphics);
-    beginOneTimeCmd(graphicsCmd);
     {
-        ScopedGpuZoneAutoCollect(graphicsCmd, "Mips blit");
-        imageBarriers[0] = {};
-        imageBarriers[0].image = skyboxGpuImage;
-        imageBarriers[0].dstStageMask = StageFlags::Blit;
-        imageBarriers[0].dstAccessMask = AccessFlags::Read | AccessFlags::Write;
-        imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
-        imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        imageBarriers[0].srcQueueFamily = QueueFamily::Compute;
-        imageBarriers[0].dstQueueFamily = QueueFamily::Graphics;
-        pipelineBarrier(graphicsCmd, nullptr, 0, imageBarriers, 1);
-        blitGpuImageMips(graphicsCmd, skyboxGpuImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-        imageBarriers[0] = {};
-        imageBarriers[0].image = skyboxGpuImage;
-        imageBarriers[0].srcStageMask = StageFlags::Blit;
-        imageBarriers[0].srcAccessMask = AccessFlags::Write;
-        imageBarriers[0].srcQueueFamily = QueueFamily::Graphics;
-        imageBarriers[0].dstQueueFamily = QueueFamily::Compute;
-        pipelineBarrier(graphicsCmd, nullptr, 0, imageBarriers, 1);
+        ScopedGpuZone(bake.cmd, "Compute prefiltered");
+        vkCmdBindPipeline(bake.cmd.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePrefilteredMapPipeline);
+
+        // one dispatch per level, sized for it, each with its own range of samples
+        for (uint8_t i = 0; i < prefilteredMapLevelCount; i++)
+        {
+            uint32_t levelFaceSize = prefilteredMapFaceSize >> i;
+            uint32_t workGroupCount = (levelFaceSize + computePrefilteredMapWorkGroupSize - 1) / computePrefilteredMapWorkGroupSize;
+            vkCmdPushConstants(bake.cmd.commandBuffer, commonPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PrefilteredMapConstants), &prefilteredMapConstants[i]);
+            vkCmdDispatch(bake.cmd.commandBuffer, workGroupCount * 6, workGroupCount, 1);
+        }
     }
-    endAndSubmitOneTimeCmd(graphicsCmd, graphicsQueue, &ownershipReleaseFinishedInfo1, &ownershipReleaseFinishedInfo2, WaitForFence::No);
 
-    Cmd computeCmd2 = allocateCmd(QueueFamily::Compute);
-    beginOneTimeCmd(computeCmd2);
+    recordEnvMapReadback(bake.cmd, bake.readbacks[0], bake.skyboxGpuImage, descriptorSet, envMaps[0]);
+    recordEnvMapReadback(bake.cmd, bake.readbacks[1], bake.prefilteredMapGpuImage, compressionDescriptorSet, envMaps[1]);
+    GpuZoneCollect(bake.cmd);
+
+    VkFenceCreateInfo fenceCreateInfo = initFenceCreateInfo();
+    vkVerify(vkCreateFence(device, &fenceCreateInfo, nullptr, &bake.fence));
+    endAndSubmitOneTimeCmd(bake.cmd, computeQueue, nullptr, nullptr, bake.fence);
+}
+
+// waits for the bake, writes the irradiance SH and copies the skybox and the prefiltered map to the CPU,
+// only on the transfer queue, so the compute queue keeps working on the next bake meanwhile
+static void endEnvMapBake(EnvMapBake &bake, const char *irradianceShPath, Image *envMaps)
+{
+    ZoneScoped;
+    vkVerify(vkWaitForFences(device, 1, &bake.fence, true, UINT64_MAX));
+    vkDestroyFence(device, bake.fence, nullptr);
+    freeCmd(bake.cmd);
+
+    VkBufferCopy copyRegion { 0, 0, sizeof(IrradianceSh) };
+    copyBufferToStagingBuffer(bake.irradianceShBuffer, &copyRegion, 1);
+    writeFile(irradianceShPath, stagingBufferMappedData, sizeof(IrradianceSh));
+
+    for (uint8_t i = 0; i < countOf(bake.readbacks); i++)
     {
-        ScopedGpuZone(computeCmd2, "Compute irradiance");
-        imageBarriers[0] = {};
-        imageBarriers[0].image = skyboxGpuImage;
-        imageBarriers[0].dstStageMask = StageFlags::ComputeShader;
-        imageBarriers[0].dstAccessMask = AccessFlags::Read;
-        imageBarriers[0].srcQueueFamily = QueueFamily::Graphics;
-        imageBarriers[0].dstQueueFamily = QueueFamily::Compute;
-        pipelineBarrier(computeCmd2, nullptr, 0, imageBarriers, 1);
-        vkCmdBindDescriptorSets(computeCmd2.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, commonPipelineLayout, 0, 1, &commonDescriptorSet, 0, nullptr);
-        vkCmdBindPipeline(computeCmd2.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computeIrradianceMapPipeline);
-        vkCmdDispatch(computeCmd2.commandBuffer, computeIrradianceMapWorkGroupCount * 6, computeIrradianceMapWorkGroupCount, 1);
-    }
-    {
-        ScopedGpuZoneAutoCollect(computeCmd2, "Compute prefiltered");
-        vkCmdBindPipeline(computeCmd2.commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePrefilteredMapPipeline);
-        vkCmdPushConstants(computeCmd2.commandBuffer, commonPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(prefilteredMapLevelCount), &prefilteredMapLevelCount);
-        vkCmdDispatch(computeCmd2.commandBuffer, computePrefilteredMapWorkGroupCount * 6, computePrefilteredMapWorkGroupCount, 1);
-    }
-    endAndSubmitOneTimeCmd(computeCmd2, computeQueue, &ownershipReleaseFinishedInfo2, nullptr, WaitForFence::Yes);
-
-    image.purpose = ImagePurpose::HDRI;
-    copyImage(skyboxGpuImage, image, QueueFamily::Compute);
-    writeImage(image, skyboxPath, GenerateMips::No, Compress::Yes);
-    copyImage(irradianceMapGpuImage, image, QueueFamily::Compute);
-    writeImage(image, irradianceMapPath, GenerateMips::No, Compress::Yes);
-    copyImage(prefilteredMapGpuImage, image, QueueFamily::Compute);
-    writeImage(image, prefilteredMapPath, GenerateMips::No, Compress::Yes);
-    destroyImage(image);
+        EnvMapReadback &readback = bake.readbacks[i];
+        readBackBuffer(readback.buffer, envMaps[i]);
+
+        if (readback.compressionView)
+        {
+#ifdef VERIFY_GPU_COMPRESSION
+            Image sourceImage {}; // queued behind the next bake, but it only checks the encoders
+            copyImage(i ? bake.prefilteredMapGpuImage : bake.skyboxGpuImage, sourceImage, QueueFamily::Compute, readback.layout);
+            verifyGpuCompression(sourceImage, envMaps[i]);
+            destroyImage(sourceImage);
+#endif // VERIFY_GPU_COMPRESSION
+            vkDestroyImageView(device, readback.compressionView, nullptr);
+        }
+    }
 
-    destroyGpuImage(hdriGpuImage);
-    destroyGpuImage(skyboxGpuImage);
-    destroyGpuImage(irradianceMapGpuImage);
-    destroyGpuImage(prefilteredMapGpuImage);
+    destroyMipLevelViews(bake.skyboxGpuImage, bake.skyboxLevelViews);
 
     for (uint8_t i = 0; i < prefilteredMapLevelCount; i++)
     {
-        vkDestroyImageView(device, imageViews[i], nullptr);
+        vkDestroyImageView(device, bake.prefilteredLevelViews[i], nullptr);
+    }
+
+    destroyGpuImage(bake.hdriGpuImage);
+    destroyGpuImage(bake.skyboxGpuImage);
+    destroyGpuBuffer(bake.irradianceShBuffer);
+    destroyGpuImage(bake.prefilteredMapGpuImage);
+}
+
+void computeEnvMaps(const EnvMapBakeInfo *infos, uint32_t hdriCount)
+{
+    ZoneScoped;
+    ASSERT(infos && hdriCount);
+
+    for (uint32_t i = 0; i < hdriCount; i++)
+    {
+        ASSERT(isValidString(infos[i].hdriPath));
+        ASSERT(isValidString(infos[i].skyboxPath));
+        ASSERT(isValidString(infos[i].irradianceShPath));
+        ASSERT(isValidString(infos[i].prefilteredMapPath));
+    }
+
+    BakeEnvMapsContext context { infos, new HdrFile[hdriCount], new Image[hdriCount * 2] };
+    EnvMapBake bakes[countOf(envMapDescriptorSets)];
+    Token openToken = createToken();
+    Token writeTokens[2] { createToken(), createToken() }; // at most two HDRIs wait for compression, which bounds the memory use
+    enqueueJob({ openHdriJob, 0, &context, JobPriority::Background }, openToken);
+
+    // the calling thread owns the GPU: HDRI i is baked while HDRI i - 1 is read back, HDRI i + 1 is opened
+    // and the maps of the HDRIs before are compressed and written on the workers
+    for (uint32_t i = 0; i <= hdriCount; i++)
+    {
+        if (i < hdriCount)
+        {
+            waitForToken(openToken);
+            destroyToken(openToken);
+
+            if (i + 1 < hdriCount)
+            {
+                openToken = createToken();
+                enqueueJob({ openHdriJob, i + 1, &context, JobPriority::Background }, openToken);
+            }
+
+            uint32_t slot = i % countOf(bakes);
+            beginEnvMapBake(bakes[slot], context.hdris[i], envMapDescriptorSets[slot], envMapCompressionDescriptorSets[slot], context.envMaps + i * 2);
+            closeHdrFile(context.hdris[i]);
+        }
+
+        if (i > 0)
+        {
+            uint32_t previous = i - 1;
+            Token &writeToken = writeTokens[previous % countOf(writeTokens)];
+            waitForToken(writeToken);
+            endEnvMapBake(bakes[previous % countOf(bakes)], infos[previous].irradianceShPath, context.envMaps + previous * 2);
+            JobInfo jobInfos[]
+            {
+                { writeEnvMapJob, previous * 2, &context, JobPriority::Background },
+                { writeEnvMapJob, previous * 2 + 1, &context, JobPriority::Background }
+            };
+            enqueueJobs(jobInfos, countOf(jobInfos), writeToken);
+        }
+    }
+
+    for (uint32_t i = 0; i < countOf(writeTokens); i++)
+    {
+        waitForToken(writeTokens[i]);
+        destroyToken(writeTokens[i]);
     }
 
-    freeCmd(graphicsCmd);
-    freeCmd(computeCmd1);
-    freeCmd(computeCmd2);
-    vkDestroySemaphore(device, semaphore1, nullptr);
-    vkDestroySemaphore(device, semaphore2, nullptr);
-}
\ No newline at end of file
+    delete[] context.hdris;
+    delete[] context.envMaps;
+}
+#pragma endregion
\ No newline at end of file
@@ -1,112 +1,1118 @@
 #include "JobSystem.hpp"
-#include "DebugUtils.hpp"
 #include "Utils.hpp"
 
-#include <condition_variable>
-#include <queue>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <new>
 #include <thread>
 #include <vector>
 
+#include <tracy/Tracy.hpp>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// std::atomic::wait is C++20, so park on the address directly
+static void futexWait(void *address, uint32_t expected)
+{
+#ifdef _WIN32
+    WaitOnAddress(address, &expected, sizeof(expected), INFINITE);
+#else
+    syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#endif
+}
+
+static void futexWake(void *address, uint32_t count)
+{
+#ifdef _WIN32
+    if (count == 1)
+        WakeByAddressSingle(address);
+    else
+        WakeByAddressAll(address);
+#else
+    syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count == 1 ? 1 : INT32_MAX, nullptr, nullptr, 0);
+#endif
+}
+
+#ifndef _WIN32
+static bool isFirstSmtSibling(uint32_t cpu)
+{
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu);
+    FILE *file = fopen(path, "r");
+
+    if (!file) // no topology info, treat every cpu as a core
+        return true;
+
+    uint32_t firstSibling = cpu;
+    VERIFY(fscanf(file, "%u", &firstSibling) == 1); // "0,32" or "0-1"
+    fclose(file);
+
+    return firstSibling == cpu;
+}
+#endif
+
+// logical cpus the process may run on, in ascending order
+static std::vector<uint32_t> getUsableCpus(bool skipSmtSiblings)
+{
+    std::vector<uint32_t> cpus;
+#ifdef _WIN32
+    DWORD_PTR processMask, systemMask;
+    VERIFY(GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask));
+
+    if (skipSmtSiblings)
+    {
+        DWORD size = 0;
+        GetLogicalProcessorInformation(nullptr, &size);
+        SYSTEM_LOGICAL_PROCESSOR_INFORMATION *infos = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION *)malloc(size);
+
+        if (GetLogicalProcessorInformation(infos, &size))
+        {
+            DWORD_PTR firstSiblingMask = 0;
+
+            for (uint32_t i = 0; i < size / sizeof(*infos); i++)
+            {
+                if (infos[i].Relationship == RelationProcessorCore)
+                    firstSiblingMask |= infos[i].ProcessorMask & (~infos[i].ProcessorMask + 1); // the lowest bit
+            }
+
+            processMask &= firstSiblingMask;
+        }
+
+        free(infos);
+    }
+
+    for (uint32_t i = 0; i < sizeof(processMask) * 8; i++)
+    {
+        if (processMask & ((DWORD_PTR)1 << i))
+            cpus.push_back(i);
+    }
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    VERIFY(!sched_getaffinity(0, sizeof(set), &set));
+
+    for (uint32_t i = 0; i < CPU_SETSIZE; i++)
+    {
+        if (CPU_ISSET(i, &set) && (!skipSmtSiblings || isFirstSmtSibling(i)))
+            cpus.push_back(i);
+    }
+#endif
+    return cpus;
+}
+
+static void pinCurrentThread(const uint32_t *cpus, uint32_t cpuCount)
+{
+#ifdef _WIN32
+    DWORD_PTR mask = 0;
+
+    for (uint32_t i = 0; i < cpuCount; i++)
+    {
+        mask |= (DWORD_PTR)1 << cpus[i];
+    }
+
+    VERIFY(SetThreadAffinityMask(GetCurrentThread(), mask));
+#else
+    cpu_set_t set;
+    CPU_ZERO(&set);
+
+    for (uint32_t i = 0; i < cpuCount; i++)
+    {
+        CPU_SET(cpus[i], &set);
+    }
+
+    VERIFY(!pthread_setaffinity_np(pthread_self(), sizeof(set), &set));
+#endif
+}
+
 struct Job
 {
     JobFunc func;
     int64_t userIndex;
     void *userData;
     Token token;
+    uint64_t enqueueTime; // set when the job is pushed
 };
 
-class alignas(128) SpinLock
+// the flags live in the counter itself, so the decrement of the last job is its final access to the token
+// and the waiter is free to destroy and reuse the token as soon as it sees zero pending jobs and no flags
+static constexpr uint32_t tokenWaiterBit = 1u << 31;
+static constexpr uint32_t tokenContinuationBit = 1u << 30; // continuations are registered, the token is not done until they are enqueued
+static constexpr uint32_t tokenCounterMask = tokenContinuationBit - 1;
+
+struct Continuation
+{
+    Job job;
+    JobPriority priority;
+    Continuation *next;
+};
+
+// job data of a token is bump allocated from a chain of blocks, the whole chain goes back to the pool when the token is destroyed
+struct ArenaBlock
+{
+    ArenaBlock *next;
+    std::atomic_uint32_t used;
+    uint32_t capacity;
+
+    uint8_t *data()
+    {
+        return (uint8_t *)(this + 1);
+    }
+};
+
+static_assert(sizeof(ArenaBlock) % 16 == 0, "Job data must stay 16 byte aligned");
+
+static constexpr uint32_t arenaBlockCapacity = 64 * 1024 - sizeof(ArenaBlock);
+static constexpr uint32_t jobDataAlignment = 16;
+
+struct TokenData
+{
+    std::atomic_uint32_t counter; // pending job count | tokenContinuationBit | tokenWaiterBit
+    std::atomic_uint32_t generation; // bumped on destroy, so handles to the previous use of the slot are detected
+    std::atomic_uint32_t nextFree; // slot index + 1, 0 ends the free list
+    std::atomic_bool cancelled;
+    Continuation *continuations; // guarded by continuationMutex
+    std::atomic<ArenaBlock *> arena; // the current block first
+    char pad[64 - 4 * sizeof(uint32_t) - 2 * sizeof(void *)]; // keep the counters of different tokens on different cache lines
+};
+
+static_assert(sizeof(TokenData) == 64, "");
+
+static_assert(sizeof(std::atomic_uint32_t) == sizeof(uint32_t), "Futex needs a plain 32-bit word");
+static_assert(sizeof(Token) == sizeof(uint64_t), "Token handles pack the slot index and the generation into a pointer");
+
+// chunk i of the token pool holds firstTokenChunkSize << i slots, together they cover every index a handle can hold
+static constexpr uint32_t firstTokenChunkSize = 4096;
+static constexpr uint32_t tokenChunkCount = 20;
+
+struct JobGraph
+{
+    JobInfo *jobInfos;
+    std::atomic_uint32_t *pendingPredecessorCounts;
+    uint32_t *successorOffsets; // successors of node i are successors[successorOffsets[i]..successorOffsets[i + 1])
+    uint32_t *successors;
+    Token token;
+};
+
+// the fields are atomics because thieves may read a slot while the owner overwrites it, the CAS on top discards such reads
+struct JobSlot
+{
+    std::atomic<JobFunc> func;
+    std::atomic<int64_t> userIndex;
+    std::atomic<void *> userData;
+    std::atomic<Token> token;
+    std::atomic<uint64_t> enqueueTime;
+
+    void store(const Job &job)
+    {
+        func.store(job.func, std::memory_order_relaxed);
+        userIndex.store(job.userIndex, std::memory_order_relaxed);
+        userData.store(job.userData, std::memory_order_relaxed);
+        token.store(job.token, std::memory_order_relaxed);
+        enqueueTime.store(job.enqueueTime, std::memory_order_relaxed);
+    }
+
+    Job load() const
+    {
+        return { func.load(std::memory_order_relaxed), userIndex.load(std::memory_order_relaxed), userData.load(std::memory_order_relaxed),
+            token.load(std::memory_order_relaxed), enqueueTime.load(std::memory_order_relaxed) };
+    }
+};
+
+// Chase-Lev work-stealing deque, see "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al. 2013)
+// the owner pushes and pops at the bottom (LIFO), other threads steal from the top (FIFO)
+class JobDeque
 {
 public:
-    SpinLock() = default;
+    JobDeque() : top { 0 }, bottom { 0 }, buffer { createBuffer(initialCapacity) } {}
+
+    ~JobDeque()
+    {
+        Buffer *buf = buffer.load(std::memory_order_relaxed);
+
+        while (buf) // old buffers are kept alive until now since thieves might still read from them
+        {
+            Buffer *prev = buf->prev;
+            delete[] buf->slots;
+            delete buf;
+            buf = prev;
+        }
+    }
 
-    bool TryAcquire()
+    void push(const Job &job) // owner only
     {
-        return !atomic.load(std::memory_order_relaxed) && !atomic.exchange(true, std::memory_order_acquire);
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer *buf = buffer.load(std::memory_order_relaxed);
+
+        if (b - t > buf->mask)
+            buf = grow(buf, t, b);
+
+        buf->slots[b & buf->mask].store(job);
+        bottom.store(b + 1, std::memory_order_release);
     }
 
-    void Acquire()
+    bool pop(Job &job) // owner only
     {
-        while (!TryAcquire())
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer *buf = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) // empty
         {
-            CPU_PAUSE();
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        job = buf->slots[b & buf->mask].load();
+
+        if (t == b) // last job, race against thieves
+        {
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
         }
+
+        return true;
     }
 
-    void Release()
+    bool steal(Job &job) // any thread
     {
-        atomic.store(false, std::memory_order_release);
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return false;
+
+        Buffer *buf = buffer.load(std::memory_order_acquire);
+        job = buf->slots[t & buf->mask].load();
+
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
     }
 
-    // C++ STD compatibility
-    bool try_lock() { return TryAcquire(); }
-    void lock() { Acquire(); }
-    void unlock() { Release(); }
+    bool empty() const
+    {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+    uint32_t size() const // approximate
+    {
+        int64_t size = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+        return size > 0 ? (uint32_t)size : 0;
+    }
 
 private:
-    std::atomic_bool atomic { false };
-    static_assert(ATOMIC_BOOL_LOCK_FREE, "");
+    struct Buffer
+    {
+        int64_t mask;
+        JobSlot *slots;
+        Buffer *prev;
+    };
+
+    static constexpr int64_t initialCapacity = 1024;
+
+    static Buffer *createBuffer(int64_t capacity)
+    {
+        ASSERT(isPowerOf2((uint32_t)capacity));
+        return new Buffer { capacity - 1, new JobSlot[capacity], nullptr };
+    }
+
+    Buffer *grow(Buffer *buf, int64_t t, int64_t b)
+    {
+        Buffer *newBuf = createBuffer((buf->mask + 1) * 2);
+        newBuf->prev = buf;
+
+        for (int64_t i = t; i < b; i++)
+        {
+            newBuf->slots[i & newBuf->mask].store(buf->slots[i & buf->mask].load());
+        }
+
+        buffer.store(newBuf, std::memory_order_release);
+        return newBuf;
+    }
+
+    // padding instead of alignas, heap allocations are not over-aligned in C++11
+    static constexpr uint32_t cacheLineSize = 64;
+    char pad0[cacheLineSize];
+    std::atomic<int64_t> top;
+    char pad1[cacheLineSize - sizeof(int64_t)];
+    std::atomic<int64_t> bottom;
+    std::atomic<Buffer *> buffer;
+    char pad2[cacheLineSize - sizeof(int64_t) - sizeof(Buffer *)];
 };
 
+static constexpr uint32_t maxExternalThreadCount = 8; // non-worker threads with a deque of their own, any others share the injection queues
+static constexpr uint32_t spinCountBeforeSleep = 64;
+
+// every priority has its own set of deques, lanes are ordered by urgency
+static constexpr uint32_t laneCount = 3;
+static constexpr uint32_t criticalLane = 0;
+static constexpr uint32_t normalLane = 1;
+static constexpr uint32_t backgroundLane = 2;
+
+// reserved workers only run critical jobs, so they sleep separately from the general ones
+static constexpr uint32_t generalWakeGroup = 0;
+static constexpr uint32_t reservedWakeGroup = 1;
+
 static std::vector<std::thread> threads;
-static TracyLockable(SpinLock, spinLock);
-static std::condition_variable_any cond;
-static std::queue<Job> jobs;
-static bool shouldStop;
+static uint32_t generalWorkerCount;
+static JobDeque *queues; // laneCount sets of queueCount deques
+static uint32_t queueCount; // one per worker, then one per external thread
+static std::atomic_uint32_t freeExternalSlots; // bit i is set while the deque of external thread i has no owner
+static std::atomic_uint32_t jobSystemGeneration; // bumped on every init, so slots claimed before a restart are dropped
+
+// jobs of the external threads that found no free slot, locked since any thread may push to them
+static TracyLockable(std::mutex, injectionMutex);
+static std::deque<Job> injectionQueues[laneCount];
+static std::atomic_uint32_t injectionJobCounts[laneCount]; // lets findJob skip the lock
+static std::atomic_bool shouldStop;
+
+// global instead of per token, so that unlocking it after the last access to a token is safe
+static TracyLockable(std::mutex, continuationMutex);
+
+// tokens live in a pool with a lock-free free list, the head packs the slot index + 1 with an ABA tag,
+// the pool grows by chunks that are never freed, so slots never move
+static std::atomic<TokenData *> tokenChunks[tokenChunkCount];
+static TracyLockable(std::mutex, tokenChunkMutex); // taken only when the pool grows
+static std::atomic_uint64_t freeTokenHead;
+static std::atomic_uint32_t usedTokenCount; // slots below it have been handed out at least once
 
-static void threadFunc(uint8_t index)
+static TracyLockable(std::mutex, arenaMutex); // taken only when a token needs a new block
+static ArenaBlock *freeArenaBlocks;
+
+static std::atomic_uint32_t wakeEpochs[2]; // sleeping workers park on it, producers bump it to wake them up
+static std::atomic_uint32_t sleepingWorkerCounts[2];
+
+// written only by its worker, read by anyone
+struct WorkerStatsData
 {
-    char name[10];
-    snprintf(name, sizeof(name), "thread#%02d", index);
-    tracy::SetThreadName(name);
+    std::atomic_uint64_t executedJobCount;
+    std::atomic_uint64_t stolenJobCount;
+    std::atomic_uint64_t busyTime;
+    std::atomic_uint64_t spinTime;
+    std::atomic_uint64_t idleTime;
+    std::atomic_uint64_t latencyHistogram[jobLatencyBucketCount];
+    char pad[64 - sizeof(uint64_t) * (5 + jobLatencyBucketCount) % 64];
+};
+
+static WorkerStatsData *workerStats;
+
+static thread_local int32_t threadQueueIndex = -1;
+static thread_local WorkerStatsData *threadStats; // nullptr on external threads
+static thread_local Token currentJobToken;
+static thread_local JobPriority currentJobPriority; // Normal outside of jobs
+static thread_local uint32_t threadRandomState;
+
+// hands the deque of an external thread back when the thread exits
+struct ExternalSlot
+{
+    int32_t index = -1;
+    uint32_t generation = 0;
+
+    ~ExternalSlot()
+    {
+        if (index >= 0 && generation == jobSystemGeneration.load(std::memory_order_relaxed))
+            freeExternalSlots.fetch_or(1u << index, std::memory_order_release); // the next owner sees our last push
+    }
+};
+
+static thread_local ExternalSlot externalSlot;
+
+// two timestamps per job, cheap enough to keep the stats always on
+static inline uint64_t getTime()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static inline void addStat(std::atomic_uint64_t &stat, uint64_t value)
+{
+    stat.store(stat.load(std::memory_order_relaxed) + value, std::memory_order_relaxed); // single writer, no RMW needed
+}
 
-    while (true)
+static inline uint32_t getLatencyBucket(uint64_t latency)
+{
+    uint64_t microseconds = latency / 1000;
+    uint32_t bucket = 0;
+
+    while (microseconds && bucket < jobLatencyBucketCount - 1)
     {
-        std::unique_lock<decltype(spinLock)> lock(spinLock);
-        while (!shouldStop && jobs.empty())
+        microseconds >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static inline uint32_t nextRandom()
+{
+    // xorshift32
+    uint32_t x = threadRandomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return threadRandomState = x;
+}
+
+static inline void setThreadQueueIndex(uint32_t index)
+{
+    threadQueueIndex = (int32_t)index;
+    threadRandomState = index * 0x9E3779B9u + 1;
+}
+
+static inline Token makeToken(uint32_t index, uint32_t generation)
+{
+    return (Token)(uintptr_t)((uint64_t)generation << 32 | (index + 1));
+}
+
+static inline uint32_t floorLog2(uint32_t value)
+{
+#ifdef _WIN32
+    unsigned long bit;
+    _BitScanReverse(&bit, value);
+    return (uint32_t)bit;
+#else
+    return 31 - (uint32_t)__builtin_clz(value);
+#endif
+}
+
+static inline uint32_t getTokenChunk(uint32_t index)
+{
+    return floorLog2(index / firstTokenChunkSize + 1); // chunk i starts at firstTokenChunkSize * (2^i - 1)
+}
+
+static inline TokenData *getTokenSlot(uint32_t index, uint32_t chunk)
+{
+    return &tokenChunks[chunk].load(std::memory_order_acquire)[index - firstTokenChunkSize * ((1u << chunk) - 1)];
+}
+
+static inline TokenData *getTokenData(Token token)
+{
+    uint64_t handle = (uint64_t)(uintptr_t)token;
+    uint32_t index = (uint32_t)handle - 1;
+
+    // checked in release builds too, a stale handle would count down the jobs of the token that reuses the slot
+    if (index >= usedTokenCount.load(std::memory_order_relaxed))
+    {
+        ASSERT(!"Invalid token!");
+        abort();
+    }
+
+    TokenData *tokenData = getTokenSlot(index, getTokenChunk(index));
+
+    if (tokenData->generation.load(std::memory_order_relaxed) != (uint32_t)(handle >> 32))
+    {
+        ASSERT(!"Stale token!");
+        abort();
+    }
+
+    return tokenData;
+}
+
+static ArenaBlock *acquireArenaBlock(uint32_t capacity)
+{
+    ArenaBlock *block = nullptr;
+
+    if (capacity <= arenaBlockCapacity)
+    {
+        capacity = arenaBlockCapacity;
+        block = freeArenaBlocks;
+
+        if (block)
+            freeArenaBlocks = block->next;
+    }
+
+    if (!block) // oversized blocks are never pooled
+    {
+        block = (ArenaBlock *)new uint8_t[sizeof(ArenaBlock) + capacity];
+        new (block) ArenaBlock;
+        block->capacity = capacity;
+    }
+
+    return block;
+}
+
+static void releaseArena(ArenaBlock *block)
+{
+    std::lock_guard<decltype(arenaMutex)> lock(arenaMutex);
+
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+
+        if (block->capacity == arenaBlockCapacity)
+        {
+            block->next = freeArenaBlocks;
+            freeArenaBlocks = block;
+        }
+        else
+        {
+            delete[] (uint8_t *)block;
+        }
+
+        block = next;
+    }
+}
+
+static inline uint32_t getLane(JobPriority priority)
+{
+    switch (priority)
+    {
+    case JobPriority::Critical:
+        return criticalLane;
+    case JobPriority::Background:
+        return backgroundLane;
+    default:
+        return normalLane;
+    }
+}
+
+static inline JobPriority getLanePriority(uint32_t lane)
+{
+    static constexpr JobPriority lanePriorities[laneCount] { JobPriority::Critical, JobPriority::Normal, JobPriority::Background };
+    return lanePriorities[lane];
+}
+
+static inline JobDeque &getQueue(uint32_t lane, uint32_t index)
+{
+    return queues[lane * queueCount + index];
+}
+
+// -1 on external threads that own no deque in the current run
+static int32_t getOwnQueueIndex()
+{
+    if (threadStats)
+        return threadQueueIndex;
+
+    if (externalSlot.index >= 0 && externalSlot.generation == jobSystemGeneration.load(std::memory_order_relaxed))
+        return threadQueueIndex;
+
+    return -1;
+}
+
+static bool claimExternalSlot()
+{
+    uint32_t slots = freeExternalSlots.load(std::memory_order_relaxed);
+
+    while (slots)
+    {
+        uint32_t index = 0;
+
+        while (!(slots & 1u << index))
+            index++;
+
+        if (freeExternalSlots.compare_exchange_weak(slots, slots & ~(1u << index), std::memory_order_acquire, std::memory_order_relaxed))
         {
-            cond.wait(lock);
+            externalSlot.index = (int32_t)index;
+            externalSlot.generation = jobSystemGeneration.load(std::memory_order_relaxed);
+            setThreadQueueIndex((uint32_t)threads.size() + index);
+            return true;
         }
+    }
 
-        if (shouldStop)
+    externalSlot.index = -1;
+    threadQueueIndex = -1;
+    return false;
+}
+
+static void pushToThreadQueue(uint32_t lane, const Job &job)
+{
+    if (getOwnQueueIndex() >= 0 || claimExternalSlot())
+    {
+        getQueue(lane, threadQueueIndex).push(job);
+        return;
+    }
+
+    std::lock_guard<decltype(injectionMutex)> lock(injectionMutex);
+    injectionQueues[lane].push_back(job);
+    injectionJobCounts[lane].fetch_add(1, std::memory_order_relaxed);
+}
+
+static bool popInjectedJob(Job &job, uint32_t lane)
+{
+    if (!injectionJobCounts[lane].load(std::memory_order_relaxed))
+        return false;
+
+    std::lock_guard<decltype(injectionMutex)> lock(injectionMutex);
+
+    if (injectionQueues[lane].empty())
+        return false;
+
+    job = injectionQueues[lane].front();
+    injectionQueues[lane].pop_front();
+    injectionJobCounts[lane].fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+// looks through the lanes up to lastLane, more urgent ones first, so a critical job is picked up right after the current job
+static bool findJob(Job &job, uint32_t &jobLane, uint32_t lastLane)
+{
+    int32_t ownQueueIndex = getOwnQueueIndex();
+
+    // the relaxed empty checks skip the fences of pop and steal on the mostly empty urgent lanes
+    for (uint32_t lane = 0; lane <= lastLane; lane++)
+    {
+        jobLane = lane;
+
+        if (ownQueueIndex >= 0)
+        {
+            JobDeque &queue = getQueue(lane, ownQueueIndex);
+
+            if (!queue.empty() && queue.pop(job))
+                return true;
+        }
+
+        if (popInjectedJob(job, lane))
+            return true;
+
+        uint32_t start = nextRandom();
+
+        for (uint32_t i = 0; i < queueCount; i++)
+        {
+            uint32_t victim = (start + i) % queueCount;
+            JobDeque &queue = getQueue(lane, victim);
+
+            if ((int32_t)victim != ownQueueIndex && !queue.empty() && queue.steal(job))
+            {
+                if (threadStats)
+                    addStat(threadStats->stolenJobCount, 1);
+
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+static bool hasQueuedJobs(uint32_t lastLane)
+{
+    for (uint32_t i = 0; i < (lastLane + 1) * queueCount; i++)
+    {
+        if (!queues[i].empty())
+            return true;
+    }
+
+    for (uint32_t lane = 0; lane <= lastLane; lane++)
+    {
+        if (injectionJobCounts[lane].load(std::memory_order_relaxed))
+            return true;
+    }
+
+    return false;
+}
+
+static void sleepUntilJobsQueued(uint32_t wakeGroup, uint32_t lastLane)
+{
+    ZoneScoped;
+    uint32_t epoch = wakeEpochs[wakeGroup].load(std::memory_order_relaxed);
+    sleepingWorkerCounts[wakeGroup].fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst); // pairs with the fence in wakeWorkers
+
+    // if a producer bumps the epoch after we read it, the futex returns immediately
+    if (!shouldStop.load(std::memory_order_relaxed) && !hasQueuedJobs(lastLane))
+        futexWait(&wakeEpochs[wakeGroup], epoch);
+
+    sleepingWorkerCounts[wakeGroup].fetch_sub(1, std::memory_order_relaxed);
+}
+
+static void wakeWorkers(uint32_t lane, uint32_t jobCount)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst); // either we see the sleeper or the sleeper sees the new jobs
+
+    // critical jobs wake both groups, whichever comes first takes the job
+    for (uint32_t wakeGroup = lane == criticalLane ? reservedWakeGroup : generalWakeGroup;; wakeGroup = generalWakeGroup)
+    {
+        if (sleepingWorkerCounts[wakeGroup].load(std::memory_order_relaxed))
+        {
+            wakeEpochs[wakeGroup].fetch_add(1, std::memory_order_relaxed);
+            futexWake(&wakeEpochs[wakeGroup], jobCount);
+        }
+
+        if (wakeGroup == generalWakeGroup)
+            break;
+    }
+}
+
+static void pushJob(Job job, JobPriority priority)
+{
+    ASSERT(job.func);
+    uint32_t lane = getLane(priority);
+    job.enqueueTime = getTime();
+    pushToThreadQueue(lane, job);
+    wakeWorkers(lane, 1);
+}
+
+static void enqueueContinuations(TokenData *tokenData)
+{
+    ZoneScoped;
+    uint32_t counter;
+    {
+        std::lock_guard<decltype(continuationMutex)> lock(continuationMutex);
+        counter = tokenData->counter.load(std::memory_order_acquire);
+
+        if (counter & tokenCounterMask) // new jobs were added in the meantime, the last of them enqueues the continuations
             return;
 
-        Job job = jobs.front();
-        jobs.pop();
-        lock.unlock();
+        // the nodes live in the arena of the token, so they are pushed before the flag is cleared
+        for (Continuation *continuation = tokenData->continuations; continuation; continuation = continuation->next)
+        {
+            pushJob(continuation->job, continuation->priority);
+        }
+
+        tokenData->continuations = nullptr;
+        counter = tokenData->counter.fetch_and(~tokenContinuationBit, std::memory_order_acq_rel); // the last access to the token
+    }
+
+    if (counter == (tokenWaiterBit | tokenContinuationBit))
+        futexWake(&tokenData->counter, UINT32_MAX);
+}
+
+static void runGraphNode(int64_t nodeIndex, void *userData);
+
+// the lane the job was found in, the jobs it enqueues without a priority of their own inherit it
+static inline void runJob(const Job &job, uint32_t lane)
+{
+    TokenData *tokenData = job.token ? getTokenData(job.token) : nullptr;
 
+    // jobs of a cancelled token are dropped but still counted down, graph nodes still have to release their successors
+    if (!tokenData || !tokenData->cancelled.load(std::memory_order_relaxed) || job.func == runGraphNode)
+    {
+        Token previousJobToken = currentJobToken; // waiters run jobs from inside other jobs
+        JobPriority previousJobPriority = currentJobPriority;
+        currentJobToken = job.token;
+        currentJobPriority = getLanePriority(lane);
         job.func(job.userIndex, job.userData);
+        currentJobToken = previousJobToken;
+        currentJobPriority = previousJobPriority;
+    }
 
-        if (job.token)
-            (*(std::atomic_int32_t *)job.token)--;
+    if (!tokenData)
+        return;
+
+    uint32_t counter = tokenData->counter.fetch_sub(1, std::memory_order_acq_rel);
+
+    // the token may already be destroyed after the decrement, the wake only uses its address
+    if (counter == (tokenWaiterBit | 1))
+        futexWake(&tokenData->counter, UINT32_MAX);
+    else if ((counter & tokenCounterMask) == 1 && counter & tokenContinuationBit) // the token is kept alive by the flag
+        enqueueContinuations(tokenData);
+}
+
+static void runGraphNode(int64_t nodeIndex, void *userData)
+{
+    ASSERT(userData);
+    JobGraph &graph = *(JobGraph *)userData;
+    const JobInfo &jobInfo = graph.jobInfos[nodeIndex];
+
+    if (!isCancelled(graph.token))
+        jobInfo.func(jobInfo.userIndex, jobInfo.userData);
+
+    for (uint32_t i = graph.successorOffsets[nodeIndex]; i < graph.successorOffsets[nodeIndex + 1]; i++)
+    {
+        uint32_t successor = graph.successors[i];
+
+        if (graph.pendingPredecessorCounts[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+            pushJob({ runGraphNode, successor, &graph, graph.token, 0 }, graph.jobInfos[successor].priority); // already counted in the token
     }
 }
 
-void initJobSystem()
+static void threadFunc(uint32_t index, int32_t cpu)
+{
+    bool reserved = index >= generalWorkerCount;
+    char name[32]; // e.g. "Worker #03 (cpu 12)", Tracy copies it
+    int32_t nameSize = snprintf(name, sizeof(name), "%s #%02u", reserved ? "Critical worker" : "Worker", index);
+
+    if (cpu >= 0)
+    {
+        uint32_t pinnedCpu = (uint32_t)cpu;
+        pinCurrentThread(&pinnedCpu, 1);
+        snprintf(name + nameSize, sizeof(name) - nameSize, " (cpu %d)", cpu);
+    }
+
+    tracy::SetThreadName(name);
+    setThreadQueueIndex(index);
+    threadStats = &workerStats[index];
+
+    uint32_t wakeGroup = reserved ? reservedWakeGroup : generalWakeGroup;
+    uint32_t lastLane = reserved ? criticalLane : backgroundLane;
+    Job job;
+    uint32_t jobLane;
+    uint32_t failedAttempts = 0;
+    uint64_t searchStart = getTime(); // everything between jobs that is not sleeping counts as spinning
+
+    while (!shouldStop.load(std::memory_order_relaxed))
+    {
+        if (findJob(job, jobLane, lastLane))
+        {
+            uint64_t jobStart = getTime();
+            addStat(threadStats->spinTime, jobStart - searchStart);
+            addStat(threadStats->latencyHistogram[getLatencyBucket(jobStart - job.enqueueTime)], 1);
+            addStat(threadStats->executedJobCount, 1); // counted on start to stay in sync with the histogram
+
+            runJob(job, jobLane);
+
+            searchStart = getTime();
+            addStat(threadStats->busyTime, searchStart - jobStart);
+            failedAttempts = 0;
+            continue;
+        }
+
+        if (++failedAttempts < spinCountBeforeSleep)
+        {
+            CPU_PAUSE();
+            continue;
+        }
+
+        uint64_t sleepStart = getTime();
+        addStat(threadStats->spinTime, sleepStart - searchStart);
+        sleepUntilJobsQueued(wakeGroup, lastLane);
+        searchStart = getTime();
+        addStat(threadStats->idleTime, searchStart - sleepStart);
+        failedAttempts = 0;
+    }
+}
+
+void initJobSystem(const JobSystemConfig &config)
 {
     if (!threads.empty())
         return;
 
     shouldStop = false;
-    uint8_t threadCount = (uint8_t)std::thread::hardware_concurrency(); // yes, this is bad
+    freeExternalSlots = (1u << maxExternalThreadCount) - 1;
+    jobSystemGeneration++;
+
+    for (uint32_t i = 0; i < countOf(wakeEpochs); i++)
+    {
+        wakeEpochs[i] = 0;
+        sleepingWorkerCounts[i] = 0;
+    }
+
+    // the window of usable cores is split into the reserved ones at the start and the worker ones after them
+    std::vector<uint32_t> cpus = getUsableCpus(config.skipSmtSiblings);
+    uint32_t firstCore = min(config.firstCore, (uint32_t)cpus.size() - 1);
+    uint32_t coreCount = min(config.coreCount ? config.coreCount : UINT32_MAX, (uint32_t)cpus.size() - firstCore);
+    uint32_t reservedCoreCount = min(config.reservedCoreCount, coreCount - 1);
+    const uint32_t *reservedCpus = cpus.data() + firstCore;
+    const uint32_t *workerCpus = reservedCpus + reservedCoreCount;
+    uint32_t workerCoreCount = coreCount - reservedCoreCount;
+
+    uint32_t threadCount = config.workerCount ? config.workerCount : workerCoreCount;
+    ASSERT(config.reservedWorkerCount < threadCount);
+    generalWorkerCount = threadCount - min(config.reservedWorkerCount, threadCount - 1);
+    queueCount = threadCount + maxExternalThreadCount;
+    queues = new JobDeque[laneCount * queueCount];
+    workerStats = new WorkerStatsData[threadCount](); // zeroed
     threads.reserve(threadCount);
 
-    for (uint8_t i = 0; i < threadCount; i++)
+    if (config.pinThreads && reservedCoreCount)
+        pinCurrentThread(reservedCpus, reservedCoreCount);
+
+    for (uint32_t i = 0; i < threadCount; i++)
     {
-        threads.emplace_back(&threadFunc, i);
+        int32_t cpu = config.pinThreads ? (int32_t)workerCpus[i % workerCoreCount] : -1;
+        threads.emplace_back(&threadFunc, i, cpu);
     }
 }
 
+uint32_t getWorkerThreadCount()
+{
+    return (uint32_t)threads.size();
+}
+
+uint32_t getWorkerStats(WorkerStats *stats, uint32_t maxCount)
+{
+    uint32_t count = min((uint32_t)threads.size(), maxCount);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const WorkerStatsData &data = workerStats[i];
+        stats[i].executedJobCount = data.executedJobCount.load(std::memory_order_relaxed);
+        stats[i].stolenJobCount = data.stolenJobCount.load(std::memory_order_relaxed);
+        stats[i].busyTime = data.busyTime.load(std::memory_order_relaxed);
+        stats[i].spinTime = data.spinTime.load(std::memory_order_relaxed);
+        stats[i].idleTime = data.idleTime.load(std::memory_order_relaxed);
+
+        for (uint32_t j = 0; j < jobLatencyBucketCount; j++)
+        {
+            stats[i].latencyHistogram[j] = data.latencyHistogram[j].load(std::memory_order_relaxed);
+        }
+    }
+
+    return (uint32_t)threads.size();
+}
+
+uint32_t getQueuedJobCount()
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < laneCount * queueCount; i++)
+    {
+        count += queues[i].size();
+    }
+
+    for (uint32_t lane = 0; lane < laneCount; lane++)
+    {
+        count += injectionJobCounts[lane].load(std::memory_order_relaxed);
+    }
+
+    return count;
+}
+
+void plotJobSystemStats()
+{
+#ifdef TRACY_ENABLE
+    static uint64_t prevExecutedJobCount, prevStolenJobCount, prevBusyTime, prevSpinTime, prevIdleTime;
+    uint64_t executedJobCount = 0, stolenJobCount = 0, busyTime = 0, spinTime = 0, idleTime = 0;
+
+    for (uint32_t i = 0; i < threads.size(); i++)
+    {
+        executedJobCount += workerStats[i].executedJobCount.load(std::memory_order_relaxed);
+        stolenJobCount += workerStats[i].stolenJobCount.load(std::memory_order_relaxed);
+        busyTime += workerStats[i].busyTime.load(std::memory_order_relaxed);
+        spinTime += workerStats[i].spinTime.load(std::memory_order_relaxed);
+        idleTime += workerStats[i].idleTime.load(std::memory_order_relaxed);
+    }
+
+    uint64_t totalTime = (busyTime - prevBusyTime) + (spinTime - prevSpinTime) + (idleTime - prevIdleTime);
+
+    TracyPlot("Jobs queued", (int64_t)getQueuedJobCount());
+    TracyPlot("Jobs executed", (int64_t)(executedJobCount - prevExecutedJobCount));
+    TracyPlot("Jobs stolen", (int64_t)(stolenJobCount - prevStolenJobCount));
+
+    if (totalTime)
+    {
+        TracyPlot("Workers busy %", 100.0 * (busyTime - prevBusyTime) / totalTime);
+        TracyPlot("Workers spinning %", 100.0 * (spinTime - prevSpinTime) / totalTime);
+    }
+
+    prevExecutedJobCount = executedJobCount;
+    prevStolenJobCount = stolenJobCount;
+    prevBusyTime = busyTime;
+    prevSpinTime = spinTime;
+    prevIdleTime = idleTime;
+#endif // TRACY_ENABLE
+}
+
 Token createToken()
 {
-    // TODO: pool allocator
-    return (Token)new std::atomic_int32_t(0);
+    uint64_t head = freeTokenHead.load(std::memory_order_acquire);
+    uint32_t index;
+
+    for (;;)
+    {
+        if (!(uint32_t)head) // the free list is empty, take a slot that was never used
+        {
+            index = usedTokenCount.fetch_add(1, std::memory_order_relaxed);
+            uint32_t chunk = getTokenChunk(index);
+            ASSERT(chunk < tokenChunkCount && "Too many tokens!"); // 2^32 - 4096 of them, memory runs out long before
+
+            if (!tokenChunks[chunk].load(std::memory_order_acquire))
+            {
+                std::lock_guard<decltype(tokenChunkMutex)> lock(tokenChunkMutex);
+
+                if (!tokenChunks[chunk].load(std::memory_order_relaxed))
+                    tokenChunks[chunk].store(new TokenData[firstTokenChunkSize << chunk](), std::memory_order_release); // zeroed
+            }
+
+            break;
+        }
+
+        index = (uint32_t)head - 1;
+        uint64_t newHead = ((head >> 32) + 1) << 32 | getTokenSlot(index, getTokenChunk(index))->nextFree.load(std::memory_order_relaxed);
+
+        if (freeTokenHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire))
+            break;
+    }
+
+    TokenData &tokenData = *getTokenSlot(index, getTokenChunk(index));
+    ASSERT(!tokenData.counter.load(std::memory_order_relaxed));
+    tokenData.cancelled.store(false, std::memory_order_relaxed);
+    tokenData.continuations = nullptr;
+    tokenData.arena.store(nullptr, std::memory_order_relaxed);
+    return makeToken(index, tokenData.generation.load(std::memory_order_relaxed));
 }
 
 void destroyToken(Token token)
 {
-    ASSERT(!*(std::atomic_int32_t *)token);
-    delete (std::atomic_int32_t *)token;
+    TokenData *tokenData = getTokenData(token);
+    ASSERT(!tokenData->counter.load(std::memory_order_acquire));
+    releaseArena(tokenData->arena.load(std::memory_order_relaxed));
+    tokenData->generation.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t index = (uint32_t)(uint64_t)(uintptr_t)token - 1;
+    uint64_t head = freeTokenHead.load(std::memory_order_relaxed);
+    uint64_t newHead;
+
+    do
+    {
+        tokenData->nextFree.store((uint32_t)head, std::memory_order_relaxed);
+        newHead = ((head >> 32) + 1) << 32 | (index + 1);
+    } while (!freeTokenHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void cancelToken(Token token)
+{
+    getTokenData(token)->cancelled.store(true, std::memory_order_relaxed);
+}
+
+bool isCancelled(Token token)
+{
+    return getTokenData(token)->cancelled.load(std::memory_order_relaxed);
+}
+
+Token getCurrentJobToken()
+{
+    return currentJobToken;
+}
+
+JobPriority getCurrentJobPriority()
+{
+    return currentJobPriority;
+}
+
+void *allocateJobData(Token token, uint32_t size)
+{
+    TokenData *tokenData = getTokenData(token);
+    size = aligned(size, jobDataAlignment);
+
+    for (;;)
+    {
+        ArenaBlock *block = tokenData->arena.load(std::memory_order_acquire);
+
+        if (block)
+        {
+            uint32_t offset = block->used.fetch_add(size, std::memory_order_relaxed);
+
+            if (offset + size <= block->capacity)
+                return block->data() + offset;
+        }
+
+        std::lock_guard<decltype(arenaMutex)> lock(arenaMutex);
+
+        if (tokenData->arena.load(std::memory_order_relaxed) != block) // another thread added a block in the meantime
+            continue;
+
+        ArenaBlock *newBlock = acquireArenaBlock(size);
+        newBlock->next = block;
+        newBlock->used.store(size, std::memory_order_relaxed);
+        tokenData->arena.store(newBlock, std::memory_order_release);
+        return newBlock->data();
+    }
 }
 
 void enqueueJob(JobInfo jobInfo, Token token)
@@ -114,37 +1120,172 @@ void enqueueJob(JobInfo jobInfo, Token token)
     ASSERT(jobInfo.func);
     ASSERT(threads.size());
     if (token)
-        (*(std::atomic_int32_t *)token)++;
+        getTokenData(token)->counter.fetch_add(1, std::memory_order_relaxed);
 
-    std::unique_lock<decltype(spinLock)> lock(spinLock);
-    jobs.push({ jobInfo.func, jobInfo.userIndex, jobInfo.userData, token });
-    lock.unlock();
-    cond.notify_one();
+    pushJob({ jobInfo.func, jobInfo.userIndex, jobInfo.userData, token, 0 }, jobInfo.priority);
 }
 
 void enqueueJobs(JobInfo *jobInfos, uint32_t jobsCount, Token token)
 {
     ASSERT(jobInfos);
     ASSERT(jobsCount);
+    ASSERT(threads.size());
 
     if (token)
-        (*(std::atomic_int32_t *)token) += jobsCount;
+        getTokenData(token)->counter.fetch_add(jobsCount, std::memory_order_relaxed);
+
+    uint32_t laneJobCounts[laneCount] = {};
+    uint64_t enqueueTime = getTime();
 
-    std::unique_lock<decltype(spinLock)> lock(spinLock);
     for (uint32_t i = 0; i < jobsCount; i++)
     {
         ASSERT(jobInfos[i].func);
-        jobs.push({ jobInfos[i].func, jobInfos[i].userIndex, jobInfos[i].userData, token });
+        uint32_t lane = getLane(jobInfos[i].priority);
+        pushToThreadQueue(lane, { jobInfos[i].func, jobInfos[i].userIndex, jobInfos[i].userData, token, enqueueTime });
+        laneJobCounts[lane]++;
+    }
+
+    for (uint32_t lane = 0; lane < laneCount; lane++)
+    {
+        if (laneJobCounts[lane])
+            wakeWorkers(lane, laneJobCounts[lane]);
+    }
+}
+
+void enqueueJobAfter(JobInfo jobInfo, Token dependency, Token token)
+{
+    ASSERT(jobInfo.func);
+    ASSERT(dependency && dependency != token);
+    ASSERT(threads.size());
+
+    if (token)
+        getTokenData(token)->counter.fetch_add(1, std::memory_order_relaxed);
+
+    Job job { jobInfo.func, jobInfo.userIndex, jobInfo.userData, token, 0 };
+    Continuation *continuation = (Continuation *)allocateJobData(dependency, sizeof(Continuation));
+    TokenData *dependencyData = getTokenData(dependency);
+    {
+        std::lock_guard<decltype(continuationMutex)> lock(continuationMutex);
+        uint32_t counter = dependencyData->counter.load(std::memory_order_acquire);
+
+        // the flag must be set while jobs are still pending, so that the last of them sees it
+        while (counter & tokenCounterMask)
+        {
+            if (dependencyData->counter.compare_exchange_weak(counter, counter | tokenContinuationBit, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                *continuation = { job, jobInfo.priority, dependencyData->continuations };
+                dependencyData->continuations = continuation;
+                return;
+            }
+        }
+    }
+
+    pushJob(job, jobInfo.priority); // the dependency is already done
+}
+
+void enqueueJobGraph(const JobGraphNode *nodes, uint32_t nodeCount, Token token)
+{
+    ZoneScoped;
+    ASSERT(nodes);
+    ASSERT(nodeCount);
+    ASSERT(token); // the graph lives in the arena of the token
+    ASSERT(threads.size());
+
+    getTokenData(token)->counter.fetch_add(nodeCount, std::memory_order_relaxed);
+
+    JobGraph *graph = (JobGraph *)allocateJobData(token, sizeof(JobGraph));
+    graph->jobInfos = (JobInfo *)allocateJobData(token, nodeCount * sizeof(JobInfo));
+    graph->pendingPredecessorCounts = (std::atomic_uint32_t *)allocateJobData(token, nodeCount * sizeof(std::atomic_uint32_t));
+    graph->successorOffsets = (uint32_t *)allocateJobData(token, (nodeCount + 1) * sizeof(uint32_t));
+    graph->token = token;
+
+    // count the successors of every node, turn the counts into end offsets and fill the lists backwards,
+    // which moves every offset to the start of its list
+    uint32_t edgeCount = 0;
+
+    for (uint32_t i = 0; i <= nodeCount; i++)
+    {
+        graph->successorOffsets[i] = 0;
+    }
+
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        ASSERT(nodes[i].jobInfo.func);
+        ASSERT(!nodes[i].predecessorCount || nodes[i].predecessors);
+        graph->jobInfos[i] = nodes[i].jobInfo;
+        new (&graph->pendingPredecessorCounts[i]) std::atomic_uint32_t(nodes[i].predecessorCount);
+        edgeCount += nodes[i].predecessorCount;
+
+        for (uint32_t j = 0; j < nodes[i].predecessorCount; j++)
+        {
+            ASSERT(nodes[i].predecessors[j] < i && "Predecessors must come first!");
+            graph->successorOffsets[nodes[i].predecessors[j]]++;
+        }
+    }
+
+    for (uint32_t i = 1; i <= nodeCount; i++)
+    {
+        graph->successorOffsets[i] += graph->successorOffsets[i - 1];
+    }
+
+    graph->successors = (uint32_t *)allocateJobData(token, edgeCount * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        for (uint32_t j = 0; j < nodes[i].predecessorCount; j++)
+        {
+            graph->successors[--graph->successorOffsets[nodes[i].predecessors[j]]] = i;
+        }
+    }
+
+    for (uint32_t i = 0; i < nodeCount; i++)
+    {
+        if (!nodes[i].predecessorCount)
+            pushJob({ runGraphNode, i, graph, token, 0 }, nodes[i].jobInfo.priority);
     }
-    lock.unlock();
-    cond.notify_all();
 }
 
-void waitForToken(Token token)
+void waitForToken(Token token, HelpWhileWaiting help)
 {
     ASSERT(token);
-    while (*(std::atomic_int32_t *)token)
-        std::this_thread::yield(); // yes, this is also bad
+    TokenData *tokenData = getTokenData(token);
+    Job job;
+    uint32_t jobLane;
+    uint32_t failedAttempts = 0;
+    uint32_t counter;
+    // background jobs wait on background pieces, if they did not help with them, workers that all wait would starve
+    uint32_t lastHelpLane = currentJobPriority == JobPriority::Background ? backgroundLane : normalLane;
+
+    while ((counter = tokenData->counter.load(std::memory_order_acquire)) & (tokenCounterMask | tokenContinuationBit))
+    {
+        // the jobs run here may belong to other tokens, which is fine as long as they are short,
+        // background ones are left to the workers so that a foreground waiter does not get stuck in a long bake
+        if (help == HelpWhileWaiting::Yes && threads.size() && findJob(job, jobLane, lastHelpLane))
+        {
+            runJob(job, jobLane);
+            failedAttempts = 0;
+            continue;
+        }
+
+        if (++failedAttempts < spinCountBeforeSleep)
+        {
+            CPU_PAUSE();
+            continue;
+        }
+
+        // the remaining jobs are running on other threads, park until the last one finishes
+        ZoneScopedN("Park");
+
+        if (counter & tokenWaiterBit || tokenData->counter.compare_exchange_weak(counter, counter | tokenWaiterBit, std::memory_order_relaxed))
+            futexWait(&tokenData->counter, counter | tokenWaiterBit);
+
+        failedAttempts = 0;
+    }
+
+    // clear the waiter bit, a one shot exchange would leave it set if new jobs were enqueued in the meantime,
+    // all waiters are woken at once, so clearing it under another one is fine
+    if (counter & tokenWaiterBit)
+        tokenData->counter.fetch_and(~tokenWaiterBit, std::memory_order_relaxed);
 }
 
 void terminateJobSystem()
@@ -152,15 +1293,32 @@ void terminateJobSystem()
     if (threads.empty())
         return;
 
-    ASSERT(jobs.empty());
-    std::unique_lock<decltype(spinLock)> lock(spinLock);
+    ASSERT(!hasQueuedJobs(backgroundLane));
     shouldStop = true;
-    lock.unlock();
-    cond.notify_all();
+
+    for (uint32_t i = 0; i < countOf(wakeEpochs); i++)
+    {
+        wakeEpochs[i].fetch_add(1, std::memory_order_seq_cst);
+        futexWake(&wakeEpochs[i], UINT32_MAX);
+    }
 
     for (std::thread &thread : threads)
     {
         thread.join();
     }
     threads.clear();
+
+    delete[] queues;
+    delete[] workerStats;
+    workerStats = nullptr;
+
+    while (freeArenaBlocks)
+    {
+        ArenaBlock *next = freeArenaBlocks->next;
+        delete[] (uint8_t *)freeArenaBlocks;
+        freeArenaBlocks = next;
+    }
+    queues = nullptr;
+    queueCount = 0;
+    threadQueueIndex = -1;
 }
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "Ktx2.hpp"
+#include "Parallel.hpp"
+#include "Utils.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <tracy/Tracy.hpp>
+#include <zstd.h>
+
+// the fixed part of the file, see the KTX 2.0 spec
+struct Ktx2Header
+{
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth, pixelHeight, pixelDepth;
+    uint32_t layerCount, faceCount, levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset, dfdByteLength;
+    uint32_t kvdByteOffset, kvdByteLength;
+    uint64_t sgdByteOffset, sgdByteLength;
+};
+static_assert(sizeof(Ktx2Header) == 80, "");
+
+struct LevelTask
+{
+    const Ktx2File *file;
+    uint8_t *dst;
+    uint8_t level;
+};
+
+Ktx2File openKtx2File(const char *filename)
+{
+    ZoneScoped;
+    ASSERT(isValidString(filename));
+    ZoneText(filename, strlen(filename));
+    static const uint8_t identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+    Ktx2File file {};
+    file.file = mapFile(filename);
+    VERIFY(file.file.data && file.file.size >= sizeof(Ktx2Header));
+
+    Ktx2Header header;
+    memcpy(&header, file.file.data, sizeof(header));
+    VERIFY(!memcmp(header.identifier, identifier, sizeof(identifier)));
+    VERIFY(header.pixelDepth == 0 && header.layerCount == 0); // the writer makes 2D images and cubemaps only
+    VERIFY(header.supercompressionScheme == (uint32_t)Ktx2Supercompression::None || header.supercompressionScheme == (uint32_t)Ktx2Supercompression::Zstd);
+    VERIFY(header.pixelWidth <= UINT16_MAX && header.pixelHeight <= UINT16_MAX);
+    VERIFY(header.faceCount == 1 || header.faceCount == 6);
+
+    file.vkFormat = header.vkFormat;
+    file.width = (uint16_t)header.pixelWidth;
+    file.height = (uint16_t)header.pixelHeight;
+    file.faceCount = (uint8_t)header.faceCount;
+    file.levelCount = (uint8_t)max(header.levelCount, 1u);
+    file.supercompression = (Ktx2Supercompression)header.supercompressionScheme;
+
+    VERIFY(sizeof(Ktx2Header) + file.levelCount * sizeof(Ktx2Level) <= file.file.size);
+    file.levels = (const Ktx2Level *)(file.file.data + sizeof(Ktx2Header));
+    uint64_t dataSize = 0;
+
+    for (uint8_t i = 0; i < file.levelCount; i++)
+    {
+        const Ktx2Level &level = file.levels[i];
+        VERIFY(level.byteOffset + level.byteLength <= file.file.size);
+        VERIFY(file.supercompression != Ktx2Supercompression::None || level.byteLength == level.uncompressedByteLength);
+        dataSize += level.uncompressedByteLength;
+    }
+
+    VERIFY(dataSize <= UINT32_MAX);
+    file.dataSize = (uint32_t)dataSize;
+
+    return file;
+}
+
+void closeKtx2File(Ktx2File &file)
+{
+    unmapFile(file.file);
+    file = {};
+}
+
+static void readLevels(uint32_t begin, uint32_t end, void *userData)
+{
+    const LevelTask *tasks = (const LevelTask *)userData;
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        ZoneScopedN("Read Level");
+        const LevelTask &task = tasks[i];
+        const Ktx2Level &level = task.file->levels[task.level];
+        const uint8_t *src = task.file->file.data + level.byteOffset;
+
+        if (task.file->supercompression == Ktx2Supercompression::Zstd)
+        {
+            size_t size = ZSTD_decompress(task.dst, (size_t)level.uncompressedByteLength, src, (size_t)level.byteLength);
+            VERIFY(!ZSTD_isError(size) && size == level.uncompressedByteLength);
+        }
+        else
+        {
+            memcpy(task.dst, src, (size_t)level.byteLength);
+        }
+    }
+}
+
+void readKtx2Levels(const Ktx2File *files, uint8_t *const *dsts, uint32_t fileCount)
+{
+    ZoneScoped;
+    ASSERT(files && dsts && fileCount);
+    std::vector<LevelTask> tasks;
+
+    for (uint32_t i = 0; i < fileCount; i++)
+    {
+        ASSERT(files[i].file.data && dsts[i]);
+        uint8_t *dst = dsts[i];
+
+        for (uint8_t level = 0; level < files[i].levelCount; level++)
+        {
+            tasks.push_back({ files + i, dst, level });
+            dst += files[i].levels[level].uncompressedByteLength;
+        }
+    }
+
+    // the first level is 3/4 of an image, starting the biggest ones first keeps the tail short
+    std::stable_sort(tasks.begin(), tasks.end(), [](const LevelTask &a, const LevelTask &b)
+    {
+        return a.file->levels[a.level].uncompressedByteLength > b.file->levels[b.level].uncompressedByteLength;
+    });
+    parallelFor(0, (uint32_t)tasks.size(), 1, readLevels, tasks.data());
+}
\ No newline at end of file
@@ -0,0 +1,695 @@
+#include "MipGeneration.hpp"
+#include "Parallel.hpp"
+#include "Utils.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <tracy/Tracy.hpp>
+
+static constexpr uint32_t maxTapCount = 6;
+static constexpr uint32_t rowPadding = 3; // texels replicated on both sides of a vertically filtered row, enough for every tap
+static constexpr uint32_t rowCacheSize = maxTapCount; // the taps of a destination row are consecutive, so they never share a slot
+static constexpr uint32_t minTexelsPerJob = 16 * 1024;
+static constexpr float maxHalf = 65504.f;
+static constexpr double pi = 3.14159265358979323846;
+
+// separable, tap k of destination texel x reads source texel 2 * x + firstTap + k
+struct MipKernel
+{
+    uint32_t tapCount;
+    int32_t firstTap;
+    float weights[maxTapCount];
+};
+
+static MipKernel boxKernel;
+static MipKernel kaiserKernel;
+static float srgbToLinearTable[256];
+static uint8_t linearToSrgbTable[65536]; // indexed by the linear value in 16 bits, finer than the sRGB steps near 0
+static bool initialized = false;
+
+struct MipLevelContext
+{
+    const uint8_t *src; // face 0
+    uint8_t *dst;
+    uint32_t srcFaceSize;
+    uint32_t dstFaceSize;
+    uint16_t srcWidth;
+    uint16_t srcHeight;
+    uint16_t dstWidth;
+    uint16_t dstHeight;
+    MipTexelFormat format;
+    const MipKernel *kernel;
+};
+
+static inline uint32_t getTexelSize(MipTexelFormat format)
+{
+    return format == MipTexelFormat::Rgba16Float ? 4 * sizeof(uint16_t) : 4;
+}
+
+#pragma region Conversions
+static inline float halfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1F;
+    uint32_t mantissa = half & 0x3FF;
+
+    if (exponent == 0) // subnormal
+    {
+        float value = mantissa * (1.f / 16777216.f);
+        return sign ? -value : value;
+    }
+
+    uint32_t bits = sign | (exponent == 31 ? 0x7F800000 | mantissa << 13 : (exponent + 112) << 23 | mantissa << 13);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// value must be in [0, maxHalf], rounds to the nearest even like F16C
+static inline uint16_t floatToHalf(float value)
+{
+    if (value < 6.103515625e-05f) // subnormal, the result may round up to the smallest normal, which is encoded right too
+        return (uint16_t)lrintf(value * 16777216.f);
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits += 0xFFF + ((bits >> 13) & 1);
+    return (uint16_t)((bits >> 13) - (112 << 10));
+}
+
+static inline float clampHalf(float value)
+{
+    return value > 0.f ? (value < maxHalf ? value : maxHalf) : 0.f; // NaN goes to 0 too
+}
+
+static inline uint8_t encodeUnorm(float value)
+{
+    return (uint8_t)(value > 0.f ? (value < 1.f ? value : 1.f) * 255.f + 0.5f : 0.5f);
+}
+
+static inline uint8_t encodeSrgb(float value)
+{
+    return linearToSrgbTable[(uint32_t)(value > 0.f ? (value < 1.f ? value : 1.f) * 65535.f + 0.5f : 0.5f)];
+}
+
+static inline void normalize3(float *texel)
+{
+    float lengthSquared = texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2];
+
+    if (lengthSquared > 0.f)
+    {
+        float scale = 1.f / sqrtf(lengthSquared);
+        texel[0] *= scale;
+        texel[1] *= scale;
+        texel[2] *= scale;
+    }
+    else // the average of opposite normals, pick the unperturbed one
+    {
+        texel[0] = 0.f;
+        texel[1] = 0.f;
+        texel[2] = 1.f;
+    }
+}
+#pragma endregion
+
+#pragma region Scalar
+// src holds texelCount texels of the format, dst 4 floats per texel
+static void decodeRowScalar(const uint8_t *src, float *dst, uint32_t texelCount, MipTexelFormat format)
+{
+    switch (format)
+    {
+    case MipTexelFormat::Rgba8Unorm:
+        for (uint32_t i = 0; i < texelCount * 4; i++)
+        {
+            dst[i] = src[i] * (1.f / 255.f);
+        }
+        break;
+    case MipTexelFormat::Rgba8Srgb:
+        for (uint32_t i = 0; i < texelCount * 4; i += 4)
+        {
+            dst[i + 0] = srgbToLinearTable[src[i + 0]];
+            dst[i + 1] = srgbToLinearTable[src[i + 1]];
+            dst[i + 2] = srgbToLinearTable[src[i + 2]];
+            dst[i + 3] = src[i + 3] * (1.f / 255.f);
+        }
+        break;
+    case MipTexelFormat::Rgba8Normal:
+        for (uint32_t i = 0; i < texelCount * 4; i += 4)
+        {
+            dst[i + 0] = src[i + 0] * (2.f / 255.f) - 1.f;
+            dst[i + 1] = src[i + 1] * (2.f / 255.f) - 1.f;
+            dst[i + 2] = src[i + 2] * (2.f / 255.f) - 1.f;
+            dst[i + 3] = src[i + 3] * (1.f / 255.f);
+        }
+        break;
+    case MipTexelFormat::Rgba16Float:
+        for (uint32_t i = 0; i < texelCount * 4; i++)
+        {
+            dst[i] = halfToFloat(((const uint16_t *)src)[i]);
+        }
+        break;
+    }
+}
+
+// dst = weight * src for the first tap, dst += weight * src for the rest
+static void accumulateRowScalar(float *dst, const float *src, float weight, uint32_t floatCount, bool firstTap)
+{
+    for (uint32_t i = 0; i < floatCount; i++)
+    {
+        dst[i] = (firstTap ? 0.f : dst[i]) + weight * src[i];
+    }
+}
+
+// src is padded, so the taps of the edge texels stay in bounds
+static void filterRowScalar(const float *src, float *dst, uint32_t dstTexelCount, const MipKernel &kernel)
+{
+    for (uint32_t x = 0; x < dstTexelCount; x++)
+    {
+        const float *srcTexel = src + (int32_t)(2 * x + kernel.firstTap) * 4;
+        float sum[4] {};
+
+        for (uint32_t k = 0; k < kernel.tapCount; k++, srcTexel += 4)
+        {
+            for (uint32_t c = 0; c < 4; c++)
+            {
+                sum[c] += kernel.weights[k] * srcTexel[c];
+            }
+        }
+
+        memcpy(dst + x * 4, sum, sizeof(sum));
+    }
+}
+
+// src is modified for normal maps
+static void encodeRowScalar(float *src, uint8_t *dst, uint32_t texelCount, MipTexelFormat format)
+{
+    switch (format)
+    {
+    case MipTexelFormat::Rgba8Unorm:
+        for (uint32_t i = 0; i < texelCount * 4; i++)
+        {
+            dst[i] = encodeUnorm(src[i]);
+        }
+        break;
+    case MipTexelFormat::Rgba8Srgb:
+        for (uint32_t i = 0; i < texelCount * 4; i += 4)
+        {
+            dst[i + 0] = encodeSrgb(src[i + 0]);
+            dst[i + 1] = encodeSrgb(src[i + 1]);
+            dst[i + 2] = encodeSrgb(src[i + 2]);
+            dst[i + 3] = encodeUnorm(src[i + 3]);
+        }
+        break;
+    case MipTexelFormat::Rgba8Normal:
+        for (uint32_t i = 0; i < texelCount * 4; i += 4)
+        {
+            normalize3(src + i);
+            dst[i + 0] = encodeUnorm(src[i + 0] * 0.5f + 0.5f);
+            dst[i + 1] = encodeUnorm(src[i + 1] * 0.5f + 0.5f);
+            dst[i + 2] = encodeUnorm(src[i + 2] * 0.5f + 0.5f);
+            dst[i + 3] = encodeUnorm(src[i + 3]);
+        }
+        break;
+    case MipTexelFormat::Rgba16Float:
+        for (uint32_t i = 0; i < texelCount * 4; i++)
+        {
+            ((uint16_t *)dst)[i] = floatToHalf(clampHalf(src[i]));
+        }
+        break;
+    }
+}
+
+// in place, the math of normalizeNormalMap.comp step by step, so that every instruction set gives the same bytes,
+// the length is never 0 since no 8 bit value maps to 0 exactly
+static void renormalizeRowScalar(uint8_t *rgba, uint32_t texelCount)
+{
+    for (uint32_t i = 0; i < texelCount * 4; i += 4)
+    {
+        float x = rgba[i + 0] / 255.f * 2.f - 1.f;
+        float y = rgba[i + 1] / 255.f * 2.f - 1.f;
+        float z = rgba[i + 2] / 255.f * 2.f - 1.f;
+        float scale = 1.f / sqrtf(x * x + y * y + z * z);
+        rgba[i + 0] = encodeUnorm(0.5f * (x * scale + 1.f));
+        rgba[i + 1] = encodeUnorm(0.5f * (y * scale + 1.f));
+        rgba[i + 2] = encodeUnorm(0.5f * (z * scale + 1.f));
+    }
+}
+#pragma endregion
+
+#pragma region SSE4.1
+// 8 bit formats as 4 lanes per texel, the scalar code handles the rest
+TARGET_SSE41 static void decodeRowSse41(const uint8_t *src, float *dst, uint32_t texelCount, MipTexelFormat format)
+{
+    if (format != MipTexelFormat::Rgba8Unorm && format != MipTexelFormat::Rgba8Normal)
+    {
+        decodeRowScalar(src, dst, texelCount, format);
+        return;
+    }
+
+    bool normal = format == MipTexelFormat::Rgba8Normal;
+    __m128 scale = normal ? _mm_setr_ps(2.f / 255.f, 2.f / 255.f, 2.f / 255.f, 1.f / 255.f) : _mm_set1_ps(1.f / 255.f);
+    __m128 bias = normal ? _mm_setr_ps(-1.f, -1.f, -1.f, 0.f) : _mm_setzero_ps();
+
+    for (uint32_t i = 0; i < texelCount; i++)
+    {
+        int32_t texel;
+        memcpy(&texel, src + i * 4, sizeof(texel));
+        __m128 value = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(texel)));
+        _mm_storeu_ps(dst + i * 4, _mm_add_ps(_mm_mul_ps(value, scale), bias));
+    }
+}
+
+TARGET_SSE41 static void accumulateRowSse41(float *dst, const float *src, float weight, uint32_t floatCount, bool firstTap)
+{
+    __m128 w = _mm_set1_ps(weight);
+
+    for (uint32_t i = 0; i < floatCount; i += 4) // whole texels
+    {
+        __m128 sum = _mm_mul_ps(w, _mm_loadu_ps(src + i));
+        _mm_storeu_ps(dst + i, firstTap ? sum : _mm_add_ps(_mm_loadu_ps(dst + i), sum));
+    }
+}
+
+TARGET_SSE41 static void filterRowSse41(const float *src, float *dst, uint32_t dstTexelCount, const MipKernel &kernel)
+{
+    for (uint32_t x = 0; x < dstTexelCount; x++)
+    {
+        const float *srcTexel = src + (int32_t)(2 * x + kernel.firstTap) * 4;
+        __m128 sum = _mm_setzero_ps();
+
+        for (uint32_t k = 0; k < kernel.tapCount; k++, srcTexel += 4)
+        {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(kernel.weights[k]), _mm_loadu_ps(srcTexel)));
+        }
+
+        _mm_storeu_ps(dst + x * 4, sum);
+    }
+}
+
+// clamps to [0, 1] and rounds to 8 bits
+TARGET_SSE41 static inline void storeUnormSse41(__m128 value, uint8_t *dst)
+{
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    __m128i integers = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+    integers = _mm_packus_epi16(_mm_packus_epi32(integers, integers), integers);
+    int32_t texel = _mm_cvtsi128_si32(integers);
+    memcpy(dst, &texel, sizeof(texel));
+}
+
+TARGET_SSE41 static void encodeRowSse41(float *src, uint8_t *dst, uint32_t texelCount, MipTexelFormat format)
+{
+    switch (format)
+    {
+    case MipTexelFormat::Rgba8Unorm:
+        for (uint32_t i = 0; i < texelCount; i++)
+        {
+            storeUnormSse41(_mm_loadu_ps(src + i * 4), dst + i * 4);
+        }
+        break;
+    case MipTexelFormat::Rgba8Normal:
+        for (uint32_t i = 0; i < texelCount; i++)
+        {
+            __m128 value = _mm_loadu_ps(src + i * 4);
+            __m128 lengthSquared = _mm_dp_ps(value, value, 0x7F);
+
+            if (_mm_cvtss_f32(lengthSquared) > 0.f)
+                value = _mm_blend_ps(_mm_div_ps(value, _mm_sqrt_ps(lengthSquared)), value, 0x8);
+            else
+                value = _mm_blend_ps(_mm_setr_ps(0.f, 0.f, 1.f, 0.f), value, 0x8);
+
+            value = _mm_add_ps(_mm_mul_ps(value, _mm_setr_ps(0.5f, 0.5f, 0.5f, 1.f)), _mm_setr_ps(0.5f, 0.5f, 0.5f, 0.f));
+            storeUnormSse41(value, dst + i * 4);
+        }
+        break;
+    default:
+        encodeRowScalar(src, dst, texelCount, format);
+        break;
+    }
+}
+
+TARGET_SSE41 static inline __m128 decodeSnormSse41(__m128i texels, int32_t shift)
+{
+    __m128 value = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(texels, shift), _mm_set1_epi32(0xFF)));
+    return _mm_sub_ps(_mm_mul_ps(_mm_div_ps(value, _mm_set1_ps(255.f)), _mm_set1_ps(2.f)), _mm_set1_ps(1.f));
+}
+
+TARGET_SSE41 static inline __m128i encodeSnormSse41(__m128 value, int32_t shift)
+{
+    value = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_add_ps(value, _mm_set1_ps(1.f)));
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    __m128i integers = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+    return _mm_slli_epi32(integers, shift);
+}
+
+// 4 texels at once, a lane per texel
+TARGET_SSE41 static void renormalizeRowSse41(uint8_t *rgba, uint32_t texelCount)
+{
+    uint32_t i = 0;
+
+    for (; i + 4 <= texelCount; i += 4)
+    {
+        __m128i texels = _mm_loadu_si128((const __m128i *)(rgba + i * 4));
+        __m128 x = decodeSnormSse41(texels, 0);
+        __m128 y = decodeSnormSse41(texels, 8);
+        __m128 z = decodeSnormSse41(texels, 16);
+        __m128 lengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        __m128 scale = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(lengthSquared));
+        __m128i result = _mm_and_si128(texels, _mm_set1_epi32((int32_t)0xFF000000));
+        result = _mm_or_si128(result, encodeSnormSse41(_mm_mul_ps(x, scale), 0));
+        result = _mm_or_si128(result, encodeSnormSse41(_mm_mul_ps(y, scale), 8));
+        result = _mm_or_si128(result, encodeSnormSse41(_mm_mul_ps(z, scale), 16));
+        _mm_storeu_si128((__m128i *)(rgba + i * 4), result);
+    }
+
+    renormalizeRowScalar(rgba + i * 4, texelCount - i);
+}
+#pragma endregion
+
+#pragma region AVX2
+// two texels per register, F16C for the half floats
+TARGET_AVX2 static void decodeRowAvx2(const uint8_t *src, float *dst, uint32_t texelCount, MipTexelFormat format)
+{
+    if (format != MipTexelFormat::Rgba16Float)
+    {
+        decodeRowSse41(src, dst, texelCount, format);
+        return;
+    }
+
+    const uint16_t *halfs = (const uint16_t *)src;
+    uint32_t i = 0;
+
+    for (; i + 2 <= texelCount; i += 2)
+    {
+        _mm256_storeu_ps(dst + i * 4, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(halfs + i * 4))));
+    }
+
+    if (i < texelCount)
+        _mm_storeu_ps(dst + i * 4, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)(halfs + i * 4))));
+}
+
+TARGET_AVX2 static void accumulateRowAvx2(float *dst, const float *src, float weight, uint32_t floatCount, bool firstTap)
+{
+    __m256 w = _mm256_set1_ps(weight);
+    uint32_t i = 0;
+
+    for (; i + 8 <= floatCount; i += 8)
+    {
+        __m256 sum = _mm256_mul_ps(w, _mm256_loadu_ps(src + i));
+        _mm256_storeu_ps(dst + i, firstTap ? sum : _mm256_add_ps(_mm256_loadu_ps(dst + i), sum));
+    }
+
+    if (i < floatCount) // one texel left
+    {
+        __m128 sum = _mm_mul_ps(_mm256_castps256_ps128(w), _mm_loadu_ps(src + i));
+        _mm_storeu_ps(dst + i, firstTap ? sum : _mm_add_ps(_mm_loadu_ps(dst + i), sum));
+    }
+}
+
+TARGET_AVX2 static void filterRowAvx2(const float *src, float *dst, uint32_t dstTexelCount, const MipKernel &kernel)
+{
+    uint32_t x = 0;
+
+    for (; x + 2 <= dstTexelCount; x += 2) // the taps of the second texel start 2 source texels later
+    {
+        const float *srcTexel = src + (int32_t)(2 * x + kernel.firstTap) * 4;
+        __m256 sum = _mm256_setzero_ps();
+
+        for (uint32_t k = 0; k < kernel.tapCount; k++, srcTexel += 4)
+        {
+            __m256 taps = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(srcTexel)), _mm_loadu_ps(srcTexel + 8), 1);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(kernel.weights[k]), taps));
+        }
+
+        _mm256_storeu_ps(dst + x * 4, sum);
+    }
+
+    if (x < dstTexelCount)
+        filterRowSse41(src + x * 2 * 4, dst + x * 4, dstTexelCount - x, kernel);
+}
+
+TARGET_AVX2 static void encodeRowAvx2(float *src, uint8_t *dst, uint32_t texelCount, MipTexelFormat format)
+{
+    if (format != MipTexelFormat::Rgba16Float)
+    {
+        encodeRowSse41(src, dst, texelCount, format);
+        return;
+    }
+
+    uint16_t *halfs = (uint16_t *)dst;
+    __m256 zero = _mm256_setzero_ps();
+    __m256 maxValue = _mm256_set1_ps(maxHalf);
+    uint32_t i = 0;
+
+    for (; i + 2 <= texelCount; i += 2)
+    {
+        __m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i * 4), zero), maxValue); // NaN goes to 0 too
+        _mm_storeu_si128((__m128i *)(halfs + i * 4), _mm256_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT));
+    }
+
+    if (i < texelCount)
+    {
+        __m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i * 4), _mm_setzero_ps()), _mm_set1_ps(maxHalf));
+        _mm_storel_epi64((__m128i *)(halfs + i * 4), _mm_cvtps_ph(value, _MM_FROUND_TO_NEAREST_INT));
+    }
+}
+
+TARGET_AVX2 static inline __m256 decodeSnormAvx2(__m256i texels, int32_t shift)
+{
+    __m256 value = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(texels, shift), _mm256_set1_epi32(0xFF)));
+    return _mm256_sub_ps(_mm256_mul_ps(_mm256_div_ps(value, _mm256_set1_ps(255.f)), _mm256_set1_ps(2.f)), _mm256_set1_ps(1.f));
+}
+
+TARGET_AVX2 static inline __m256i encodeSnormAvx2(__m256 value, int32_t shift)
+{
+    value = _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_add_ps(value, _mm256_set1_ps(1.f)));
+    value = _mm256_min_ps(_mm256_max_ps(value, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+    __m256i integers = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(255.f)), _mm256_set1_ps(0.5f)));
+    return _mm256_slli_epi32(integers, shift);
+}
+
+// 8 texels at once, no FMA so that the rounding matches the other paths
+TARGET_AVX2 static void renormalizeRowAvx2(uint8_t *rgba, uint32_t texelCount)
+{
+    uint32_t i = 0;
+
+    for (; i + 8 <= texelCount; i += 8)
+    {
+        __m256i texels = _mm256_loadu_si256((const __m256i *)(rgba + i * 4));
+        __m256 x = decodeSnormAvx2(texels, 0);
+        __m256 y = decodeSnormAvx2(texels, 8);
+        __m256 z = decodeSnormAvx2(texels, 16);
+        __m256 lengthSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+        __m256 scale = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_sqrt_ps(lengthSquared));
+        __m256i result = _mm256_and_si256(texels, _mm256_set1_epi32((int32_t)0xFF000000));
+        result = _mm256_or_si256(result, encodeSnormAvx2(_mm256_mul_ps(x, scale), 0));
+        result = _mm256_or_si256(result, encodeSnormAvx2(_mm256_mul_ps(y, scale), 8));
+        result = _mm256_or_si256(result, encodeSnormAvx2(_mm256_mul_ps(z, scale), 16));
+        _mm256_storeu_si256((__m256i *)(rgba + i * 4), result);
+    }
+
+    renormalizeRowSse41(rgba + i * 4, texelCount - i);
+}
+#pragma endregion
+
+typedef void (*DecodeRowFunc)(const uint8_t *src, float *dst, uint32_t texelCount, MipTexelFormat format);
+typedef void (*AccumulateRowFunc)(float *dst, const float *src, float weight, uint32_t floatCount, bool firstTap);
+typedef void (*FilterRowFunc)(const float *src, float *dst, uint32_t dstTexelCount, const MipKernel &kernel);
+typedef void (*EncodeRowFunc)(float *src, uint8_t *dst, uint32_t texelCount, MipTexelFormat format);
+typedef void (*RenormalizeRowFunc)(uint8_t *rgba, uint32_t texelCount);
+
+static DecodeRowFunc decodeRow = decodeRowScalar;
+static AccumulateRowFunc accumulateRow = accumulateRowScalar;
+static FilterRowFunc filterRow = filterRowScalar;
+static EncodeRowFunc encodeRow = encodeRowScalar;
+static RenormalizeRowFunc renormalizeRow = renormalizeRowScalar;
+
+// rows of all faces form a single range, the decoded source rows are cached since consecutive destination rows share taps
+static void generateMipRows(uint32_t begin, uint32_t end, void *userData)
+{
+    ZoneScoped;
+    ASSERT(userData);
+    const MipLevelContext &context = *(const MipLevelContext *)userData;
+    const MipKernel &kernel = *context.kernel;
+    uint32_t texelSize = getTexelSize(context.format);
+    uint32_t paddedWidth = context.srcWidth + 2 * rowPadding;
+
+    float *memory = new float[(rowCacheSize * context.srcWidth + paddedWidth + context.dstWidth) * 4];
+    float *cachedRows = memory;
+    float *filteredRow = cachedRows + rowCacheSize * context.srcWidth * 4; // vertically
+    float *dstRow = filteredRow + paddedWidth * 4;
+    int32_t cachedRowIndices[rowCacheSize];
+    uint32_t cachedFace = UINT32_MAX;
+
+    for (uint32_t row = begin; row < end; row++)
+    {
+        uint32_t face = row / context.dstHeight;
+        uint32_t y = row % context.dstHeight;
+        const uint8_t *src = context.src + face * context.srcFaceSize;
+
+        if (face != cachedFace)
+        {
+            memset(cachedRowIndices, 255, sizeof(cachedRowIndices));
+            cachedFace = face;
+        }
+
+        for (uint32_t k = 0; k < kernel.tapCount; k++)
+        {
+            int32_t srcY = (int32_t)(2 * y) + kernel.firstTap + (int32_t)k;
+            srcY = srcY < 0 ? 0 : (srcY < context.srcHeight ? srcY : context.srcHeight - 1);
+            float *cachedRow = cachedRows + (srcY % rowCacheSize) * context.srcWidth * 4;
+
+            if (cachedRowIndices[srcY % rowCacheSize] != srcY)
+            {
+                decodeRow(src + srcY * context.srcWidth * texelSize, cachedRow, context.srcWidth, context.format);
+                cachedRowIndices[srcY % rowCacheSize] = srcY;
+            }
+
+            accumulateRow(filteredRow + rowPadding * 4, cachedRow, kernel.weights[k], context.srcWidth * 4, k == 0);
+        }
+
+        for (uint32_t i = 0; i < rowPadding; i++) // clamp to the edges
+        {
+            memcpy(filteredRow + i * 4, filteredRow + rowPadding * 4, 4 * sizeof(float));
+            memcpy(filteredRow + (rowPadding + context.srcWidth + i) * 4, filteredRow + (rowPadding + context.srcWidth - 1) * 4, 4 * sizeof(float));
+        }
+
+        filterRow(filteredRow + rowPadding * 4, dstRow, context.dstWidth, kernel);
+        encodeRow(dstRow, context.dst + face * context.dstFaceSize + y * context.dstWidth * texelSize, context.dstWidth, context.format);
+    }
+
+    delete[] memory;
+}
+
+static double besselI0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+
+    for (uint32_t k = 1; k < 32; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+static void initKernels()
+{
+    boxKernel = { 2, 0, { 0.5f, 0.5f } };
+
+    static constexpr double kaiserAlpha = 4.0;
+    static constexpr double kaiserRadius = maxTapCount / 2; // in source texels
+    kaiserKernel.tapCount = maxTapCount;
+    kaiserKernel.firstTap = -(int32_t)(maxTapCount / 2 - 1);
+    double sum = 0.0;
+    double weights[maxTapCount];
+
+    for (uint32_t k = 0; k < maxTapCount; k++)
+    {
+        double distance = (int32_t)k + kaiserKernel.firstTap + 0.5 - 1.0; // from the center of the destination texel, in source texels
+        double t = distance / 2.0; // in destination texels
+        double sinc = sin(pi * t) / (pi * t);
+        double ratio = distance / kaiserRadius;
+        weights[k] = sinc * besselI0(kaiserAlpha * sqrt(1.0 - ratio * ratio)) / besselI0(kaiserAlpha);
+        sum += weights[k];
+    }
+
+    for (uint32_t k = 0; k < maxTapCount; k++)
+    {
+        kaiserKernel.weights[k] = (float)(weights[k] / sum);
+    }
+}
+
+static void initSrgbTables()
+{
+    for (uint32_t i = 0; i < countOf(srgbToLinearTable); i++)
+    {
+        float value = i / 255.f;
+        srgbToLinearTable[i] = value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+    }
+
+    for (uint32_t i = 0; i < countOf(linearToSrgbTable); i++)
+    {
+        float value = i / 65535.f;
+        value = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.f / 2.4f) - 0.055f;
+        linearToSrgbTable[i] = (uint8_t)(value * 255.f + 0.5f);
+    }
+}
+
+void initMipGeneration(SimdIsa maxIsa)
+{
+    initKernels();
+    initSrgbTables();
+
+    switch ((SimdIsa)min((uint32_t)getMaxSimdIsa(), (uint32_t)maxIsa))
+    {
+    case SimdIsa::Scalar:
+        decodeRow = decodeRowScalar;
+        accumulateRow = accumulateRowScalar;
+        filterRow = filterRowScalar;
+        encodeRow = encodeRowScalar;
+        renormalizeRow = renormalizeRowScalar;
+        break;
+    case SimdIsa::Sse41:
+        decodeRow = decodeRowSse41;
+        accumulateRow = accumulateRowSse41;
+        filterRow = filterRowSse41;
+        encodeRow = encodeRowSse41;
+        renormalizeRow = renormalizeRowSse41;
+        break;
+    case SimdIsa::Avx2:
+        decodeRow = decodeRowAvx2;
+        accumulateRow = accumulateRowAvx2;
+        filterRow = filterRowAvx2;
+        encodeRow = encodeRowAvx2;
+        renormalizeRow = renormalizeRowAvx2;
+        break;
+    }
+
+    initialized = true;
+}
+
+void generateMips(uint8_t *data, uint16_t width, uint16_t height, uint8_t faceCount, uint8_t levelCount, MipTexelFormat format, MipFilter filter)
+{
+    ZoneScoped;
+    ASSERT(initialized);
+    ASSERT(data && width && height && faceCount && levelCount);
+    uint32_t texelSize = getTexelSize(format);
+
+    MipLevelContext context {};
+    context.src = data;
+    context.srcWidth = width;
+    context.srcHeight = height;
+    context.format = format;
+    context.kernel = filter == MipFilter::Kaiser ? &kaiserKernel : &boxKernel;
+
+    for (uint8_t i = 1; i < levelCount; i++)
+    {
+        ASSERT(context.srcWidth > 1 || context.srcHeight > 1);
+        context.dstWidth = (uint16_t)max(context.srcWidth / 2, 1);
+        context.dstHeight = (uint16_t)max(context.srcHeight / 2, 1);
+        context.srcFaceSize = context.srcWidth * context.srcHeight * texelSize;
+        context.dstFaceSize = context.dstWidth * context.dstHeight * texelSize;
+        context.dst = (uint8_t *)context.src + context.srcFaceSize * faceCount;
+
+        uint32_t rowsPerJob = max(minTexelsPerJob / context.dstWidth, 1);
+        parallelFor(0, faceCount * context.dstHeight, rowsPerJob, generateMipRows, &context);
+
+        context.src = context.dst;
+        context.srcWidth = context.dstWidth;
+        context.srcHeight = context.dstHeight;
+    }
+}
+
+void renormalizeNormals(uint8_t *rgba, uint32_t texelCount)
+{
+    ZoneScoped;
+    ASSERT(initialized);
+    ASSERT(rgba && texelCount);
+    parallelFor(0, texelCount, minTexelsPerJob, [](uint32_t begin, uint32_t end, void *userData)
+    {
+        renormalizeRow((uint8_t *)userData + begin * 4, end - begin);
+    }, rgba);
+}
\ No newline at end of file
@@ -0,0 +1,232 @@
+#include "Parallel.hpp"
+#include "JobSystem.hpp"
+#include "Utils.hpp"
+
+#include <string.h>
+
+#include <tracy/Tracy.hpp>
+
+static constexpr uint32_t chunksPerThread = 8; // enough pieces to balance uneven work without drowning in jobs
+static constexpr uint32_t scanGrainSize = 16 * 1024;
+
+struct ParallelForContext
+{
+    RangeFunc func;
+    void *userData;
+    uint32_t grainSize;
+    Token token;
+    Token parentToken; // the token of the job that called parallelFor, cancelling it cancels the loop too
+    JobPriority priority; // of the job that called parallelFor, so the pieces of a bake do not hold up frame work
+};
+
+static inline int64_t packRange(uint32_t begin, uint32_t end)
+{
+    return (int64_t)((uint64_t)end << 32 | begin);
+}
+
+static uint32_t getAutoGrainSize(uint32_t count)
+{
+    return max(count / (max(getWorkerThreadCount(), 1) * chunksPerThread), 1);
+}
+
+static void splitAndRun(uint32_t begin, uint32_t end, ParallelForContext &context);
+
+static void parallelForJob(int64_t userIndex, void *userData)
+{
+    ASSERT(userData);
+    splitAndRun((uint32_t)userIndex, (uint32_t)((uint64_t)userIndex >> 32), *(ParallelForContext *)userData);
+}
+
+static void splitAndRun(uint32_t begin, uint32_t end, ParallelForContext &context)
+{
+    if (context.parentToken && isCancelled(context.parentToken))
+    {
+        cancelToken(context.token); // drops the pieces that are still queued
+        return;
+    }
+
+    // hand the upper half to the thieves and keep splitting the lower one, the owner then runs the pieces in LIFO order
+    // which keeps them close to each other in memory
+    while (end - begin > context.grainSize)
+    {
+        uint32_t middle = begin + (end - begin) / 2;
+        enqueueJob({ parallelForJob, packRange(middle, end), &context, context.priority }, context.token);
+        end = middle;
+    }
+
+    context.func(begin, end, context.userData);
+}
+
+// token may already hold job data of the caller, it is only waited on here and stays cancelled if the loop was
+static bool parallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, RangeFunc func, void *userData, Token token)
+{
+    ParallelForContext context { func, userData, grainSize, token, getCurrentJobToken(), getCurrentJobPriority() };
+    splitAndRun(begin, end, context);
+    waitForToken(token);
+
+    return !isCancelled(token); // the caller may still be cancelled now, but then all pieces have run anyway
+}
+
+bool parallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, RangeFunc func, void *userData)
+{
+    ZoneScoped;
+    ASSERT(func);
+    ASSERT(begin <= end);
+
+    if (begin == end)
+        return true;
+
+    if (!grainSize)
+        grainSize = getAutoGrainSize(end - begin);
+
+    if (end - begin <= grainSize)
+    {
+        func(begin, end, userData);
+        return true;
+    }
+
+    Token token = createToken();
+    bool done = parallelFor(begin, end, grainSize, func, userData, token);
+    destroyToken(token);
+
+    return done;
+}
+
+struct ParallelReduceContext
+{
+    ReduceRangeFunc reduceFunc;
+    void *userData;
+    uint8_t *partials;
+    uint32_t resultSize;
+    uint32_t begin;
+    uint32_t end;
+    uint32_t grainSize;
+};
+
+static void reduceChunks(uint32_t chunkBegin, uint32_t chunkEnd, void *userData)
+{
+    ParallelReduceContext &context = *(ParallelReduceContext *)userData;
+
+    for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+    {
+        uint32_t begin = context.begin + i * context.grainSize;
+        uint32_t end = min(begin + context.grainSize, context.end);
+        context.reduceFunc(begin, end, context.partials + i * context.resultSize, context.userData);
+    }
+}
+
+bool parallelReduce(uint32_t begin, uint32_t end, uint32_t grainSize, void *result, uint32_t resultSize, ReduceRangeFunc reduceFunc, JoinFunc joinFunc, void *userData)
+{
+    ZoneScoped;
+    ASSERT(result && resultSize);
+    ASSERT(reduceFunc && joinFunc);
+    ASSERT(begin <= end);
+
+    if (begin == end)
+        return true;
+
+    if (!grainSize)
+        grainSize = getAutoGrainSize(end - begin);
+
+    // fixed chunks instead of recursive splitting, so the partials can be joined in a deterministic order
+    uint32_t chunkCount = (end - begin + grainSize - 1) / grainSize;
+
+    if (chunkCount == 1)
+    {
+        reduceFunc(begin, end, result, userData);
+        return true;
+    }
+
+    Token token = createToken();
+    uint8_t *partials = (uint8_t *)allocateJobData(token, chunkCount * resultSize);
+
+    for (uint32_t i = 0; i < chunkCount; i++)
+    {
+        memcpy(partials + i * resultSize, result, resultSize);
+    }
+
+    ParallelReduceContext context { reduceFunc, userData, partials, resultSize, begin, end, grainSize };
+    bool done = parallelFor(0, chunkCount, 1, reduceChunks, &context, token);
+
+    for (uint32_t i = 0; i < chunkCount && done; i++) // the partials of dropped chunks were never computed
+    {
+        joinFunc(result, partials + i * resultSize, userData);
+    }
+
+    destroyToken(token);
+
+    return done;
+}
+
+struct ParallelScanContext
+{
+    const uint32_t *src;
+    uint32_t *dst;
+    uint32_t *chunkSums;
+    uint32_t count;
+};
+
+static void sumChunks(uint32_t chunkBegin, uint32_t chunkEnd, void *userData)
+{
+    ParallelScanContext &context = *(ParallelScanContext *)userData;
+
+    for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+    {
+        uint32_t end = min((i + 1) * scanGrainSize, context.count);
+        uint32_t sum = 0;
+
+        for (uint32_t j = i * scanGrainSize; j < end; j++)
+        {
+            sum += context.src[j];
+        }
+
+        context.chunkSums[i] = sum;
+    }
+}
+
+static void scanChunks(uint32_t chunkBegin, uint32_t chunkEnd, void *userData)
+{
+    ParallelScanContext &context = *(ParallelScanContext *)userData;
+
+    for (uint32_t i = chunkBegin; i < chunkEnd; i++)
+    {
+        uint32_t end = min((i + 1) * scanGrainSize, context.count);
+        uint32_t sum = context.chunkSums[i];
+
+        for (uint32_t j = i * scanGrainSize; j < end; j++)
+        {
+            uint32_t value = context.src[j]; // read before write, src and dst may alias
+            context.dst[j] = sum;
+            sum += value;
+        }
+    }
+}
+
+bool parallelExclusiveScan(const uint32_t *src, uint32_t *dst, uint32_t count, uint32_t &total)
+{
+    ZoneScoped;
+    ASSERT(!count || (src && dst));
+    uint32_t chunkCount = (count + scanGrainSize - 1) / scanGrainSize;
+    Token token = createToken();
+    uint32_t *chunkSums = (uint32_t *)allocateJobData(token, chunkCount * sizeof(uint32_t));
+    ParallelScanContext context { src, dst, chunkSums, count };
+    total = 0;
+
+    // two passes over the data: sum every chunk, scan the sums serially, then scan every chunk starting from its offset,
+    // the sums of dropped chunks were never written, so a cancelled first pass skips the rest
+    bool done = parallelFor(0, chunkCount, 1, sumChunks, &context, token);
+
+    for (uint32_t i = 0; i < chunkCount && done; i++)
+    {
+        uint32_t sum = chunkSums[i];
+        chunkSums[i] = total;
+        total += sum;
+    }
+
+    if (done)
+        done = parallelFor(0, chunkCount, 1, scanChunks, &context, token);
+
+    destroyToken(token);
+
+    return done;
+}
\ No newline at end of file
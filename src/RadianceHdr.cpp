@@ -0,0 +1,348 @@
+#include "RadianceHdr.hpp"
+#include "Parallel.hpp"
+#include "Utils.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include <tracy/Tracy.hpp>
+
+static constexpr uint32_t minTexelsPerJob = 16 * 1024;
+static constexpr float maxHalf = 65504.f;
+static constexpr uint16_t oneHalf = 0x3C00;
+static bool initialized = false;
+
+struct DecodeRowsContext
+{
+    const HdrFile *file;
+    uint16_t firstRow;
+    uint16_t *dst;
+};
+
+#pragma region Conversions
+// 2^(exponent - 136), the mantissas are bytes with 8 fraction bits, the exponents below 10 are too small for a half anyway
+static inline float getRgbeScale(uint8_t exponent)
+{
+    uint32_t bits = exponent > 9 ? (uint32_t)(exponent - 9) << 23 : 0;
+    float scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return scale;
+}
+
+// value must be in [0, maxHalf], rounds to the nearest even like F16C, same as in MipGeneration.cpp
+static inline uint16_t floatToHalf(float value)
+{
+    if (value < 6.103515625e-05f) // subnormal, the result may round up to the smallest normal, which is encoded right too
+        return (uint16_t)lrintf(value * 16777216.f);
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    bits += 0xFFF + ((bits >> 13) & 1);
+    return (uint16_t)((bits >> 13) - (112 << 10));
+}
+#pragma endregion
+
+#pragma region Scalar
+// planes holds the r, g, b and e bytes of a row one plane after another, planeSize apart, dst 4 halves per texel
+static void convertRowScalar(const uint8_t *planes, uint32_t planeSize, uint16_t *dst, uint32_t texelCount)
+{
+    for (uint32_t i = 0; i < texelCount; i++)
+    {
+        float scale = getRgbeScale(planes[3 * planeSize + i]);
+        float r = planes[i] * scale;
+        float g = planes[planeSize + i] * scale;
+        float b = planes[2 * planeSize + i] * scale;
+        dst[i * 4 + 0] = floatToHalf(r < maxHalf ? r : maxHalf);
+        dst[i * 4 + 1] = floatToHalf(g < maxHalf ? g : maxHalf);
+        dst[i * 4 + 2] = floatToHalf(b < maxHalf ? b : maxHalf);
+        dst[i * 4 + 3] = oneHalf;
+    }
+}
+#pragma endregion
+
+#pragma region SSE4.1
+// 4 texels at a time, the half conversion is the scalar one in integer lanes
+TARGET_SSE41 static inline __m128i loadPlaneSse41(const uint8_t *plane)
+{
+    int32_t bytes;
+    memcpy(&bytes, plane, sizeof(bytes));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+}
+
+TARGET_SSE41 static inline __m128i floatToHalfSse41(__m128 value)
+{
+    __m128i bits = _mm_castps_si128(value);
+    __m128i normal = _mm_add_epi32(bits, _mm_add_epi32(_mm_set1_epi32(0xFFF), _mm_and_si128(_mm_srli_epi32(bits, 13), _mm_set1_epi32(1))));
+    normal = _mm_sub_epi32(_mm_srli_epi32(normal, 13), _mm_set1_epi32(112 << 10));
+    __m128i subnormal = _mm_cvtps_epi32(_mm_mul_ps(value, _mm_set1_ps(16777216.f))); // rounds to the nearest even
+    return _mm_blendv_epi8(normal, subnormal, _mm_castps_si128(_mm_cmplt_ps(value, _mm_set1_ps(6.103515625e-05f))));
+}
+
+TARGET_SSE41 static void convertRowSse41(const uint8_t *planes, uint32_t planeSize, uint16_t *dst, uint32_t texelCount)
+{
+    __m128 maxValue = _mm_set1_ps(maxHalf);
+    __m128i alpha = _mm_set1_epi32(oneHalf << 16);
+    uint32_t i = 0;
+
+    for (; i + 4 <= texelCount; i += 4)
+    {
+        __m128i exponent = _mm_sub_epi32(loadPlaneSse41(planes + 3 * planeSize + i), _mm_set1_epi32(9));
+        __m128 scale = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(exponent, 23)), _mm_castsi128_ps(_mm_cmpgt_epi32(exponent, _mm_setzero_si128())));
+        __m128i r = floatToHalfSse41(_mm_min_ps(_mm_mul_ps(_mm_cvtepi32_ps(loadPlaneSse41(planes + i)), scale), maxValue));
+        __m128i g = floatToHalfSse41(_mm_min_ps(_mm_mul_ps(_mm_cvtepi32_ps(loadPlaneSse41(planes + planeSize + i)), scale), maxValue));
+        __m128i b = floatToHalfSse41(_mm_min_ps(_mm_mul_ps(_mm_cvtepi32_ps(loadPlaneSse41(planes + 2 * planeSize + i)), scale), maxValue));
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+        __m128i ba = _mm_or_si128(b, alpha);
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_unpacklo_epi32(rg, ba));
+        _mm_storeu_si128((__m128i *)(dst + i * 4 + 8), _mm_unpackhi_epi32(rg, ba));
+    }
+
+    if (i < texelCount)
+        convertRowScalar(planes + i, planeSize, dst + i * 4, texelCount - i);
+}
+#pragma endregion
+
+#pragma region AVX2
+// 8 texels at a time through F16C
+TARGET_AVX2 static inline __m256 loadPlaneAvx2(const uint8_t *plane, __m256 scale)
+{
+    __m256 value = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)plane))), scale);
+    return _mm256_min_ps(value, _mm256_set1_ps(maxHalf));
+}
+
+TARGET_AVX2 static void convertRowAvx2(const uint8_t *planes, uint32_t planeSize, uint16_t *dst, uint32_t texelCount)
+{
+    __m128i alpha = _mm_set1_epi16((int16_t)oneHalf);
+    uint32_t i = 0;
+
+    for (; i + 8 <= texelCount; i += 8)
+    {
+        __m256i exponent = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(planes + 3 * planeSize + i))), _mm256_set1_epi32(9));
+        __m256 scale = _mm256_and_ps(_mm256_castsi256_ps(_mm256_slli_epi32(exponent, 23)), _mm256_castsi256_ps(_mm256_cmpgt_epi32(exponent, _mm256_setzero_si256())));
+        __m128i r = _mm256_cvtps_ph(loadPlaneAvx2(planes + i, scale), _MM_FROUND_TO_NEAREST_INT);
+        __m128i g = _mm256_cvtps_ph(loadPlaneAvx2(planes + planeSize + i, scale), _MM_FROUND_TO_NEAREST_INT);
+        __m128i b = _mm256_cvtps_ph(loadPlaneAvx2(planes + 2 * planeSize + i, scale), _MM_FROUND_TO_NEAREST_INT);
+        __m128i rgLow = _mm_unpacklo_epi16(r, g);
+        __m128i rgHigh = _mm_unpackhi_epi16(r, g);
+        __m128i baLow = _mm_unpacklo_epi16(b, alpha);
+        __m128i baHigh = _mm_unpackhi_epi16(b, alpha);
+        _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_unpacklo_epi32(rgLow, baLow));
+        _mm_storeu_si128((__m128i *)(dst + i * 4 + 8), _mm_unpackhi_epi32(rgLow, baLow));
+        _mm_storeu_si128((__m128i *)(dst + i * 4 + 16), _mm_unpacklo_epi32(rgHigh, baHigh));
+        _mm_storeu_si128((__m128i *)(dst + i * 4 + 24), _mm_unpackhi_epi32(rgHigh, baHigh));
+    }
+
+    if (i < texelCount)
+        convertRowSse41(planes + i, planeSize, dst + i * 4, texelCount - i);
+}
+#pragma endregion
+
+typedef void (*ConvertRowFunc)(const uint8_t *planes, uint32_t planeSize, uint16_t *dst, uint32_t texelCount);
+
+static ConvertRowFunc convertRow = convertRowScalar;
+
+#pragma region Parsing
+static bool skipPrefix(const char *&pos, const char *end, const char *prefix)
+{
+    size_t length = strlen(prefix);
+
+    if ((size_t)(end - pos) < length || memcmp(pos, prefix, length))
+        return false;
+
+    pos += length;
+    return true;
+}
+
+static uint32_t parseNumber(const char *&pos, const char *end)
+{
+    uint32_t number = 0;
+    VERIFY(pos < end && *pos >= '0' && *pos <= '9');
+
+    for (; pos < end && *pos >= '0' && *pos <= '9' && number <= UINT16_MAX; pos++)
+    {
+        number = number * 10 + (*pos - '0');
+    }
+
+    return number;
+}
+
+// the run length encoded rows start with 2, 2 and the width in big endian, every other row is flat RGBE texels,
+// the old run length encoding is not supported, just like in stb_image
+static inline bool isRleRow(const uint8_t *row, const uint8_t *end, uint16_t width)
+{
+    return width >= 8 && width < 32768 && end - row >= 4 && row[0] == 2 && row[1] == 2 && (row[2] << 8 | row[3]) == width;
+}
+
+// walks the runs of the row without decoding them, returns where the next row starts
+static const uint8_t *skipRow(const uint8_t *row, const uint8_t *end, uint16_t width)
+{
+    if (!isRleRow(row, end, width))
+    {
+        VERIFY(end - row >= width * 4);
+        return row + width * 4;
+    }
+
+    row += 4;
+
+    for (uint32_t channel = 0; channel < 4; channel++)
+    {
+        for (uint32_t x = 0; x < width;)
+        {
+            VERIFY(row < end);
+            uint32_t count = *row++;
+            uint32_t runSize = count > 128 ? 1 : count;
+            count = count > 128 ? count - 128 : count;
+            VERIFY(count && x + count <= width && end - row >= runSize);
+            row += runSize;
+            x += count;
+        }
+    }
+
+    return row;
+}
+
+static void decodeRow(const uint8_t *row, const uint8_t *end, uint16_t width, uint8_t *planes)
+{
+    if (!isRleRow(row, end, width))
+    {
+        for (uint32_t x = 0; x < width; x++, row += 4)
+        {
+            planes[x] = row[0];
+            planes[width + x] = row[1];
+            planes[2 * width + x] = row[2];
+            planes[3 * width + x] = row[3];
+        }
+
+        return;
+    }
+
+    row += 4;
+
+    for (uint32_t channel = 0; channel < 4; channel++)
+    {
+        uint8_t *plane = planes + channel * width;
+
+        for (uint32_t x = 0; x < width;)
+        {
+            uint32_t count = *row++;
+
+            if (count > 128)
+            {
+                memset(plane + x, *row++, count - 128);
+                x += count - 128;
+            }
+            else
+            {
+                memcpy(plane + x, row, count);
+                row += count;
+                x += count;
+            }
+        }
+    }
+}
+#pragma endregion
+
+void initHdrDecoding(SimdIsa maxIsa)
+{
+    switch ((SimdIsa)min((uint32_t)getMaxSimdIsa(), (uint32_t)maxIsa))
+    {
+    case SimdIsa::Scalar:
+        convertRow = convertRowScalar;
+        break;
+    case SimdIsa::Sse41:
+        convertRow = convertRowSse41;
+        break;
+    case SimdIsa::Avx2:
+        convertRow = convertRowAvx2;
+        break;
+    }
+
+    initialized = true;
+}
+
+HdrFile openHdrFile(const char *filename)
+{
+    ZoneScoped;
+    ASSERT(isValidString(filename));
+    ZoneText(filename, strlen(filename));
+
+    HdrFile file {};
+    file.file = mapFile(filename);
+    VERIFY(file.file.data && file.file.size <= UINT32_MAX);
+    const char *pos = (const char *)file.file.data;
+    const char *end = pos + file.file.size;
+    VERIFY(skipPrefix(pos, end, "#?RADIANCE\n") || skipPrefix(pos, end, "#?RGBE\n"));
+
+    // the header ends with an empty line, only the format matters, the exposure and the primaries are ignored like in stb_image
+    for (;;)
+    {
+        const char *lineEnd = (const char *)memchr(pos, '\n', end - pos);
+        VERIFY(lineEnd);
+
+        if (lineEnd == pos)
+            break;
+
+        if (skipPrefix(pos, lineEnd, "FORMAT="))
+            VERIFY(skipPrefix(pos, lineEnd, "32-bit_rle_rgbe") && pos == lineEnd);
+
+        pos = lineEnd + 1;
+    }
+
+    pos++;
+    VERIFY(skipPrefix(pos, end, "-Y "));
+    uint32_t height = parseNumber(pos, end);
+    VERIFY(skipPrefix(pos, end, " +X "));
+    uint32_t width = parseNumber(pos, end);
+    VERIFY(skipPrefix(pos, end, "\n"));
+    VERIFY(width && width <= UINT16_MAX && height && height <= UINT16_MAX);
+    VERIFY((uint64_t)width * height * 4 * sizeof(uint16_t) <= UINT32_MAX); // the decoded size must fit into Image::dataSize
+    file.width = (uint16_t)width;
+    file.height = (uint16_t)height;
+
+    const uint8_t *row = (const uint8_t *)pos;
+    file.rowOffsets = new uint32_t[height + 1];
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        file.rowOffsets[y] = (uint32_t)(row - file.file.data);
+        row = skipRow(row, file.file.data + file.file.size, file.width);
+    }
+
+    file.rowOffsets[height] = (uint32_t)(row - file.file.data);
+
+    return file;
+}
+
+void closeHdrFile(HdrFile &file)
+{
+    unmapFile(file.file);
+    delete[] file.rowOffsets;
+    file = {};
+}
+
+static void decodeRows(uint32_t begin, uint32_t end, void *userData)
+{
+    ZoneScoped;
+    ASSERT(userData);
+    const DecodeRowsContext &context = *(const DecodeRowsContext *)userData;
+    const HdrFile &file = *context.file;
+    uint8_t *planes = new uint8_t[file.width * 4];
+
+    for (uint32_t y = begin; y < end; y++)
+    {
+        decodeRow(file.file.data + file.rowOffsets[y], file.file.data + file.rowOffsets[y + 1], file.width, planes);
+        convertRow(planes, file.width, context.dst + (y - context.firstRow) * file.width * 4, file.width);
+    }
+
+    delete[] planes;
+}
+
+void decodeHdrRows(const HdrFile &file, uint16_t firstRow, uint16_t rowCount, uint16_t *dst)
+{
+    ZoneScoped;
+    ASSERT(initialized);
+    ASSERT(file.rowOffsets && dst && rowCount);
+    ASSERT(firstRow + rowCount <= file.height);
+    DecodeRowsContext context { &file, firstRow, dst };
+    parallelFor(firstRow, firstRow + rowCount, max(minTexelsPerJob / file.width, 1), decodeRows, &context);
+}
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "Scene.hpp"
 #include "ImageUtils.hpp"
+#include "Parallel.hpp"
 #include "VkUtils.hpp"
 
 #include <stack>
@@ -11,12 +12,15 @@
 
 static const char *const sceneFileExtension = ".bin";
 static const char *const textureFileExtension = ".ktx2";
+static constexpr uint32_t sceneImportVersion = 1; // bump when the scene file layout or the mesh processing changes
 
-static void importImage(const cgltf_image *image, const char *path, ImagePurpose purpose)
+static ImageImportInfo initImageImportInfo(const cgltf_image *image, ImagePurpose purpose)
 {
-    uint8_t *data = (uint8_t *)image->buffer_view->buffer->data + image->buffer_view->offset;
-    uint32_t dataSize = (uint32_t)image->buffer_view->size;
-    importImage(data, dataSize, purpose, path);
+    ImageImportInfo info {};
+    info.data = (uint8_t *)image->buffer_view->buffer->data + image->buffer_view->offset;
+    info.dataSize = (uint32_t)image->buffer_view->size;
+    info.purpose = purpose;
+    return info;
 }
 
 static void importMaterials(const cgltf_data *data, Scene &scene, const char *sceneDirPath)
@@ -37,6 +41,9 @@ static void importMaterials(const cgltf_data *data, Scene &scene, const char *sc
     uint32_t imagePathSize = snprintf(imagePath, sizeof(imagePath), "%s/", sceneDirPath);
     scene.materials.reserve(data->materials_count);
     scene.imagePaths.reserve(data->materials_count * 3);
+    uint32_t firstImage = (uint32_t)scene.imagePaths.size();
+    std::vector<ImageImportInfo> imageImportInfos;
+    imageImportInfos.reserve(data->materials_count * 3);
 
     for (cgltf_size i = 0; i < data->materials_count; i++)
     {
@@ -49,7 +56,7 @@ static void importMaterials(const cgltf_data *data, Scene &scene, const char *sc
             {
                 texIndex = (uint32_t)scene.imagePaths.size();
                 snprintf(imagePath + imagePathSize, sizeof(imagePath) - imagePathSize, "image%02u%s", texIndex, textureFileExtension);
-                importImage(view.texture->image, imagePath, purpose);
+                imageImportInfos.push_back(initImageImportInfo(view.texture->image, purpose));
                 scene.imagePaths.push_back(imagePath);
             }
         };
@@ -63,6 +70,16 @@ static void importMaterials(const cgltf_data *data, Scene &scene, const char *sc
 
         scene.materials.push_back(md);
     }
+
+    if (imageImportInfos.empty())
+        return;
+
+    for (uint32_t i = 0; i < imageImportInfos.size(); i++) // the paths are final once all of them are pushed
+    {
+        imageImportInfos[i].outImageFilename = scene.imagePaths[firstImage + i].c_str();
+    }
+
+    importImages(imageImportInfos.data(), (uint32_t)imageImportInfos.size());
 }
 
 static void optimizeScene(Scene &scene)
@@ -87,11 +104,18 @@ static void optimizeScene(Scene &scene)
     scene.normalUvs = newNormalUvBuffer;
 }
 
-void importMaterial(const MaterialTextureSet &srcSet, const MaterialTextureSet &dstSet)
+void importMaterials(const MaterialTextureSet *srcSets, const MaterialTextureSet *dstSets, uint32_t setCount)
 {
-    importImage(srcSet.baseColorTexPath, dstSet.baseColorTexPath, ImagePurpose::Color);
-    importImage(srcSet.normalTexPath, dstSet.normalTexPath, ImagePurpose::Normal);
-    importImage(srcSet.aoRoughMetalTexPath, dstSet.aoRoughMetalTexPath, ImagePurpose::Shading);
+    std::vector<ImageImportInfo> imageImportInfos(setCount * 3);
+
+    for (uint32_t i = 0; i < setCount; i++)
+    {
+        imageImportInfos[i * 3 + 0] = { nullptr, 0, srcSets[i].baseColorTexPath, dstSets[i].baseColorTexPath, ImagePurpose::Color };
+        imageImportInfos[i * 3 + 1] = { nullptr, 0, srcSets[i].normalTexPath, dstSets[i].normalTexPath, ImagePurpose::Normal };
+        imageImportInfos[i * 3 + 2] = { nullptr, 0, srcSets[i].aoRoughMetalTexPath, dstSets[i].aoRoughMetalTexPath, ImagePurpose::Shading };
+    }
+
+    importImages(imageImportInfos.data(), (uint32_t)imageImportInfos.size());
 }
 
 void addMaterialToScene(Scene &scene, const MaterialTextureSet &set)
@@ -108,6 +132,94 @@ void addMaterialToScene(Scene &scene, const MaterialTextureSet &set)
     scene.imagePaths.push_back(set.aoRoughMetalTexPath);
 }
 
+struct PrimitiveImportContext
+{
+    const cgltf_accessor *accessor;
+    Scene *scene;
+    const glm::mat4 *toWorldMat;
+    size_t indexOffset;
+    size_t vertexOffset;
+    uint16_t transformIndex;
+};
+
+static void importIndices(uint32_t begin, uint32_t end, void *userData)
+{
+    PrimitiveImportContext &context = *(PrimitiveImportContext *)userData;
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        context.scene->indices[context.indexOffset + i] = (uint32_t)(context.vertexOffset + cgltf_accessor_read_index(context.accessor, i));
+    }
+}
+
+static void importPositions(uint32_t begin, uint32_t end, void *partial, void *userData)
+{
+    PrimitiveImportContext &context = *(PrimitiveImportContext *)userData;
+    AABB &aabb = *(AABB *)partial;
+    float values[4];
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        VERIFY(cgltf_accessor_read_float(context.accessor, i, values, countOf(values)));
+        Position &position = context.scene->positions[context.vertexOffset + i];
+        position.x = meshopt_quantizeHalf(values[0]);
+        position.y = meshopt_quantizeHalf(values[1]);
+        position.z = meshopt_quantizeHalf(values[2]);
+        position.transformIndex = context.transformIndex;
+
+        glm::vec3 worldPos = glm::vec3(*context.toWorldMat * glm::vec4(glm::make_vec3(values), 1.f));
+        aabb.min = glm::min(aabb.min, worldPos);
+        aabb.max = glm::max(aabb.max, worldPos);
+    }
+}
+
+static void joinAabbs(void *dst, const void *src, void *userData)
+{
+    UNUSED(userData);
+    AABB &dstAabb = *(AABB *)dst;
+    const AABB &srcAabb = *(const AABB *)src;
+    dstAabb.min = glm::min(dstAabb.min, srcAabb.min);
+    dstAabb.max = glm::max(dstAabb.max, srcAabb.max);
+}
+
+static void importNormals(uint32_t begin, uint32_t end, void *userData)
+{
+    PrimitiveImportContext &context = *(PrimitiveImportContext *)userData;
+    float values[4];
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        VERIFY(cgltf_accessor_read_float(context.accessor, i, values, countOf(values)));
+        NormalUv &normal = context.scene->normalUvs[context.vertexOffset + i];
+        normal.xyzw = (uint32_t)meshopt_quantizeSnorm(values[0], 8) & 0x000000FF |
+            (uint32_t)meshopt_quantizeSnorm(values[1], 8) << 8 & 0x0000FF00 |
+            (uint32_t)meshopt_quantizeSnorm(values[2], 8) << 16 & 0x00FF0000;
+    }
+}
+
+static void importUvs(uint32_t begin, uint32_t end, void *userData)
+{
+    PrimitiveImportContext &context = *(PrimitiveImportContext *)userData;
+    float values[4];
+
+    for (uint32_t i = begin; i < end; i++)
+    {
+        VERIFY(cgltf_accessor_read_float(context.accessor, i, values, countOf(values)));
+        NormalUv &uv = context.scene->normalUvs[context.vertexOffset + i];
+        uv.uv = (uint32_t)meshopt_quantizeSnorm(values[0] / MAX_UV, 16) & 0x0000FFFF |
+            (uint32_t)meshopt_quantizeSnorm(values[1] / MAX_UV, 16) << 16 & 0xFFFF0000;
+    }
+}
+
+uint64_t hashSceneImportSettings(float scale, uint64_t seed)
+{
+    uint64_t hash = hashValue(sceneImportVersion, seed);
+    hash = hashValue(scale, hash);
+    hash = hashImageImportSettings(ImagePurpose::Color, hash);
+    hash = hashImageImportSettings(ImagePurpose::Normal, hash);
+    return hashImageImportSettings(ImagePurpose::Shading, hash);
+}
+
 void importSceneFromGlb(const char *glbFilePath, const char *sceneDirPath, float scale)
 {
     ASSERT(pathExists(glbFilePath));
@@ -132,7 +244,6 @@ void importSceneFromGlb(const char *glbFilePath, const char *sceneDirPath, float
 
     scene.aabb.min = glm::vec3(FLT_MAX);
     scene.aabb.max = glm::vec3(-FLT_MAX);
-    float values[4];
 
     while (!stack.empty())
     {
@@ -176,50 +287,28 @@ void importSceneFromGlb(const char *glbFilePath, const char *sceneDirPath, float
             scene.positions.resize(oldVertexCount + vertexCount);
             scene.normalUvs.resize(oldVertexCount + vertexCount);
 
-            for (cgltf_size j = 0; j < indexCount; j++)
-            {
-                scene.indices[oldIndexCount + j] = (uint32_t)(oldVertexCount + cgltf_accessor_read_index(primitive.indices, j));
-            }
+            PrimitiveImportContext context { primitive.indices, &scene, &td.toWorldMat, oldIndexCount, oldVertexCount, transformIndex };
+            parallelFor(0, (uint32_t)indexCount, 0, importIndices, &context);
 
             for (cgltf_size j = 0; j < primitive.attributes_count; j++)
             {
                 const cgltf_attribute &attribute = primitive.attributes[j];
+                context.accessor = attribute.data;
 
                 switch (attribute.type)
                 {
                 case cgltf_attribute_type_position:
-                    for (cgltf_size k = 0; k < vertexCount; k++)
-                    {
-                        VERIFY(cgltf_accessor_read_float(attribute.data, k, values, countOf(values)));
-                        Position &position = scene.positions[oldVertexCount + k];
-                        position.x = meshopt_quantizeHalf(values[0]);
-                        position.y = meshopt_quantizeHalf(values[1]);
-                        position.z = meshopt_quantizeHalf(values[2]);
-                        position.transformIndex = transformIndex;
-
-                        glm::vec3 worldPos = glm::vec3(td.toWorldMat * glm::vec4(glm::make_vec3(values), 1.f));
-                        scene.aabb.min = glm::min(scene.aabb.min, worldPos);
-                        scene.aabb.max = glm::max(scene.aabb.max, worldPos);
-                    }
+                {
+                    AABB aabb { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+                    parallelReduce(0, (uint32_t)vertexCount, 0, &aabb, sizeof(aabb), importPositions, joinAabbs, &context);
+                    joinAabbs(&scene.aabb, &aabb, nullptr);
                     break;
+                }
                 case cgltf_attribute_type_normal:
-                    for (cgltf_size k = 0; k < vertexCount; k++)
-                    {
-                        VERIFY(cgltf_accessor_read_float(attribute.data, k, values, countOf(values)));
-                        NormalUv &normal = scene.normalUvs[oldVertexCount + k];
-                        normal.xyzw = (uint32_t)meshopt_quantizeSnorm(values[0], 8) & 0x000000FF |
-                            (uint32_t)meshopt_quantizeSnorm(values[1], 8) << 8 & 0x0000FF00 |
-                            (uint32_t)meshopt_quantizeSnorm(values[2], 8) << 16 & 0x00FF0000;
-                    }
+                    parallelFor(0, (uint32_t)vertexCount, 0, importNormals, &context);
                     break;
                 case cgltf_attribute_type_texcoord:
-                    for (cgltf_size k = 0; k < vertexCount; k++)
-                    {
-                        VERIFY(cgltf_accessor_read_float(attribute.data, k, values, countOf(values)));
-                        NormalUv &uv = scene.normalUvs[oldVertexCount + k];
-                        uv.uv = (uint32_t)meshopt_quantizeSnorm(values[0] / MAX_UV, 16) & 0x0000FFFF |
-                            (uint32_t)meshopt_quantizeSnorm(values[1] / MAX_UV, 16) << 16 & 0xFFFF0000;
-                    }
+                    parallelFor(0, (uint32_t)vertexCount, 0, importUvs, &context);
                     break;
                 default:
                     break;
@@ -5,14 +5,68 @@
 #include <string.h>
 
 #ifdef _MSC_VER
+#include <intrin.h> // for __cpuid
 #include <io.h> // for _access
+#include <sys/stat.h> // for _stat64
 #include <direct.h> // for _mkdir
+#include <windows.h> // for CreateFileMappingA and MapViewOfFile
 #else // assume UNIX
 #include <unistd.h> // for access
-#include <sys/stat.h> // for mkdir
+#include <sys/stat.h> // for mkdir and stat
+#include <fcntl.h> // for open
+#include <sys/mman.h> // for mmap
 #endif
 
 #include <cwalk.h>
+#define XXH_INLINE_ALL // private copy, so it cannot clash with the one bundled in libktx
+#include <xxhash.h>
+
+SimdIsa getMaxSimdIsa()
+{
+#ifdef _MSC_VER
+    int32_t info[4];
+    __cpuid(info, 0);
+    int32_t maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6; // OSXSAVE, AVX and the OS saves the YMM registers
+    bool avx2 = false;
+
+    if (avx && maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    return avx2 ? SimdIsa::Avx2 : (sse41 ? SimdIsa::Sse41 : SimdIsa::Scalar);
+}
+
+const char *getSimdIsaName(SimdIsa isa)
+{
+    switch (isa)
+    {
+    case SimdIsa::Scalar:
+        return "scalar";
+    case SimdIsa::Sse41:
+        return "sse4.1";
+    case SimdIsa::Avx2:
+        return "avx2";
+    }
+
+    ASSERT(false);
+    return "";
+}
+
+uint64_t hash64(const void *data, uint64_t size, uint64_t seed)
+{
+    ASSERT(data || !size);
+    return XXH64(data, (size_t)size, seed);
+}
 
 bool mkdir(const char *path, bool recursive)
 {
@@ -23,7 +77,7 @@ bool mkdir(const char *path, bool recursive)
 #ifdef _MSC_VER
         return !_mkdir(path);
 #else // assume UNIX
-        return !mkdir(path, 0777);
+        return !::mkdir(path, (mode_t)0777);
 #endif
     }
 
@@ -40,7 +94,7 @@ bool mkdir(const char *path, bool recursive)
 #ifdef _MSC_VER
         _mkdir(buffer);
 #else // assume UNIX
-        mkdir(dirname, 0777);
+        ::mkdir(buffer, (mode_t)0777);
 #endif
     } while (cwk_path_get_next_segment(&segment));
 
@@ -57,6 +111,24 @@ bool pathExists(const char *path)
 #endif
 }
 
+bool getFileStats(const char *filename, uint64_t &size, uint64_t &modifiedTime)
+{
+    ASSERT(isValidString(filename));
+#ifdef _MSC_VER
+    struct _stat64 stats;
+    if (_stat64(filename, &stats))
+        return false;
+#else // assume UNIX
+    struct stat stats;
+    if (stat(filename, &stats))
+        return false;
+#endif
+    size = (uint64_t)stats.st_size;
+    modifiedTime = (uint64_t)stats.st_mtime;
+
+    return true;
+}
+
 uint32_t readFile(const char *filename, uint8_t *buffer, uint32_t bufferSize)
 {
     ASSERT(isValidString(filename));
@@ -78,6 +150,63 @@ uint32_t readFile(const char *filename, uint8_t *buffer, uint32_t bufferSize)
     return size;
 }
 
+MappedFile mapFile(const char *filename)
+{
+    ASSERT(isValidString(filename));
+    MappedFile file {};
+#ifdef _MSC_VER
+    HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (fileHandle == INVALID_HANDLE_VALUE)
+        return file;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(fileHandle, &size) && size.QuadPart > 0)
+    {
+        file.handle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        file.data = file.handle ? (const uint8_t *)MapViewOfFile(file.handle, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        file.size = (uint64_t)size.QuadPart;
+    }
+
+    CloseHandle(fileHandle); // the mapping keeps the file open
+#else // assume UNIX
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return file;
+
+    struct stat stats;
+    if (!fstat(fd, &stats) && stats.st_size > 0)
+    {
+        void *data = mmap(nullptr, (size_t)stats.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, (size_t)stats.st_size, MADV_WILLNEED); // start reading ahead, the whole file is copied right away
+            file.data = (const uint8_t *)data;
+            file.size = (uint64_t)stats.st_size;
+        }
+    }
+
+    close(fd); // the mapping keeps the file open
+#endif
+    if (!file.data)
+        unmapFile(file);
+
+    return file;
+}
+
+void unmapFile(MappedFile &file)
+{
+#ifdef _MSC_VER
+    if (file.data)
+        UnmapViewOfFile(file.data);
+    if (file.handle)
+        CloseHandle(file.handle);
+#else // assume UNIX
+    if (file.data)
+        munmap((void *)file.data, (size_t)file.size);
+#endif
+    file = {};
+}
+
 uint32_t writeFile(const char *filename, const void *data, uint32_t size)
 {
     ASSERT(isValidString(filename));
@@ -8,6 +8,7 @@
 #include <meshoptimizer.h>
 #include <VkBootstrap.h>
 
+#include "AssetCache.hpp"
 #include "Camera.hpp"
 #include "DebugUtils.hpp"
 #include "Graphics.hpp"
@@ -17,11 +18,6 @@
 #include "ShaderUtils.hpp"
 #include "VkUtils.hpp"
 
-// skip importing if already exist
-#define SKIP_SCENE_REIMPORT 1
-#define SKIP_MATERIAL_REIMPORT 1
-#define SKIP_ENV_MAP_REIMPORT 1
-
 GLFWwindow *window;
 float timeSinceStart = 0.f;
 
@@ -52,6 +48,7 @@ int main()
         if (delta > 1.f)
             delta = defaultDelta;
         prevTime = currTime;
+        plotJobSystemStats();
         FrameMark;
     }
 
@@ -100,9 +97,14 @@ struct ShaderTable
     defineShader(renderBurnMap, ".frag", Fragment);
     defineShader(computeSkybox, ".comp", Compute);
     defineShader(computeBrdfLut, ".comp", Compute);
-    defineShader(computeIrradianceMap, ".comp", Compute);
+    defineShader(computeIrradianceSh, ".comp", Compute);
     defineShader(computePrefilteredMap, ".comp", Compute);
     defineShader(normalizeNormalMap, ".comp", Compute);
+    defineShader(compressBC5, ".comp", Compute);
+    defineShader(compressBC6, ".comp", Compute);
+    defineShader(compressBC7, ".comp", Compute);
+    defineShader(generateMipsRgba8, ".comp", Compute);
+    defineShader(generateMipsRgba16f, ".comp", Compute);
     defineShader(computePlaneCut, ".comp", Compute);
     defineShader(computeBlur2D, ".comp", Compute);
     defineShader(computeBloomAndTonemap, ".comp", Compute);
@@ -239,11 +241,11 @@ VkPipeline bloomAndTonemapPipeline;
 GpuBuffer modelBuffer;
 GpuBuffer globalUniformBuffer;
 GpuBuffer drawIndirectBuffer;
+GpuBuffer irradianceShBuffer; // one IrradianceSh per HDRI
 
 GpuImage modelTextures[MAX_MODEL_TEXTURES];
 uint8_t modelTextureCount;
 GpuImage skyboxImages[countOf(hdriImagePaths)];
-GpuImage irradianceMaps[countOf(hdriImagePaths)];
 GpuImage prefilteredMaps[countOf(hdriImagePaths)];
 GpuImage brdfLut;
 GpuImage burnMapImage;
@@ -338,6 +340,7 @@ void initVulkan()
     VkPhysicalDeviceFeatures features {};
     features.shaderInt16 = true;
     features.shaderSampledImageArrayDynamicIndexing = true;
+    features.shaderStorageImageArrayDynamicIndexing = true;
     features.textureCompressionBC = true;
     features.shaderStorageImageMultisample = true;
     features.fillModeNonSolid = true;
@@ -599,12 +602,12 @@ void initDescriptors()
         {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 64},
         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 64},
         {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 64},
-        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 64},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 5 * (64 + MAX_MIP_BATCH_SIZE * MAX_MIP_LEVEL_COUNT + MAX_NORMAL_MAP_BATCH_SIZE)}, // the image utils set and the two env map baking and compression set pairs
         {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 64 + MAX_MODEL_TEXTURES},
         {VK_DESCRIPTOR_TYPE_SAMPLER, 64},
         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1} // for imgui
     };
-    VkDescriptorPoolCreateInfo poolCreateInfo = initDescriptorPoolCreateInfo(10, poolSizes, countOf(poolSizes), VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT /* for imgui */);
+    VkDescriptorPoolCreateInfo poolCreateInfo = initDescriptorPoolCreateInfo(12, poolSizes, countOf(poolSizes), VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT /* for imgui */);
     vkVerify(vkCreateDescriptorPool(device, &poolCreateInfo, nullptr, &descriptorPool));
 
     VkDescriptorSetLayoutBinding globalSetBindings[]
@@ -624,7 +627,7 @@ void initDescriptors()
         {13, VK_DESCRIPTOR_TYPE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT, &nearestRepeatSampler},
         {20, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // brdf lut
         {21, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, countOf(skyboxImages), VK_SHADER_STAGE_FRAGMENT_BIT}, // skybox
-        {22, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, countOf(irradianceMaps), VK_SHADER_STAGE_FRAGMENT_BIT}, // irradiance
+        {22, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // irradiance sh
         {23, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, countOf(prefilteredMaps), VK_SHADER_STAGE_FRAGMENT_BIT}, // prefiltered
         {24, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // burn map texture
         {25, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // framebuffer image
@@ -818,25 +821,94 @@ void terminateImgui()
     ImGui::DestroyContext();
 }
 
+static uint64_t imageShadersHash; // the GPU import paths, hashed into every image asset key
+
+static uint64_t hashImageShaders()
+{
+    const ShaderCompileInfo *const infos[] = {
+        &shaderTable.computeSkyboxComputeShader,
+        &shaderTable.computeBrdfLutComputeShader,
+        &shaderTable.computeIrradianceShComputeShader,
+        &shaderTable.computePrefilteredMapComputeShader,
+        &shaderTable.normalizeNormalMapComputeShader,
+        &shaderTable.compressBC5ComputeShader,
+        &shaderTable.compressBC6ComputeShader,
+        &shaderTable.compressBC7ComputeShader,
+        &shaderTable.generateMipsRgba8ComputeShader,
+        &shaderTable.generateMipsRgba16fComputeShader
+    };
+
+    uint64_t hash = 0;
+
+    for (uint8_t i = 0; i < countOf(infos); i++)
+    {
+        hash = hashValue(hashSourceFile(infos[i]->shaderSpvPath), hash);
+    }
+
+    return hash;
+}
+
+static uint64_t hashMaterialSources(const MaterialTextureSet &srcSet)
+{
+    uint64_t hash = hashImageImportSettings(ImagePurpose::Color, imageShadersHash);
+    hash = hashImageImportSettings(ImagePurpose::Normal, hash);
+    hash = hashImageImportSettings(ImagePurpose::Shading, hash);
+    hash = hashValue(hashSourceFile(srcSet.baseColorTexPath), hash);
+    hash = hashValue(hashSourceFile(srcSet.normalTexPath), hash);
+    return hashValue(hashSourceFile(srcSet.aoRoughMetalTexPath), hash);
+}
+
+static bool isMaterialUpToDate(const MaterialTextureSet &dstSet, uint64_t key)
+{
+    return isAssetUpToDate(dstSet.baseColorTexPath, key) && isAssetUpToDate(dstSet.normalTexPath, key) &&
+        isAssetUpToDate(dstSet.aoRoughMetalTexPath, key);
+}
+
 void prepareAssets()
 {
     ZoneScoped;
     ASSERT(pathExists(assetsPath) && "Assets must reside in the working dir!");
+    loadAssetCache(assetsPath "assetCache.txt");
+    imageShadersHash = hashImageShaders();
 
     for (uint8_t i = 0; i < countOf(sceneInfos); i++)
     {
-#if SKIP_SCENE_REIMPORT
-        if (!pathExists(sceneInfos[i].sceneDirPath))
-#endif
+        uint64_t key = hashSceneImportSettings(sceneInfos[i].scalingFactor, imageShadersHash);
+        key = hashValue(hashSourceFile(sceneInfos[i].glbAssetPath), key);
+
+        if (!isAssetUpToDate(sceneInfos[i].sceneDirPath, key))
+        {
             importSceneFromGlb(sceneInfos[i].glbAssetPath, sceneInfos[i].sceneDirPath, sceneInfos[i].scalingFactor);
+            setAssetKey(sceneInfos[i].sceneDirPath, key);
+        }
     }
 
+    MaterialTextureSet srcSets[countOf(materialInfos)];
+    MaterialTextureSet dstSets[countOf(materialInfos)];
+    uint64_t keys[countOf(materialInfos)];
+    uint32_t setCount = 0;
+
     for (uint8_t i = 0; i < countOf(materialInfos); i++)
     {
-#if SKIP_MATERIAL_REIMPORT
-        if (!pathExists(materialInfos[i].dstSet.baseColorTexPath))
-#endif
-            importMaterial(materialInfos[i].srcSet, materialInfos[i].dstSet);
+        uint64_t key = hashMaterialSources(materialInfos[i].srcSet);
+
+        if (!isMaterialUpToDate(materialInfos[i].dstSet, key))
+        {
+            srcSets[setCount] = materialInfos[i].srcSet;
+            dstSets[setCount] = materialInfos[i].dstSet;
+            keys[setCount] = key;
+            setCount++;
+        }
+    }
+
+    if (setCount)
+        importMaterials(srcSets, dstSets, setCount);
+
+    for (uint32_t i = 0; i < setCount; i++)
+    {
+        setAssetKey(dstSets[i].baseColorTexPath, keys[i]);
+        setAssetKey(dstSets[i].normalTexPath, keys[i]);
+        setAssetKey(dstSets[i].aoRoughMetalTexPath, keys[i]);
     }
 }
 
@@ -958,13 +1030,18 @@ void loadModel(const char *sceneDirPath)
     modelTextureCount = (uint8_t)model.imagePaths.size();
     VkDescriptorImageInfo imageInfos[MAX_MODEL_TEXTURES] {};
 
+    const char *imagePaths[MAX_MODEL_TEXTURES];
+
+    for (uint8_t i = 0; i < modelTextureCount; i++)
+    {
+        imagePaths[i] = model.imagePaths[i].data();
+    }
+
+    if (modelTextureCount)
+        loadGpuImages(imagePaths, modelTextures, modelTextureCount, QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT);
+
     for (uint8_t i = 0; i < modelTextureCount; i++)
     {
-        ZoneScopedN("Load Texture");
-        ZoneText(model.imagePaths[i].data(), model.imagePaths[i].length());
-        Image image = loadImage(model.imagePaths[i].data());
-        modelTextures[i] = createAndCopyGpuImage(image, QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT);
-        destroyImage(image);
         imageInfos[i].imageView = modelTextures[i].imageView;
         imageInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     }
@@ -1016,55 +1093,92 @@ void loadEnvMaps()
 {
     ZoneScoped;
 
-#if SKIP_ENV_MAP_REIMPORT
-    if (!pathExists(brdfLutImagePath))
-#endif
+    uint64_t envMapSettingsHash = hashImageImportSettings(ImagePurpose::HDRI, imageShadersHash);
+
+    if (!isAssetUpToDate(brdfLutImagePath, envMapSettingsHash))
+    {
         computeBrdfLut(brdfLutImagePath);
+        setAssetKey(brdfLutImagePath, envMapSettingsHash);
+    }
 
-    Image image = loadImage(brdfLutImagePath);
-    brdfLut = createAndCopyGpuImage(image, QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT);
-    destroyImage(image);
+    loadGpuImages(&brdfLutImagePath, &brdfLut, 1, QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT);
 
-    VkDescriptorImageInfo brdfLutImageInfo { nullptr, brdfLut.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-    VkDescriptorImageInfo skyboxImageInfos[countOf(hdriImagePaths)];
-    VkDescriptorImageInfo irradianceImageInfos[countOf(hdriImagePaths)];
-    VkDescriptorImageInfo prefilteredImageInfos[countOf(hdriImagePaths)];
-    char skyboxImagePath[256], irradianceMapImagePath[256], prefilteredMapImagePath[256];
+    char skyboxImagePaths[countOf(hdriImagePaths)][256];
+    char irradianceShPaths[countOf(hdriImagePaths)][256];
+    char prefilteredMapImagePaths[countOf(hdriImagePaths)][256];
+    const char *envMapImagePaths[2][countOf(hdriImagePaths)];
+    EnvMapBakeInfo bakeInfos[countOf(hdriImagePaths)];
+    uint64_t bakeKeys[countOf(hdriImagePaths)];
+    uint32_t bakeCount = 0;
 
     for (uint8_t i = 0; i < countOf(hdriImagePaths); i++)
     {
+        char *skyboxImagePath = envMapImagePaths[0][i] = skyboxImagePaths[i];
+        char *irradianceShPath = irradianceShPaths[i];
+        char *prefilteredMapImagePath = envMapImagePaths[1][i] = prefilteredMapImagePaths[i];
         const char *hdriFilename;
         size_t hdriFilenameLength;
         cwk_path_get_basename_wout_extension(hdriImagePaths[i], &hdriFilename, &hdriFilenameLength);
-        snprintf(skyboxImagePath, sizeof(skyboxImagePath), "%s/%.*s_skybox.ktx2", envmapsPath, (uint32_t)hdriFilenameLength, hdriFilename);
-        snprintf(irradianceMapImagePath, sizeof(irradianceMapImagePath), "%s/%.*s_irradiance.ktx2", envmapsPath, (uint32_t)hdriFilenameLength, hdriFilename);
-        snprintf(prefilteredMapImagePath, sizeof(prefilteredMapImagePath), "%s/%.*s_prefiltered.ktx2", envmapsPath, (uint32_t)hdriFilenameLength, hdriFilename);
-
-#if SKIP_ENV_MAP_REIMPORT
-        if (!pathExists(skyboxImagePath))
-#endif
-            computeEnvMaps(hdriImagePaths[i], skyboxImagePath, irradianceMapImagePath, prefilteredMapImagePath);
-
-        image = loadImage(skyboxImagePath);
-        skyboxImages[i] = createAndCopyGpuImage(image, QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT, GpuImageType::Image2DCubemap);
-        destroyImage(image);
-        image = loadImage(irradianceMapImagePath);
-        irradianceMaps[i] = createAndCopyGpuImage(image, QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT, GpuImageType::Image2DCubemap);
-        destroyImage(image);
-        image = loadImage(prefilteredMapImagePath);
-        prefilteredMaps[i] = createAndCopyGpuImage(image, QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT, GpuImageType::Image2DCubemap);
-        destroyImage(image);
+        snprintf(skyboxImagePath, sizeof(skyboxImagePaths[i]), "%s/%.*s_skybox.ktx2", envmapsPath, (uint32_t)hdriFilenameLength, hdriFilename);
+        snprintf(irradianceShPath, sizeof(irradianceShPaths[i]), "%s/%.*s_irradianceSh.bin", envmapsPath, (uint32_t)hdriFilenameLength, hdriFilename);
+        snprintf(prefilteredMapImagePath, sizeof(prefilteredMapImagePaths[i]), "%s/%.*s_prefiltered.ktx2", envmapsPath, (uint32_t)hdriFilenameLength, hdriFilename);
 
+        uint64_t key = hashValue(hashSourceFile(hdriImagePaths[i]), envMapSettingsHash);
+
+        if (!isAssetUpToDate(skyboxImagePath, key) || !isAssetUpToDate(irradianceShPath, key) ||
+            !isAssetUpToDate(prefilteredMapImagePath, key))
+        {
+            bakeInfos[bakeCount] = { hdriImagePaths[i], skyboxImagePath, irradianceShPath, prefilteredMapImagePath };
+            bakeKeys[bakeCount] = key;
+            bakeCount++;
+        }
+    }
+
+    if (bakeCount)
+        computeEnvMaps(bakeInfos, bakeCount);
+
+    for (uint32_t i = 0; i < bakeCount; i++)
+    {
+        setAssetKey(bakeInfos[i].skyboxPath, bakeKeys[i]);
+        setAssetKey(bakeInfos[i].irradianceShPath, bakeKeys[i]);
+        setAssetKey(bakeInfos[i].prefilteredMapPath, bakeKeys[i]);
+    }
+
+    loadGpuImages(envMapImagePaths[0], skyboxImages, countOf(hdriImagePaths), QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT);
+    loadGpuImages(envMapImagePaths[1], prefilteredMaps, countOf(hdriImagePaths), QueueFamily::Graphics, VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    uint32_t irradianceShsSize = countOf(hdriImagePaths) * sizeof(IrradianceSh);
+    irradianceShBuffer = createGpuBuffer(irradianceShsSize,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    setGpuBufferName(irradianceShBuffer, NAMEOF(irradianceShBuffer));
+
+    for (uint8_t i = 0; i < countOf(hdriImagePaths); i++)
+    {
+        uint8_t *irradianceSh = (uint8_t *)stagingBufferMappedData + i * sizeof(IrradianceSh);
+        VERIFY(readFile(irradianceShPaths[i], irradianceSh, sizeof(IrradianceSh)) == sizeof(IrradianceSh));
+    }
+
+    VkBufferCopy irradianceShCopy { 0, 0, irradianceShsSize };
+    copyStagingBufferToBuffer(irradianceShBuffer, &irradianceShCopy, 1);
+
+    VkDescriptorImageInfo brdfLutImageInfo { nullptr, brdfLut.imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    VkDescriptorImageInfo skyboxImageInfos[countOf(hdriImagePaths)];
+    VkDescriptorImageInfo prefilteredImageInfos[countOf(hdriImagePaths)];
+
+    for (uint8_t i = 0; i < countOf(hdriImagePaths); i++)
+    {
         skyboxImageInfos[i] = { nullptr, skyboxImages[i].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-        irradianceImageInfos[i] = { nullptr, irradianceMaps[i].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
         prefilteredImageInfos[i] = { nullptr, prefilteredMaps[i].imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
     }
 
+    VkDescriptorBufferInfo irradianceShBufferInfo { irradianceShBuffer.buffer, 0, irradianceShsSize };
+
     VkWriteDescriptorSet writes[]
     {
         initWriteDescriptorSetImage(globalDescriptorSet, 20, 1, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, &brdfLutImageInfo),
         initWriteDescriptorSetImage(globalDescriptorSet, 21, countOf(skyboxImageInfos), VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, skyboxImageInfos),
-        initWriteDescriptorSetImage(globalDescriptorSet, 22, countOf(irradianceImageInfos), VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, irradianceImageInfos),
+        initWriteDescriptorSetBuffer(globalDescriptorSet, 22, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &irradianceShBufferInfo),
         initWriteDescriptorSetImage(globalDescriptorSet, 23, countOf(prefilteredImageInfos), VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, prefilteredImageInfos),
     };
 
@@ -1134,6 +1248,7 @@ void initScene()
 
     loadModel(sceneInfos[selectedScene].sceneDirPath);
     loadEnvMaps();
+    saveAssetCache();
     loadLights();
     resetCamera();
 
@@ -1146,6 +1261,7 @@ void terminateScene()
     destroyGpuBuffer(modelBuffer);
     destroyGpuBuffer(globalUniformBuffer);
     destroyGpuBuffer(drawIndirectBuffer);
+    destroyGpuBuffer(irradianceShBuffer);
 
     for (uint8_t i = 0; i < modelTextureCount; i++)
     {
@@ -1155,7 +1271,6 @@ void terminateScene()
     for (uint8_t i = 0; i < countOf(hdriImagePaths); i++)
     {
         destroyGpuImage(skyboxImages[i]);
-        destroyGpuImage(irradianceMaps[i]);
         destroyGpuImage(prefilteredMaps[i]);
     }
 
@@ -1277,12 +1392,19 @@ void init()
     initPipelines();
     initImgui();
     initRenderdoc();
-    initJobSystem();
+    JobSystemConfig jobSystemConfig {};
+    jobSystemConfig.reservedCoreCount = 1; // the main thread records and submits frames
+    initJobSystem(jobSystemConfig);
     initImageUtils(shaderTable.computeSkyboxComputeShader.shaderSpvPath,
         shaderTable.computeBrdfLutComputeShader.shaderSpvPath,
-        shaderTable.computeIrradianceMapComputeShader.shaderSpvPath,
+        shaderTable.computeIrradianceShComputeShader.shaderSpvPath,
         shaderTable.computePrefilteredMapComputeShader.shaderSpvPath,
-        shaderTable.normalizeNormalMapComputeShader.shaderSpvPath);
+        shaderTable.normalizeNormalMapComputeShader.shaderSpvPath,
+        shaderTable.compressBC5ComputeShader.shaderSpvPath,
+        shaderTable.compressBC6ComputeShader.shaderSpvPath,
+        shaderTable.compressBC7ComputeShader.shaderSpvPath,
+        shaderTable.generateMipsRgba8ComputeShader.shaderSpvPath,
+        shaderTable.generateMipsRgba16fComputeShader.shaderSpvPath);
 
     updateRenderTargetDescriptors();
     initScene();
@@ -1519,6 +1641,72 @@ static inline void tableCellLabel(const char *label)
     ImGui::TableNextColumn();
 }
 
+// prints the upper bound of the latency histogram bucket containing the given fraction of jobs
+static void textLatencyPercentile(const WorkerStats &stats, float fraction)
+{
+    uint64_t threshold = (uint64_t)(stats.executedJobCount * fraction);
+    uint64_t count = 0;
+
+    for (uint32_t i = 0; i < jobLatencyBucketCount - 1; i++)
+    {
+        count += stats.latencyHistogram[i];
+
+        if (count > threshold)
+        {
+            ImGui::Text("<%u", 1u << i);
+            return;
+        }
+    }
+
+    ImGui::Text(">%u", 1u << (jobLatencyBucketCount - 2));
+}
+
+static void drawJobSystemStats()
+{
+    static std::vector<WorkerStats> stats;
+    stats.resize(getWorkerThreadCount()); // the worker count only changes when the job system is restarted
+    uint32_t workerCount = min(getWorkerStats(stats.data(), (uint32_t)stats.size()), (uint32_t)stats.size());
+
+    ImGui::Text("Queued jobs: %u", getQueuedJobCount());
+
+    if (ImGui::BeginTable("##Table", 8, ImGuiTableFlags_NoHostExtendX | ImGuiTableFlags_Borders))
+    {
+        ImGui::TableSetupColumn("#");
+        ImGui::TableSetupColumn("Jobs");
+        ImGui::TableSetupColumn("Stolen");
+        ImGui::TableSetupColumn("Busy");
+        ImGui::TableSetupColumn("Spin");
+        ImGui::TableSetupColumn("Idle");
+        ImGui::TableSetupColumn("p50 us");
+        ImGui::TableSetupColumn("p99 us");
+        ImGui::TableHeadersRow();
+
+        for (uint32_t i = 0; i < workerCount; i++)
+        {
+            const WorkerStats &worker = stats[i];
+            uint64_t totalTime = worker.busyTime + worker.spinTime + worker.idleTime;
+            double percentScale = totalTime ? 100.0 / totalTime : 0.0;
+            ImGui::TableNextColumn();
+            ImGui::Text("%2u", i);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)worker.executedJobCount);
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", (unsigned long long)worker.stolenJobCount);
+            ImGui::TableNextColumn();
+            ImGui::Text("%5.1f%%", worker.busyTime * percentScale);
+            ImGui::TableNextColumn();
+            ImGui::Text("%5.1f%%", worker.spinTime * percentScale);
+            ImGui::TableNextColumn();
+            ImGui::Text("%5.1f%%", worker.idleTime * percentScale);
+            ImGui::TableNextColumn();
+            textLatencyPercentile(worker, 0.5f);
+            ImGui::TableNextColumn();
+            textLatencyPercentile(worker, 0.99f);
+        }
+        ImGui::EndTable();
+    }
+}
+
 void drawImgui(Cmd cmd)
 {
     ZoneScoped;
@@ -1747,6 +1935,11 @@ void drawImgui(Cmd cmd)
         }
     }
 
+    if (ImGui::CollapsingHeader("Job system"))
+    {
+        drawJobSystemStats();
+    }
+
     ImGui::End();
 #pragma endregion UiCode
 
@@ -0,0 +1,181 @@
+#ifndef BLOCK_COMPRESSION_H
+#define BLOCK_COMPRESSION_H
+
+// Every invocation encodes one 4x4 block of one face of one mip level. The encoders follow the fast paths of
+// src/BlockCompression.cpp and only emit the modes its decoders understand: BC4 8-value, BC6H mode 11 and BC7 mode 6.
+
+layout(local_size_x_id = 0) in;
+
+layout(set = 0, binding = 5) uniform sampler linearClampSampler;
+layout(set = 0, binding = 6) uniform texture2DArray srcTexture;
+layout(std430, set = 0, binding = 7) restrict writeonly buffer BlockBuffer
+{
+    uvec4 blocks[];
+};
+
+layout(push_constant) uniform ConstantBlock
+{
+    uint level;
+    uint firstBlock; // of the level in the block buffer
+    uint srgb; // the texels are fetched through an sRGB format and have to be encoded back
+};
+
+const uint weights4[16] = uint[](0u, 4u, 9u, 13u, 17u, 21u, 26u, 30u, 34u, 38u, 43u, 47u, 51u, 55u, 60u, 64u);
+
+bool loadBlock(out vec4 texels[16])
+{
+    ivec3 size = textureSize(sampler2DArray(srcTexture, linearClampSampler), int(level));
+    uvec2 blockCount = (uvec2(size.xy) + 3u) / 4u;
+    uint faceBlockCount = blockCount.x * blockCount.y;
+    uint blockIndex = gl_GlobalInvocationID.x;
+
+    if(blockIndex >= faceBlockCount * uint(size.z))
+        return false;
+
+    int face = int(blockIndex / faceBlockCount);
+    uint faceBlockIndex = blockIndex % faceBlockCount;
+    ivec2 origin = 4 * ivec2(faceBlockIndex % blockCount.x, faceBlockIndex / blockCount.x);
+
+    for(int i = 0; i < 16; i++) // mips smaller than a block repeat their last row and column
+    {
+        ivec2 texelCoords = min(origin + ivec2(i % 4, i / 4), size.xy - 1);
+        texels[i] = texelFetch(sampler2DArray(srcTexture, linearClampSampler), ivec3(texelCoords, face), int(level));
+    }
+
+    return true;
+}
+
+void storeBlock(uint words[4])
+{
+    blocks[firstBlock + gl_GlobalInvocationID.x] = uvec4(words[0], words[1], words[2], words[3]);
+}
+
+// value must fit into bitCount bits, returns the offset of the next field
+uint writeBits(inout uint words[4], uint offset, uint value, uint bitCount)
+{
+    uint shift = offset & 31u;
+    words[offset >> 5u] |= value << shift;
+
+    if(shift + bitCount > 32u)
+        words[(offset >> 5u) + 1u] |= value >> (32u - shift);
+
+    return offset + bitCount;
+}
+
+// the extent of the texels along their principal axis, found with a few power iterations on the covariance
+void fitEndpoints(vec4 texels[16], out vec4 endpoints[2])
+{
+    vec4 mean = vec4(0.f);
+    vec4 low = texels[0];
+    vec4 high = texels[0];
+
+    for(int i = 0; i < 16; i++)
+    {
+        mean += texels[i];
+        low = min(low, texels[i]);
+        high = max(high, texels[i]);
+    }
+
+    mean /= 16.f;
+    vec4 axis = high - low;
+
+    for(int iteration = 0; iteration < 4; iteration++)
+    {
+        vec4 product = vec4(0.f);
+
+        for(int i = 0; i < 16; i++)
+        {
+            vec4 offset = texels[i] - mean;
+            product += offset * dot(offset, axis);
+        }
+
+        float scale = max(max(abs(product.x), abs(product.y)), max(abs(product.z), abs(product.w)));
+
+        if(scale == 0.f)
+            break;
+
+        axis = product / scale;
+    }
+
+    float lengthSquared = dot(axis, axis);
+    float tMin = 0.f;
+    float tMax = 0.f;
+
+    if(lengthSquared > 0.f)
+    {
+        tMin = dot(texels[0] - mean, axis);
+        tMax = tMin;
+
+        for(int i = 1; i < 16; i++)
+        {
+            float t = dot(texels[i] - mean, axis);
+            tMin = min(tMin, t);
+            tMax = max(tMax, t);
+        }
+
+        tMin /= lengthSquared;
+        tMax /= lengthSquared;
+    }
+
+    endpoints[0] = mean + axis * tMin;
+    endpoints[1] = mean + axis * tMax;
+}
+
+// the nearest 4 bit index of every texel projected onto the segment between the endpoints, returns the squared error
+float findIndices(vec4 texels[16], vec4 endpoints[2], out uint indices[16])
+{
+    vec4 direction = endpoints[1] - endpoints[0];
+    float lengthSquared = dot(direction, direction);
+    float scale = lengthSquared > 0.f ? 64.f / lengthSquared : 0.f;
+    float error = 0.f;
+
+    for(int i = 0; i < 16; i++)
+    {
+        float weight = dot(texels[i] - endpoints[0], direction) * scale;
+        uint index = 0u;
+
+        for(uint k = 1u; k < 16u; k++)
+        {
+            if(abs(float(weights4[k]) - weight) < abs(float(weights4[index]) - weight))
+                index = k;
+        }
+
+        indices[i] = index;
+        vec4 difference = texels[i] - mix(endpoints[0], endpoints[1], float(weights4[index]) / 64.f);
+        error += dot(difference, difference);
+    }
+
+    return error;
+}
+
+// least squares endpoints for the given indices, fails if all texels share the same weight
+bool refineEndpoints(vec4 texels[16], uint indices[16], inout vec4 endpoints[2])
+{
+    float aa = 0.f;
+    float ab = 0.f;
+    float bb = 0.f;
+    vec4 ax = vec4(0.f);
+    vec4 bx = vec4(0.f);
+
+    for(int i = 0; i < 16; i++)
+    {
+        float b = float(weights4[indices[i]]) / 64.f;
+        float a = 1.f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        ax += a * texels[i];
+        bx += b * texels[i];
+    }
+
+    float determinant = aa * bb - ab * ab;
+
+    if(abs(determinant) < 1e-6f)
+        return false;
+
+    endpoints[0] = (ax * bb - bx * ab) / determinant;
+    endpoints[1] = (bx * aa - ax * ab) / determinant;
+    return true;
+}
+
+#endif // !BLOCK_COMPRESSION_H
\ No newline at end of file
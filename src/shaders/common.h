@@ -19,6 +19,9 @@
 #define MAX_LIGHTS 16
 #define MAX_MODEL_TEXTURES 64
 #define MAX_PREFILTERED_MAP_LOD 4
+#define MAX_MIP_LEVEL_COUNT 13 // up to 4096x4096
+#define MAX_MIP_BATCH_SIZE 4 // images whose mips are made by one submission
+#define MAX_NORMAL_MAP_BATCH_SIZE 4 // the normal maps of one import batch, they are only normalized one batch at a time
 #define MAX_UV 2.f // valid UV coords should in the [-MAX_UV, +MAX_UV] range
 
 #define SCENE_SHOW_WIREFRAME (1u << 0)
@@ -117,6 +120,11 @@ struct PushData // yes, this can be optimized
     CuttingData cuttingData;
 };
 
+struct IrradianceSh // 9 L2 spherical harmonics of the diffuse irradiance, w is unused
+{
+    vec4 coefficients[9];
+};
+
 struct DrawIndirectData
 {
     // start of VkDrawIndexedIndirectCommand
@@ -144,6 +152,7 @@ static_assert(sizeof(LightingData) == sizeof(LightData) * MAX_LIGHTS + 4, "");
 static_assert(sizeof(SceneData) == sizeof(float[4]) * (4 * 5 + 1), "");
 static_assert(sizeof(LineData) == sizeof(float[2]) * 4, "");
 static_assert(sizeof(CuttingData) == sizeof(float[4]) * 2, "");
+static_assert(sizeof(IrradianceSh) == sizeof(float[4]) * 9, "");
 #endif // __cplusplus
 
 #endif // !COMMON_H
\ No newline at end of file
@@ -0,0 +1,144 @@
+#ifndef GENERATE_MIPS_H
+#define GENERATE_MIPS_H
+
+#include "common.h"
+
+// Single pass mip generation. Every work group reduces a 64x64 tile of level 0 to the levels 1-6 of the tile,
+// level 2 and below go through shared memory. The last work group of a face to finish, found with an atomic counter,
+// reduces level 6 to the remaining levels the same way. The includer defines MIP_FORMAT, the format of the level views.
+// A batch of images shares the descriptors, the levels of image i start at element i * MAX_MIP_LEVEL_COUNT.
+
+layout(local_size_x = 256) in;
+
+layout(set = 0, binding = 8, MIP_FORMAT) uniform coherent image2DArray levelImages[MAX_MIP_BATCH_SIZE * MAX_MIP_LEVEL_COUNT]; // all faces of a level
+layout(std430, set = 0, binding = 9) coherent buffer CounterBuffer
+{
+    uint counters[]; // per face of every image of the batch, zeroed before the dispatches
+};
+
+layout(push_constant) uniform ConstantBlock
+{
+    uint levelCount;
+    uint srgb; // the levels are UNORM views of an sRGB image, they are filtered in linear space
+    uint imageIndex; // one dispatch per image, so it is uniform
+};
+
+#define LEVEL_IMAGE(level) levelImages[imageIndex * MAX_MIP_LEVEL_COUNT + uint(level)]
+
+const int tileSize = 64;
+const int tileLevelCount = 6;
+
+shared vec4 tileTexels[16][16]; // the current level of the tile, starting with level 2
+shared bool lastWorkGroup;
+
+vec4 loadTexel(int level, ivec2 coords, int face)
+{
+    coords = min(coords, imageSize(LEVEL_IMAGE(level)).xy - 1); // odd sizes and 1 texel wide levels repeat their edges
+    vec4 texel = imageLoad(LEVEL_IMAGE(level), ivec3(coords, face));
+
+    if(srgb != 0u)
+        texel.rgb = mix(texel.rgb / 12.92f, pow((texel.rgb + 0.055f) / 1.055f, vec3(2.4f)), greaterThan(texel.rgb, vec3(0.04045f)));
+
+    return texel;
+}
+
+void storeTexel(int level, ivec2 coords, int face, vec4 texel)
+{
+    if(level >= int(levelCount) || any(greaterThanEqual(coords, imageSize(LEVEL_IMAGE(level)).xy)))
+        return;
+
+    if(srgb != 0u)
+        texel.rgb = mix(texel.rgb * 12.92f, 1.055f * pow(texel.rgb, vec3(1.f / 2.4f)) - 0.055f, greaterThan(texel.rgb, vec3(0.0031308f)));
+
+    imageStore(LEVEL_IMAGE(level), ivec3(coords, face), texel);
+}
+
+// a texel of level + 1, coords are clamped to that level first, so the texels past its edge repeat the edge too
+vec4 reduceTexel(int level, ivec2 coords, int face)
+{
+    coords = min(coords, imageSize(LEVEL_IMAGE(level + 1)).xy - 1);
+    ivec2 srcCoords = 2 * coords;
+    return 0.25f * (loadTexel(level, srcCoords, face) + loadTexel(level, srcCoords + ivec2(1, 0), face) +
+        loadTexel(level, srcCoords + ivec2(0, 1), face) + loadTexel(level, srcCoords + ivec2(1, 1), face));
+}
+
+// reduces the tile of srcLevel at tileOrigin, in srcLevel texels, to the next tileLevelCount levels
+void reduceTile(int srcLevel, ivec2 tileOrigin, int face)
+{
+    ivec2 threadCoords = ivec2(gl_LocalInvocationIndex % 16u, gl_LocalInvocationIndex / 16u);
+
+    // every thread makes a 2x2 quad of the first level and reduces it to a texel of the second one
+    ivec2 quadOrigin = (tileOrigin >> 1) + 2 * threadCoords;
+    vec4 sum = vec4(0.f);
+
+    for(int i = 0; i < 4; i++)
+    {
+        ivec2 coords = quadOrigin + ivec2(i & 1, i >> 1);
+        vec4 texel = reduceTexel(srcLevel, coords, face);
+        storeTexel(srcLevel + 1, coords, face, texel);
+        sum += texel;
+    }
+
+    // texels past the edge of the second level are never read, so the clamping of reduceTexel is enough here
+    tileTexels[threadCoords.y][threadCoords.x] = 0.25f * sum;
+    storeTexel(srcLevel + 2, (tileOrigin >> 2) + threadCoords, face, 0.25f * sum);
+
+    for(int i = 3; i <= tileLevelCount; i++)
+    {
+        int level = srcLevel + i;
+
+        if(level >= int(levelCount))
+            break;
+
+        int size = tileSize >> i;
+        ivec2 origin = tileOrigin >> i;
+        ivec2 prevMaxCoords = imageSize(LEVEL_IMAGE(level - 1)).xy - 1 - (tileOrigin >> (i - 1));
+        bool active = all(lessThan(threadCoords, ivec2(size)));
+        vec4 texel = vec4(0.f);
+        barrier();
+
+        if(active)
+        {
+            for(int j = 0; j < 4; j++)
+            {
+                ivec2 srcCoords = min(2 * threadCoords + ivec2(j & 1, j >> 1), prevMaxCoords);
+                texel += tileTexels[srcCoords.y][srcCoords.x];
+            }
+
+            texel *= 0.25f;
+        }
+
+        barrier();
+
+        if(active)
+        {
+            tileTexels[threadCoords.y][threadCoords.x] = texel;
+            storeTexel(level, origin + threadCoords, face, texel);
+        }
+    }
+}
+
+void main()
+{
+    int face = int(gl_WorkGroupID.z);
+    reduceTile(0, ivec2(gl_WorkGroupID.xy) * tileSize, face);
+
+    if(levelCount <= uint(tileLevelCount + 1))
+        return;
+
+    if(gl_LocalInvocationIndex == 0u) // the thread that stored the texel of level 6
+    {
+        memoryBarrierImage();
+        lastWorkGroup = atomicAdd(counters[imageIndex * 6u + uint(face)], 1u) == gl_NumWorkGroups.x * gl_NumWorkGroups.y - 1u;
+    }
+
+    barrier();
+
+    if(!lastWorkGroup)
+        return;
+
+    memoryBarrierImage();
+    reduceTile(tileLevelCount, ivec2(0), face); // level 6 fits into a tile for up to 4096x4096
+}
+
+#endif // !GENERATE_MIPS_H
\ No newline at end of file
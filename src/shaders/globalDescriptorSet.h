@@ -58,7 +58,10 @@ layout(set = 0, binding = 13) uniform sampler nearestRepeatSampler;
 
 layout(set = 0, binding = 20) uniform texture2D brdfLut;
 layout(set = 0, binding = 21) uniform textureCube skyboxTextures[];
-layout(set = 0, binding = 22) uniform textureCube irradianceMaps[];
+layout(std430, set = 0, binding = 22) restrict readonly buffer IrradianceShBlock
+{
+    IrradianceSh irradianceShs[];
+};
 layout(set = 0, binding = 23) uniform textureCube prefilteredMaps[];
 layout(set = 0, binding = 24) uniform texture2D burnMapTexture;
 layout(set = 0, binding = 25, rgba16f) uniform image2DMS frameBufferImage;
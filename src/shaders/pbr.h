@@ -1,6 +1,7 @@
 #ifndef PBR_H
 #define PBR_H
 
+#include "common.h"
 #include "utils.h"
 
 vec3 fresnelSchlick(float cosTheta, vec3 F0)
@@ -55,6 +56,21 @@ void directBRDF(float NdotV, float NdotL, float NdotH, float HdotV, vec3 albedo,
     fSpec = F * G * D / max(4.f * NdotV * NdotL, EPSILON);
 }
 
+// the coefficients are already convolved with the cosine lobe and divided by PI, see computeIrradianceSh.comp
+vec3 evalIrradianceSh(IrradianceSh sh, vec3 N)
+{
+    float basis[9];
+    evalShBasis(N, basis);
+    vec3 irradiance = vec3(0.f);
+
+    for(uint i = 0; i < 9; i++)
+    {
+        irradiance += sh.coefficients[i].rgb * basis[i];
+    }
+
+    return max(irradiance, 0.f); // ringing can go below zero next to very bright spots
+}
+
 void envBRDF(vec3 albedo, float roughness, float metallic, vec3 irradiance, vec3 prefiltered, vec2 brdf, out vec3 fDiff, out vec3 fSpec)
 {
     vec3 F0 = mix(vec3(0.04f), albedo, metallic);
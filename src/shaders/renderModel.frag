@@ -82,7 +82,7 @@ void main()
     vec3 R = reflect(-V, N);
     float NdotV = max(dot(N, V), 0.f);
 
-    vec3 irradiance = texture(samplerCube(irradianceMaps[skyboxIndex], linearRepeatSampler), N).rgb;
+    vec3 irradiance = evalIrradianceSh(irradianceShs[skyboxIndex], N);
     vec3 prefiltered = textureLod(samplerCube(prefilteredMaps[skyboxIndex], linearRepeatSampler), R, roughness * MAX_PREFILTERED_MAP_LOD).rgb;
     vec2 brdf = texture(sampler2D(brdfLut, linearClampSampler), vec2(NdotV, roughness)).rg;
 
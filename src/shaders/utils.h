@@ -33,6 +33,20 @@ vec2 hammersley2d(uint i, uint N)
     return vec2(float(i) / float(N), radicalInverseVdC(i));
 }
 
+// the 9 real spherical harmonics of bands 0 to 2, dir must be normalized
+void evalShBasis(vec3 dir, out float basis[9])
+{
+    basis[0] = 0.282095f;
+    basis[1] = 0.488603f * dir.y;
+    basis[2] = 0.488603f * dir.z;
+    basis[3] = 0.488603f * dir.x;
+    basis[4] = 1.092548f * dir.x * dir.y;
+    basis[5] = 1.092548f * dir.y * dir.z;
+    basis[6] = 0.315392f * (3.f * dir.z * dir.z - 1.f);
+    basis[7] = 1.092548f * dir.x * dir.z;
+    basis[8] = 0.546274f * (dir.x * dir.x - dir.y * dir.y);
+}
+
 vec3 mix3(vec3 colors[3], float value)
 {
     vec3 m1 = mix(colors[0], colors[1], 2.f * value);